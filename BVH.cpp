@@ -0,0 +1,241 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+void BVH::build(std::vector< Box > const &boxes) {
+	item_boxes = boxes;
+	nodes.clear();
+	leaf_items.resize(boxes.size());
+	item_leaf.assign(boxes.size(), -1U);
+	dirty_leaves.clear();
+
+	for (uint32_t i = 0; i < boxes.size(); ++i) {
+		leaf_items[i] = i;
+	}
+
+	if (boxes.empty()) {
+		leaf_dirty.clear();
+		return;
+	}
+
+	//centers are what get split on:
+	std::vector< glm::vec3 > centers(boxes.size());
+	for (uint32_t i = 0; i < boxes.size(); ++i) {
+		centers[i] = 0.5f * (boxes[i].min + boxes[i].max);
+	}
+
+	//top-down build, splitting at the median of the longest axis of the centers' bounds:
+	// (work list holds node index + range of leaf_items it covers)
+	struct Todo {
+		uint32_t node;
+		uint32_t begin, end;
+	};
+	std::vector< Todo > todo;
+	nodes.reserve(2 * (boxes.size() / LeafSize + 1));
+	nodes.emplace_back();
+	todo.emplace_back(Todo{0, 0, uint32_t(boxes.size())});
+
+	while (!todo.empty()) {
+		Todo at = todo.back();
+		todo.pop_back();
+
+		Box bounds;
+		Box center_bounds;
+		for (uint32_t i = at.begin; i < at.end; ++i) {
+			bounds.expand(boxes[leaf_items[i]]);
+			center_bounds.expand(Box(centers[leaf_items[i]], centers[leaf_items[i]]));
+		}
+		nodes[at.node].box = bounds;
+
+		if (at.end - at.begin <= LeafSize) {
+			nodes[at.node].first = at.begin;
+			nodes[at.node].count = at.end - at.begin;
+			for (uint32_t i = at.begin; i < at.end; ++i) {
+				item_leaf[leaf_items[i]] = at.node;
+			}
+			continue;
+		}
+
+		glm::vec3 size = center_bounds.max - center_bounds.min;
+		uint32_t axis = 0;
+		if (size.y > size[axis]) axis = 1;
+		if (size.z > size[axis]) axis = 2;
+
+		uint32_t mid = at.begin + (at.end - at.begin) / 2;
+		std::nth_element(leaf_items.begin() + at.begin, leaf_items.begin() + mid, leaf_items.begin() + at.end, [&](uint32_t a, uint32_t b) {
+			return centers[a][axis] < centers[b][axis];
+		});
+
+		uint32_t left = uint32_t(nodes.size());
+		nodes.emplace_back();
+		nodes.emplace_back();
+		nodes[at.node].first = left;
+		nodes[at.node].count = 0;
+		nodes[left].parent = at.node;
+		nodes[left+1].parent = at.node;
+
+		todo.emplace_back(Todo{left, at.begin, mid});
+		todo.emplace_back(Todo{left+1, mid, at.end});
+	}
+
+	leaf_dirty.assign(nodes.size(), 0);
+}
+
+void BVH::set_box(uint32_t item, Box const &box) {
+	assert(item < item_boxes.size());
+	item_boxes[item] = box;
+	uint32_t leaf = item_leaf[item];
+	if (!leaf_dirty[leaf]) {
+		leaf_dirty[leaf] = 1;
+		dirty_leaves.emplace_back(leaf);
+	}
+}
+
+void BVH::refit() {
+	refit_nodes = 0;
+	for (uint32_t leaf : dirty_leaves) {
+		leaf_dirty[leaf] = 0;
+
+		Node &node = nodes[leaf];
+		Box box;
+		for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+			box.expand(item_boxes[leaf_items[i]]);
+		}
+		node.box = box;
+		refit_nodes += 1;
+
+		//walk up, stopping once a parent's box doesn't change:
+		for (uint32_t n = node.parent; n != -1U; n = nodes[n].parent) {
+			Box merged = nodes[nodes[n].first].box;
+			merged.expand(nodes[nodes[n].first + 1].box);
+			refit_nodes += 1;
+			if (merged.min == nodes[n].box.min && merged.max == nodes[n].box.max) break;
+			nodes[n].box = merged;
+		}
+	}
+	dirty_leaves.clear();
+}
+
+void BVH::query_frustum(Frustum const &frustum, std::vector< uint32_t > *items) const {
+	assert(items);
+	if (nodes.empty()) return;
+
+	//box vs frustum, also noting planes the box is entirely inside (children don't need to test those):
+	auto classify = [&frustum](Box const &box, uint32_t &mask) -> bool {
+		glm::vec3 center = 0.5f * (box.min + box.max);
+		glm::vec3 extent = 0.5f * (box.max - box.min);
+		for (uint32_t p = 0; p < 6; ++p) {
+			if (!(mask & (1 << p))) continue;
+			glm::vec4 const &plane = frustum.planes[p];
+			float d = glm::dot(glm::vec3(plane), center) + plane.w;
+			float r = glm::dot(glm::abs(glm::vec3(plane)), extent);
+			if (d + r < 0.0f) return false; //outside
+			if (d - r >= 0.0f) mask &= ~(1 << p); //entirely inside this plane
+		}
+		return true;
+	};
+
+	struct Todo {
+		uint32_t node;
+		uint32_t mask; //planes that still need testing
+	};
+	std::vector< Todo > todo;
+	todo.emplace_back(Todo{0, 0x3f});
+	while (!todo.empty()) {
+		Todo at = todo.back();
+		todo.pop_back();
+		Node const &node = nodes[at.node];
+		if (at.mask && !classify(node.box, at.mask)) continue;
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				uint32_t mask = at.mask;
+				if (!mask || classify(item_boxes[leaf_items[i]], mask)) items->emplace_back(leaf_items[i]);
+			}
+		} else {
+			todo.emplace_back(Todo{node.first, at.mask});
+			todo.emplace_back(Todo{node.first + 1, at.mask});
+		}
+	}
+}
+
+void BVH::query_box(Box const &box, std::vector< uint32_t > *items) const {
+	assert(items);
+	if (nodes.empty()) return;
+
+	std::vector< uint32_t > todo;
+	todo.emplace_back(0);
+	while (!todo.empty()) {
+		Node const &node = nodes[todo.back()];
+		todo.pop_back();
+		if (!node.box.overlaps(box)) continue;
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				if (item_boxes[leaf_items[i]].overlaps(box)) items->emplace_back(leaf_items[i]);
+			}
+		} else {
+			todo.emplace_back(node.first);
+			todo.emplace_back(node.first + 1);
+		}
+	}
+}
+
+uint32_t BVH::raycast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, float *t_) const {
+	if (nodes.empty()) return -1U;
+
+	glm::vec3 inv_dir = 1.0f / direction; //(infinities for zero components are fine for slab tests)
+
+	//ray vs box (slab test); returns entry distance or +infinity on miss:
+	auto hit = [&](Box const &box, float limit) -> float {
+		glm::vec3 t0 = (box.min - origin) * inv_dir;
+		glm::vec3 t1 = (box.max - origin) * inv_dir;
+		glm::vec3 near = glm::min(t0, t1);
+		glm::vec3 far = glm::max(t0, t1);
+		float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+		float exit = std::min(std::min(far.x, far.y), std::min(far.z, limit));
+		return (enter <= exit ? enter : std::numeric_limits< float >::infinity());
+	};
+
+	uint32_t best = -1U;
+	float best_t = max_t;
+
+	//depth-first, visiting nearer child first, skipping anything farther than current best:
+	struct Todo {
+		uint32_t node;
+		float t;
+	};
+	std::vector< Todo > todo;
+	float root_t = hit(nodes[0].box, best_t);
+	if (root_t != std::numeric_limits< float >::infinity()) todo.emplace_back(Todo{0, root_t});
+	while (!todo.empty()) {
+		Todo at = todo.back();
+		todo.pop_back();
+		if (at.t > best_t) continue;
+		Node const &node = nodes[at.node];
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				float t = hit(item_boxes[leaf_items[i]], best_t);
+				//(t is +infinity on a miss, which would equal best_t when max_t is infinite)
+				if (t != std::numeric_limits< float >::infinity() && (t < best_t || (t == best_t && best == -1U))) {
+					best_t = t;
+					best = leaf_items[i];
+				}
+			}
+		} else {
+			float ta = hit(nodes[node.first].box, best_t);
+			float tb = hit(nodes[node.first + 1].box, best_t);
+			//push farther child first so nearer child is popped first:
+			if (ta <= tb) {
+				if (tb != std::numeric_limits< float >::infinity()) todo.emplace_back(Todo{node.first + 1, tb});
+				if (ta != std::numeric_limits< float >::infinity()) todo.emplace_back(Todo{node.first, ta});
+			} else {
+				if (ta != std::numeric_limits< float >::infinity()) todo.emplace_back(Todo{node.first, ta});
+				if (tb != std::numeric_limits< float >::infinity()) todo.emplace_back(Todo{node.first + 1, tb});
+			}
+		}
+	}
+
+	if (best != -1U && t_) *t_ = best_t;
+	return best;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+/*
+ * BVH is a bounding volume hierarchy over a set of axis-aligned boxes
+ *  ("items", identified by index), supporting:
+ *  - frustum queries (e.g., culling)
+ *  - ray casts (e.g., mouse picking)
+ *  - box overlap queries (e.g., "what is near this?")
+ *
+ * After build(), boxes can move: set_box() records the new box and refit()
+ *  then updates only the nodes above moved items. Adding or removing items
+ *  needs a new build().
+ *
+ * (Refitting keeps the tree's structure, so if items move very far the
+ *  tree gets looser; rebuild every so often if that matters.)
+ *
+ * Scene uses this (see Scene::update_bvh) to index drawables.
+ *
+ */
+
+#include "Frustum.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+struct BVH {
+	struct Box {
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		Box() = default;
+		Box(glm::vec3 const &min_, glm::vec3 const &max_) : min(min_), max(max_) { }
+		void expand(Box const &o) { min = glm::min(min, o.min); max = glm::max(max, o.max); }
+		bool overlaps(Box const &o) const {
+			return min.x <= o.max.x && o.min.x <= max.x
+			    && min.y <= o.max.y && o.min.y <= max.y
+			    && min.z <= o.max.z && o.min.z <= max.z;
+		}
+	};
+
+	//(re-)build tree over items 0 .. boxes.size()-1:
+	void build(std::vector< Box > const &boxes);
+
+	//change the box of an item (takes effect at the next refit()):
+	void set_box(uint32_t item, Box const &box);
+	//update node boxes above items changed with set_box():
+	void refit();
+
+	//items whose boxes are (at least partly) inside the frustum:
+	void query_frustum(Frustum const &frustum, std::vector< uint32_t > *items) const;
+	//items whose boxes overlap 'box':
+	void query_box(Box const &box, std::vector< uint32_t > *items) const;
+	//item whose box is hit first by the ray origin + t * direction, t in [0, max_t]:
+	// returns -1U if nothing is hit; sets *t to the distance (in units of 'direction') to the box.
+	uint32_t raycast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t = std::numeric_limits< float >::infinity(), float *t = nullptr) const;
+
+	size_t size() const { return item_boxes.size(); }
+
+	//-- internals --
+	enum : uint32_t { LeafSize = 4 }; //max items per leaf
+
+	struct Node {
+		Box box;
+		uint32_t parent = -1U;
+		uint32_t first = 0; //leaf: first index in 'leaf_items'; interior: index of left child (right child is first+1)
+		uint32_t count = 0; //leaf: number of items; interior: 0
+	};
+	std::vector< Node > nodes; //nodes[0] is the root
+	std::vector< uint32_t > leaf_items; //item indices, grouped by leaf
+	std::vector< uint32_t > item_leaf; //leaf node containing each item
+	std::vector< Box > item_boxes; //current box for each item
+
+	std::vector< uint32_t > dirty_leaves; //leaves with items changed since last refit
+	std::vector< uint8_t > leaf_dirty; //(per node) is this leaf already in dirty_leaves?
+
+	uint32_t refit_nodes = 0; //stats: nodes touched by last refit()
+};
@@ -0,0 +1,141 @@
+#include "ChunkReader.hpp"
+
+#include <cassert>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(std::string const &filename) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open '" + filename + "' for mapping.");
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(file_size.QuadPart);
+	file_handle = file;
+	if (size == 0) return; //can't map empty files, but they are valid
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		file_handle = nullptr;
+		throw std::runtime_error("Failed to create mapping of '" + filename + "'.");
+	}
+	mapping_handle = mapping;
+	data = reinterpret_cast< uint8_t const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!data) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		mapping_handle = file_handle = nullptr;
+		throw std::runtime_error("Failed to map view of '" + filename + "'.");
+	}
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to open '" + filename + "' for mapping.");
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(st.st_size);
+	if (size != 0) {
+		void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Failed to map '" + filename + "'.");
+		}
+		data = reinterpret_cast< uint8_t const * >(mapped);
+		//chunks are read front-to-back, so let the kernel read ahead aggressively
+		// (advice values aren't flags, so each needs its own call):
+		madvise(mapped, size, MADV_SEQUENTIAL);
+		madvise(mapped, size, MADV_WILLNEED);
+	}
+	//the mapping keeps the file contents alive, so the descriptor isn't needed any more:
+	close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+	if (data) UnmapViewOfFile(data);
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle) CloseHandle(file_handle);
+#else
+	if (data) munmap(const_cast< uint8_t * >(data), size);
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+//------------------------------------
+
+ChunkReader::ChunkReader(std::string const &filename_) : filename(filename_), file(filename_), rest_stream(&rest_buf) {
+}
+
+uint8_t const *ChunkReader::read_raw(std::string const &magic, size_t alignment, size_t element_size, size_t *bytes) {
+	assert(magic.size() == 4);
+	assert(bytes);
+	assert(alignment <= alignof(uint64_t) && "realigned storage is only 8-byte aligned");
+
+	ChunkHeader header;
+	if (offset > file.size || file.size - offset < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header from '" + filename + "'");
+	}
+	std::memcpy(&header, file.data + offset, sizeof(header));
+	if (std::string(header.magic, 4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk of '" + filename + "' (expected '" + magic + "', got '" + std::string(header.magic, 4) + "')");
+	}
+	if (header.size % element_size != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size.");
+	}
+	offset += sizeof(header);
+	if (file.size - offset < header.size) {
+		throw std::runtime_error("Failed to read chunk data from '" + filename + "'.");
+	}
+
+	uint8_t const *data = file.data + offset;
+	offset += header.size;
+	*bytes = header.size;
+
+	if (header.size != 0 && reinterpret_cast< uintptr_t >(data) % alignment != 0) {
+		//misaligned (happens after chunks with odd sizes) -- copy to aligned storage:
+		realigned.emplace_back((header.size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+		std::memcpy(realigned.back().data(), data, header.size);
+		data = reinterpret_cast< uint8_t const * >(realigned.back().data());
+	}
+
+	return data;
+}
+
+bool ChunkReader::peek(std::string const &magic) const {
+	assert(magic.size() == 4);
+	if (offset > file.size || file.size - offset < sizeof(ChunkHeader)) return false;
+	return std::memcmp(file.data + offset, magic.data(), 4) == 0;
+}
+
+std::istream &ChunkReader::rest() {
+	uint8_t const *end = file.data + file.size;
+	uint8_t const *begin = (offset < file.size ? file.data + offset : end);
+	rest_buf.set(begin, end);
+	rest_stream.clear();
+	return rest_stream;
+}
+
+void ChunkReader::skip(size_t bytes) {
+	offset += bytes;
+}
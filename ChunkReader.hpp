@@ -0,0 +1,119 @@
+#pragma once
+
+/*
+ * ChunkReader reads the same chunked format as read_chunk() (see
+ * read_write_chunk.hpp), but from a memory-mapped file, handing back
+ * Span<>s that point directly into the mapping instead of copying into
+ * std::vector<>s.
+ *
+ * This means file data goes straight from the page cache to wherever it is
+ * consumed (e.g., glBufferData), with no intermediate copies.
+ *
+ * Spans are valid as long as the ChunkReader that returned them is alive.
+ *
+ * (If a chunk's data happens not to be suitably aligned for its element type
+ *  -- e.g., it follows a string chunk with an odd length -- the reader copies
+ *  it into aligned storage that it owns, so spans are always safe to use.)
+ *
+ */
+
+#include <string>
+#include <istream>
+#include <streambuf>
+#include <list>
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+//A (read-only) view of 'count' contiguous T's:
+template< typename T >
+struct Span {
+	T const *data_ = nullptr;
+	size_t size_ = 0;
+
+	Span() = default;
+	Span(T const *data__, size_t size__) : data_(data__), size_(size__) { }
+
+	T const *data() const { return data_; }
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+	T const &operator[](size_t i) const { return data_[i]; }
+	T const *begin() const { return data_; }
+	T const *end() const { return data_ + size_; }
+};
+
+//A read-only memory mapping of an entire file:
+struct MappedFile {
+	//note: will throw if file can't be opened or mapped.
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	uint8_t const *data = nullptr;
+	size_t size = 0;
+
+	//-- internals --
+	#ifdef _WIN32
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+	#endif
+};
+
+struct ChunkReader {
+	//map 'filename' for reading:
+	// note: will throw if file can't be opened.
+	ChunkReader(std::string const &filename);
+
+	//read the next chunk, which should have the given magic number:
+	// note: will throw on wrong magic, truncated data, or a size that isn't a multiple of sizeof(T).
+	template< typename T >
+	Span< T > read(std::string const &magic);
+
+	//does the next chunk have this magic number?
+	bool peek(std::string const &magic) const;
+
+	//are there any bytes left after the chunks read so far?
+	bool at_end() const { return offset >= file.size; }
+
+	//a std::istream over the rest of the file (for code that wants to read extra data its own way):
+	// note: reading from this stream doesn't advance the reader, but 'skip' can be used to do so.
+	std::istream &rest();
+	void skip(size_t bytes);
+
+	std::string filename;
+	MappedFile file;
+	size_t offset = 0; //byte offset of the next chunk header
+
+	//-- internals --
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	//returns pointer to chunk data (and advances past it):
+	uint8_t const *read_raw(std::string const &magic, size_t alignment, size_t element_size, size_t *bytes);
+
+	//storage for chunks that needed to be copied for alignment:
+	std::list< std::vector< uint64_t > > realigned;
+
+	struct MemoryBuf : std::streambuf {
+		void set(uint8_t const *begin, uint8_t const *end) {
+			char *b = const_cast< char * >(reinterpret_cast< char const * >(begin));
+			char *e = const_cast< char * >(reinterpret_cast< char const * >(end));
+			setg(b, b, e);
+		}
+	} rest_buf;
+	std::istream rest_stream;
+};
+
+template< typename T >
+Span< T > ChunkReader::read(std::string const &magic) {
+	size_t bytes = 0;
+	uint8_t const *data = read_raw(magic, alignof(T), sizeof(T), &bytes);
+	return Span< T >(reinterpret_cast< T const * >(data), bytes / sizeof(T));
+}
@@ -0,0 +1,94 @@
+#include "Frustum.hpp"
+
+#include <cassert>
+#include <cmath>
+
+Frustum::Frustum(glm::mat4 const &world_to_clip) {
+	//Plane extraction as per Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix":
+	// a point is inside if -w <= x,y,z <= w (in clip space), so each plane is (row 3) +/- (row i).
+	glm::mat4 const &m = world_to_clip;
+	glm::vec4 row[4];
+	for (uint32_t r = 0; r < 4; ++r) {
+		row[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+	}
+	planes[0] = row[3] + row[0]; //left
+	planes[1] = row[3] - row[0]; //right
+	planes[2] = row[3] + row[1]; //bottom
+	planes[3] = row[3] - row[1]; //top
+	planes[4] = row[3] + row[2]; //near
+	planes[5] = row[3] - row[2]; //far
+
+	//normalizing isn't needed for inside/outside tests, but keeps offsets in world units:
+	for (auto &plane : planes) {
+		float len = glm::length(glm::vec3(plane));
+		if (len > 0.0f) plane /= len;
+	}
+}
+
+void BoxBatch::clear() {
+	center_x.clear(); center_y.clear(); center_z.clear();
+	extent_x.clear(); extent_y.clear(); extent_z.clear();
+}
+
+void BoxBatch::reserve(size_t count) {
+	center_x.reserve(count); center_y.reserve(count); center_z.reserve(count);
+	extent_x.reserve(count); extent_y.reserve(count); extent_z.reserve(count);
+}
+
+void BoxBatch::add(glm::mat4x3 const &to_world, glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 center = 0.5f * (max + min);
+	glm::vec3 extent = 0.5f * (max - min);
+
+	//center transforms as a point; extent by the absolute value of the linear part (Arvo's method):
+	glm::vec3 world_center = to_world * glm::vec4(center, 1.0f);
+	glm::vec3 world_extent =
+		  glm::abs(to_world[0]) * extent.x
+		+ glm::abs(to_world[1]) * extent.y
+		+ glm::abs(to_world[2]) * extent.z;
+
+	center_x.emplace_back(world_center.x);
+	center_y.emplace_back(world_center.y);
+	center_z.emplace_back(world_center.z);
+	extent_x.emplace_back(world_extent.x);
+	extent_y.emplace_back(world_extent.y);
+	extent_z.emplace_back(world_extent.z);
+}
+
+uint32_t cull_boxes(Frustum const &frustum, BoxBatch const &boxes, uint8_t *visible) {
+	assert(visible || boxes.size() == 0);
+
+	size_t const count = boxes.size();
+	float const *cx = boxes.center_x.data();
+	float const *cy = boxes.center_y.data();
+	float const *cz = boxes.center_z.data();
+	float const *ex = boxes.extent_x.data();
+	float const *ey = boxes.extent_y.data();
+	float const *ez = boxes.extent_z.data();
+
+	//process boxes in fixed-size batches with no data-dependent branches, so the inner loops vectorize:
+	constexpr size_t Batch = 16;
+	uint32_t total = 0;
+	for (size_t base = 0; base < count; base += Batch) {
+		size_t n = (count - base < Batch ? count - base : Batch);
+
+		float inside[Batch];
+		for (size_t i = 0; i < Batch; ++i) inside[i] = 1.0f;
+
+		for (auto const &plane : frustum.planes) {
+			float const px = plane.x, py = plane.y, pz = plane.z, pw = plane.w;
+			float const ax = std::abs(px), ay = std::abs(py), az = std::abs(pz);
+			for (size_t i = 0; i < n; ++i) {
+				//signed distance of center, and 'radius' of box projected onto the plane normal:
+				float d = px * cx[base+i] + py * cy[base+i] + pz * cz[base+i] + pw;
+				float r = ax * ex[base+i] + ay * ey[base+i] + az * ez[base+i];
+				inside[i] = (d + r >= 0.0f ? inside[i] : 0.0f);
+			}
+		}
+
+		for (size_t i = 0; i < n; ++i) {
+			visible[base+i] = (inside[i] != 0.0f ? 1 : 0);
+			total += visible[base+i];
+		}
+	}
+	return total;
+}
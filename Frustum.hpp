@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ * Frustum culling helpers.
+ *
+ * A Frustum is six planes pulled from a world-to-clip matrix; BoxBatch holds
+ *  many world-space axis-aligned boxes in structure-of-arrays form, and
+ *  cull_boxes() tests a whole batch against a frustum in branch-free loops
+ *  that the compiler can vectorize.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct Frustum {
+	//planes as (normal, offset); a point p is inside if dot(normal, p) + offset >= 0 for every plane:
+	// (order: left, right, bottom, top, near, far)
+	glm::vec4 planes[6];
+
+	Frustum() = default;
+	//extract planes from a world-to-clip matrix:
+	// (works with infinite perspective matrices -- the far plane just never rejects anything)
+	explicit Frustum(glm::mat4 const &world_to_clip);
+};
+
+//world-space axis-aligned boxes, stored as center + half-extent:
+struct BoxBatch {
+	std::vector< float > center_x, center_y, center_z;
+	std::vector< float > extent_x, extent_y, extent_z;
+
+	size_t size() const { return center_x.size(); }
+	void clear();
+	void reserve(size_t count);
+
+	//add a box given in object space, transformed into world space by 'to_world':
+	// (the result is the world-space box containing the transformed object-space box)
+	void add(glm::mat4x3 const &to_world, glm::vec3 const &min, glm::vec3 const &max);
+};
+
+//set visible[i] to 1 if box i is (at least partly) inside the frustum, 0 otherwise:
+// returns the number of visible boxes.
+// (conservative: boxes near frustum corners may be reported visible when they aren't)
+uint32_t cull_boxes(Frustum const &frustum, BoxBatch const &boxes, uint8_t *visible);
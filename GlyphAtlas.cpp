@@ -0,0 +1,209 @@
+#include "GlyphAtlas.hpp"
+
+#include "gl_errors.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <cstring>
+
+GlyphAtlas::GlyphAtlas(FT_Face face_, glm::uvec2 page_size_, uint32_t max_pages_)
+	: face(face_), page_size(page_size_), max_pages(max_pages_) {
+	if (max_pages == 0) throw std::runtime_error("GlyphAtlas needs at least one page.");
+	add_page();
+}
+
+GlyphAtlas::~GlyphAtlas() {
+	for (auto &page : pages) {
+		glDeleteTextures(1, &page.texture);
+		page.texture = 0;
+	}
+}
+
+GlyphAtlas::Glyph const &GlyphAtlas::get(FT_UInt glyph_index) {
+	auto f = glyphs.find(glyph_index);
+	if (f != glyphs.end()) {
+		counters.hits += 1;
+		if (f->second.size.x > 0 && f->second.size.y > 0) {
+			pages[f->second.page].last_used = batch;
+		}
+		return f->second;
+	}
+	counters.misses += 1;
+
+	if (FT_Load_Glyph(face, glyph_index, FT_LOAD_RENDER)) {
+		throw std::runtime_error("Failed to load glyph " + std::to_string(glyph_index));
+	}
+	FT_Bitmap const &bitmap = face->glyph->bitmap;
+
+	Glyph glyph;
+	glyph.size = glm::ivec2(bitmap.width, bitmap.rows);
+	glyph.bearing = glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top);
+	glyph.advance = uint32_t(face->glyph->advance.x);
+
+	if (glyph.size.x > 0 && glyph.size.y > 0) {
+		//glyphs are stored with a one-pixel empty border so linear filtering doesn't bleed between neighbors:
+		glm::uvec2 padded = glm::uvec2(glyph.size) + glm::uvec2(2);
+		if (padded.x > page_size.x || padded.y > page_size.y) {
+			throw std::runtime_error("Glyph " + std::to_string(glyph_index) + " is larger than an atlas page.");
+		}
+
+		glm::uvec2 at;
+		glyph.page = allocate(padded, &at);
+
+		//copy bitmap rows (which may have a pitch different from their width) into padded scratch:
+		scratch.assign(padded.x * padded.y, 0);
+		for (uint32_t row = 0; row < bitmap.rows; ++row) {
+			std::memcpy(&scratch[(row + 1) * padded.x + 1], bitmap.buffer + int(row) * bitmap.pitch, bitmap.width);
+		}
+
+		glBindTexture(GL_TEXTURE_2D, pages[glyph.page].texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, at.x, at.y, padded.x, padded.y, GL_RED, GL_UNSIGNED_BYTE, scratch.data());
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glyph.uv_min = glm::vec2(at + glm::uvec2(1)) / glm::vec2(page_size);
+		glyph.uv_max = glm::vec2(at + glm::uvec2(1) + glm::uvec2(glyph.size)) / glm::vec2(page_size);
+
+		Page &page = pages[glyph.page];
+		page.used_pixels += uint64_t(padded.x) * uint64_t(padded.y);
+		page.glyphs += 1;
+		page.last_used = batch;
+	}
+
+	return glyphs.emplace(glyph_index, glyph).first->second;
+}
+
+void GlyphAtlas::begin_batch() {
+	batch += 1;
+}
+
+uint32_t GlyphAtlas::allocate(glm::uvec2 const &size, glm::uvec2 *at) {
+	//first, try to fit into an existing page:
+	for (uint32_t p = 0; p < pages.size(); ++p) {
+		if (allocate_in(pages[p], size, at)) return p;
+	}
+
+	//next, grow if allowed:
+	if (pages.size() < max_pages) {
+		uint32_t p = add_page();
+		if (!allocate_in(pages[p], size, at)) throw std::runtime_error("Glyph doesn't fit in an empty atlas page.");
+		return p;
+	}
+
+	//otherwise, evict the least-recently-used page that isn't part of the current batch:
+	uint32_t victim = -1U;
+	for (uint32_t p = 0; p < pages.size(); ++p) {
+		if (pages[p].last_used == batch) continue;
+		if (victim == -1U || pages[p].last_used < pages[victim].last_used) victim = p;
+	}
+	if (victim == -1U) {
+		//every page is needed by this batch, so all we can do is grow past the limit:
+		counters.overflows += 1;
+		victim = add_page();
+	} else {
+		evict(victim);
+	}
+
+	if (!allocate_in(pages[victim], size, at)) throw std::runtime_error("Glyph doesn't fit in an empty atlas page.");
+	return victim;
+}
+
+bool GlyphAtlas::allocate_in(Page &page, glm::uvec2 const &size, glm::uvec2 *at) {
+	//best fit: the shelf with room whose height wastes the fewest rows:
+	Page::Shelf *best = nullptr;
+	for (auto &shelf : page.shelves) {
+		if (shelf.height < size.y) continue;
+		if (shelf.x + size.x > page_size.x) continue;
+		if (best == nullptr || shelf.height < best->height) best = &shelf;
+	}
+
+	//don't put short glyphs on much taller shelves if a new shelf would fit:
+	if (best && best->height > size.y + size.y / 2 && page.used_y + size.y <= page_size.y) {
+		best = nullptr;
+	}
+
+	if (!best) {
+		if (page.used_y + size.y > page_size.y) return false;
+		page.shelves.emplace_back();
+		best = &page.shelves.back();
+		best->y = page.used_y;
+		best->height = size.y;
+		best->x = 0;
+		page.used_y += size.y;
+	}
+
+	*at = glm::uvec2(best->x, best->y);
+	best->x += size.x;
+	return true;
+}
+
+uint32_t GlyphAtlas::add_page() {
+	pages.emplace_back();
+	Page &page = pages.back();
+	page.last_used = batch;
+
+	glGenTextures(1, &page.texture);
+	glBindTexture(GL_TEXTURE_2D, page.texture);
+	std::vector< uint8_t > zeros(page_size.x * page_size.y, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, page_size.x, page_size.y, 0, GL_RED, GL_UNSIGNED_BYTE, zeros.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GL_ERRORS();
+
+	return uint32_t(pages.size()) - 1;
+}
+
+void GlyphAtlas::evict(uint32_t p) {
+	Page &page = pages[p];
+
+	for (auto g = glyphs.begin(); g != glyphs.end(); /* later */) {
+		if (g->second.page == p && g->second.size.x > 0 && g->second.size.y > 0) {
+			g = glyphs.erase(g);
+			counters.evicted_glyphs += 1;
+		} else {
+			++g;
+		}
+	}
+
+	//clear texels so that the padding around newly-packed glyphs is empty:
+	std::vector< uint8_t > zeros(page_size.x * page_size.y, 0);
+	glBindTexture(GL_TEXTURE_2D, page.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, page_size.x, page_size.y, GL_RED, GL_UNSIGNED_BYTE, zeros.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	page.shelves.clear();
+	page.used_y = 0;
+	page.used_pixels = 0;
+	page.glyphs = 0;
+	page.last_used = batch;
+
+	counters.evictions += 1;
+	generation += 1;
+}
+
+GlyphAtlas::Stats GlyphAtlas::stats() const {
+	Stats ret = counters;
+	ret.pages = uint32_t(pages.size());
+	ret.glyphs = uint32_t(glyphs.size());
+	ret.used_pixels = 0;
+	for (auto const &page : pages) {
+		ret.used_pixels += page.used_pixels;
+	}
+	ret.total_pixels = uint64_t(pages.size()) * uint64_t(page_size.x) * uint64_t(page_size.y);
+	return ret;
+}
+
+void GlyphAtlas::print_stats(std::ostream &out) const {
+	Stats s = stats();
+	out << "Glyph atlas: " << s.glyphs << " glyphs in " << s.pages << "/" << max_pages << " pages of "
+	    << page_size.x << "x" << page_size.y << " (" << int(s.occupancy() * 100.0f + 0.5f) << "% occupied); "
+	    << s.hits << " hits, " << s.misses << " misses, "
+	    << s.evictions << " evictions (" << s.evicted_glyphs << " glyphs), "
+	    << s.overflows << " overflow pages." << std::endl;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+/*
+ * A GlyphAtlas packs rendered glyph bitmaps into a few large single-channel
+ * textures ("pages") so that a whole string can be drawn with one texture bind.
+ *
+ * Glyphs are rendered with FreeType the first time they are requested and
+ * placed into the pages with a simple shelf packer. Later requests are just a
+ * hash lookup.
+ *
+ * When every page is full, the least-recently-used page (one that was not
+ * touched by the current batch) is cleared and reused. Every such eviction
+ * bumps 'generation', so code that caches texture coordinates can tell when
+ * they are stale.
+ *
+ */
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+
+struct GlyphAtlas {
+	//NOTE: the atlas renders glyphs with whatever size is currently set on 'face':
+	GlyphAtlas(FT_Face face, glm::uvec2 page_size = glm::uvec2(512, 512), uint32_t max_pages = 4);
+	~GlyphAtlas();
+
+	//atlas owns GL textures, so copying is not allowed:
+	GlyphAtlas(GlyphAtlas const &) = delete;
+	GlyphAtlas &operator=(GlyphAtlas const &) = delete;
+
+	struct Glyph {
+		uint32_t page = 0;     //index of texture page holding glyph
+		glm::vec2 uv_min;      //texture coordinates of glyph's top-left corner
+		glm::vec2 uv_max;      //texture coordinates of glyph's bottom-right corner
+		glm::ivec2 size;       //size of glyph bitmap (pixels)
+		glm::ivec2 bearing;    //offset from baseline to top left of glyph (pixels)
+		uint32_t advance = 0;  //offset to advance to next glyph (1/64 pixels)
+	};
+
+	//look up a glyph (by FreeType glyph index), rendering and packing it if needed:
+	// note: will throw if the glyph fails to load or doesn't fit in a page.
+	// note: the returned reference is only valid until the next call to get().
+	Glyph const &get(FT_UInt glyph_index);
+
+	//start a new batch of get() calls; pages used in the current batch are never evicted:
+	void begin_batch();
+
+	//texture object for a page:
+	GLuint page_texture(uint32_t page) const { return pages[page].texture; }
+	uint32_t page_count() const { return uint32_t(pages.size()); }
+
+	//incremented whenever previously-returned glyph placements become invalid:
+	uint32_t generation = 0;
+
+	//----- stats (useful for sizing the atlas) -----
+	struct Stats {
+		uint32_t pages = 0;          //pages currently allocated
+		uint32_t glyphs = 0;         //glyphs currently resident
+		uint64_t used_pixels = 0;    //pixels covered by resident glyphs (including padding)
+		uint64_t total_pixels = 0;   //pixels in all allocated pages
+		uint64_t hits = 0;           //get() calls that found a resident glyph
+		uint64_t misses = 0;         //get() calls that had to render a glyph
+		uint64_t evictions = 0;      //pages cleared to make room
+		uint64_t evicted_glyphs = 0; //glyphs dropped by those evictions
+		uint64_t overflows = 0;      //pages allocated past max_pages because every page was in use by one batch
+
+		float occupancy() const { return total_pixels ? float(used_pixels) / float(total_pixels) : 0.0f; }
+	};
+	Stats stats() const;
+	void print_stats(std::ostream &out) const;
+
+	//-- internals --
+	FT_Face face;
+	glm::uvec2 page_size;
+	uint32_t max_pages;
+
+	struct Page {
+		GLuint texture = 0;
+		//shelves are horizontal strips of height 'height' starting at row 'y', filled left-to-right up to 'x':
+		struct Shelf {
+			uint32_t y = 0;
+			uint32_t height = 0;
+			uint32_t x = 0;
+		};
+		std::vector< Shelf > shelves;
+		uint32_t used_y = 0; //rows claimed by shelves so far
+		uint64_t used_pixels = 0;
+		uint32_t glyphs = 0;
+		uint32_t last_used = 0; //batch in which this page was last touched
+	};
+	std::vector< Page > pages;
+
+	std::unordered_map< FT_UInt, Glyph > glyphs;
+
+	uint32_t batch = 1;
+	Stats counters; //hits / misses / evictions / overflows; the rest are computed in stats()
+
+	std::vector< uint8_t > scratch; //padded copy of a glyph bitmap for upload
+
+	//find space for a w x h rectangle, evicting a page if needed; returns page index and sets *at:
+	uint32_t allocate(glm::uvec2 const &size, glm::uvec2 *at);
+	//try to place a rectangle in a particular page:
+	bool allocate_in(Page &page, glm::uvec2 const &size, glm::uvec2 *at);
+	uint32_t add_page();
+	void evict(uint32_t page);
+};
@@ -0,0 +1,141 @@
+#include "LitColorTextureInstancedProgram.hpp"
+#include "LitColorTextureProgram.hpp"
+
+#include "gl_compile_program.hpp"
+#include "gl_errors.hpp"
+
+#include <cstddef>
+
+Load< LitColorTextureInstancedProgram > lit_color_texture_instanced_program(LoadTagEarly, []() -> LitColorTextureInstancedProgram const * {
+	LitColorTextureInstancedProgram *ret = new LitColorTextureInstancedProgram();
+
+	//----- let the (non-instanced) pipeline template know about this variant -----
+	lit_color_texture_program_pipeline.instancing.program = ret->program;
+	lit_color_texture_program_pipeline.instancing.instance_buffer = ret->instance_buffer;
+	//NOTE: instancing.vao still needs to be set per-MeshBuffer, using bind_instance_attributes
+
+	return ret;
+});
+
+LitColorTextureInstancedProgram::LitColorTextureInstancedProgram() {
+	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
+	program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"in mat4 OBJECT_TO_CLIP;\n"
+		"in mat4x3 OBJECT_TO_LIGHT;\n"
+		"in mat3 NORMAL_TO_LIGHT;\n"
+		"in vec4 Position;\n"
+		"in vec3 Normal;\n"
+		"in vec4 Color;\n"
+		"in vec2 TexCoord;\n"
+		"out vec3 position;\n"
+		"out vec3 normal;\n"
+		"out vec4 color;\n"
+		"out vec2 texCoord;\n"
+		"void main() {\n"
+		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
+		"	position = OBJECT_TO_LIGHT * Position;\n"
+		"	normal = NORMAL_TO_LIGHT * Normal;\n"
+		"	color = Color;\n"
+		"	texCoord = TexCoord;\n"
+		"}\n"
+	,
+		//fragment shader: (same as LitColorTextureProgram)
+		"#version 330\n"
+		"uniform sampler2D TEX;\n"
+		"uniform int LIGHT_TYPE;\n"
+		"uniform vec3 LIGHT_LOCATION;\n"
+		"uniform vec3 LIGHT_DIRECTION;\n"
+		"uniform vec3 LIGHT_ENERGY;\n"
+		"uniform float LIGHT_CUTOFF;\n"
+		"in vec3 position;\n"
+		"in vec3 normal;\n"
+		"in vec4 color;\n"
+		"in vec2 texCoord;\n"
+		"out vec4 fragColor;\n"
+		"void main() {\n"
+		"	vec3 n = normalize(normal);\n"
+		"	vec3 e;\n"
+		"	if (LIGHT_TYPE == 0) { //point light \n"
+		"		vec3 l = (LIGHT_LOCATION - position);\n"
+		"		float dis2 = dot(l,l);\n"
+		"		l = normalize(l);\n"
+		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+		"		e = nl * LIGHT_ENERGY;\n"
+		"	} else if (LIGHT_TYPE == 1) { //hemi light \n"
+		"		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
+		"	} else if (LIGHT_TYPE == 2) { //spot light \n"
+		"		vec3 l = (LIGHT_LOCATION - position);\n"
+		"		float dis2 = dot(l,l);\n"
+		"		l = normalize(l);\n"
+		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+		"		float c = dot(l,-LIGHT_DIRECTION);\n"
+		"		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
+		"		e = nl * LIGHT_ENERGY;\n"
+		"	} else { //(LIGHT_TYPE == 3) //directional light \n"
+		"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
+		"	}\n"
+		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
+		"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
+		"}\n"
+	);
+
+	//look up the locations of vertex attributes:
+	Position_vec4 = glGetAttribLocation(program, "Position");
+	Normal_vec3 = glGetAttribLocation(program, "Normal");
+	Color_vec4 = glGetAttribLocation(program, "Color");
+	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
+
+	OBJECT_TO_CLIP_mat4 = glGetAttribLocation(program, "OBJECT_TO_CLIP");
+	OBJECT_TO_LIGHT_mat4x3 = glGetAttribLocation(program, "OBJECT_TO_LIGHT");
+	NORMAL_TO_LIGHT_mat3 = glGetAttribLocation(program, "NORMAL_TO_LIGHT");
+
+	//look up the locations of uniforms:
+	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
+	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
+	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
+	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
+	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
+
+	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
+
+	//set TEX to always refer to texture binding zero:
+	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
+
+	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
+
+	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
+
+	//buffer for per-instance data (contents are streamed each draw):
+	glGenBuffers(1, &instance_buffer);
+
+	GL_ERRORS();
+}
+
+LitColorTextureInstancedProgram::~LitColorTextureInstancedProgram() {
+	glDeleteBuffers(1, &instance_buffer);
+	instance_buffer = 0;
+	glDeleteProgram(program);
+	program = 0;
+}
+
+void LitColorTextureInstancedProgram::bind_instance_attributes(std::set< GLuint > *bound) const {
+	using Instance = Scene::Drawable::Pipeline::Instance;
+
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	//each matrix column is a separate attribute location, advanced once per instance:
+	auto bind_columns = [&](GLuint location, GLint columns, GLint rows, size_t offset) {
+		if (location == -1U) return;
+		for (GLint c = 0; c < columns; ++c) {
+			glVertexAttribPointer(location + c, rows, GL_FLOAT, GL_FALSE, sizeof(Instance), (GLbyte *)0 + offset + c * rows * sizeof(float));
+			glEnableVertexAttribArray(location + c);
+			glVertexAttribDivisor(location + c, 1);
+			if (bound) bound->insert(location + c);
+		}
+	};
+	bind_columns(OBJECT_TO_CLIP_mat4, 4, 4, offsetof(Instance, OBJECT_TO_CLIP));
+	bind_columns(OBJECT_TO_LIGHT_mat4x3, 4, 3, offsetof(Instance, OBJECT_TO_LIGHT));
+	bind_columns(NORMAL_TO_LIGHT_mat3, 3, 3, offsetof(Instance, NORMAL_TO_LIGHT));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
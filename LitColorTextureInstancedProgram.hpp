@@ -0,0 +1,47 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Load.hpp"
+#include "Scene.hpp"
+
+#include <set>
+
+//Instanced variant of LitColorTextureProgram:
+// same lighting, but OBJECT_TO_CLIP, OBJECT_TO_LIGHT, and NORMAL_TO_LIGHT are per-instance attributes (streamed by Scene::draw)
+struct LitColorTextureInstancedProgram {
+	LitColorTextureInstancedProgram();
+	~LitColorTextureInstancedProgram();
+
+	GLuint program = 0;
+
+	//Attribute (per-vertex variable) locations:
+	GLuint Position_vec4 = -1U;
+	GLuint Normal_vec3 = -1U;
+	GLuint Color_vec4 = -1U;
+	GLuint TexCoord_vec2 = -1U;
+
+	//Attribute (per-instance variable) locations -- matrices take one location per column:
+	GLuint OBJECT_TO_CLIP_mat4 = -1U;
+	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
+	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
+
+	//Uniform (per-invocation variable) locations:
+	//lighting:
+	GLuint LIGHT_TYPE_int = -1U;
+	GLuint LIGHT_LOCATION_vec3 = -1U;
+	GLuint LIGHT_DIRECTION_vec3 = -1U;
+	GLuint LIGHT_ENERGY_vec3 = -1U;
+	GLuint LIGHT_CUTOFF_float = -1U;
+
+	//Textures:
+	//TEXTURE0 - texture that is accessed by TexCoord
+
+	//Buffer that Scene::draw streams per-instance data (Scene::Drawable::Pipeline::Instance) into:
+	GLuint instance_buffer = 0;
+
+	//Point per-instance attributes at instance_buffer in the currently-bound vertex array object:
+	// (pass to MeshBuffer::make_vao_for_program)
+	void bind_instance_attributes(std::set< GLuint > *bound) const;
+};
+
+extern Load< LitColorTextureInstancedProgram > lit_color_texture_instanced_program;
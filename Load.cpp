@@ -1,20 +1,52 @@
 #include "Load.hpp"
 
-#include <array>
-#include <list>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <cassert>
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
-		return load_lists;
+	struct LoadEntry {
+		LoadTag tag = LoadTagDefault;
+		void const *key = nullptr;
+		std::vector< void const * > after; //keys of loads that must finish first
+		std::function< void() > prepare; //runs on a worker (empty for tagged loads)
+		std::function< void() > finish; //runs on the main thread
+
+		//filled in by call_load_functions():
+		std::vector< uint32_t > dependents;
+		uint32_t waiting_on = 0;
+	};
+
+	std::vector< LoadEntry > &get_load_entries() {
+		static std::vector< LoadEntry > load_entries;
+		return load_entries;
 	}
 }
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn) {
-	auto &load_lists = get_load_lists();
-	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+void add_load_function(LoadTag tag, std::function< void() > const &fn, void const *key) {
+	assert(tag < MaxLoadTag);
+	auto &entries = get_load_entries();
+	entries.emplace_back();
+	entries.back().tag = tag;
+	entries.back().key = key;
+	entries.back().finish = fn;
+}
+
+void add_load_function(void const *key, std::vector< void const * > const &after, std::function< void() > const &prepare, std::function< void() > const &finish) {
+	assert(prepare && finish);
+	auto &entries = get_load_entries();
+	entries.emplace_back();
+	entries.back().tag = LoadTagDefault;
+	entries.back().key = key;
+	entries.back().after = after;
+	entries.back().prepare = prepare;
+	entries.back().finish = finish;
 }
 
 void call_load_functions() {
@@ -22,11 +54,156 @@ void call_load_functions() {
 	assert(!has_been_called && "call_load_functions should only be called *once*");
 	has_been_called = true;
 
-	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
-		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+	std::vector< LoadEntry > entries;
+	entries.swap(get_load_entries());
+	if (entries.empty()) return;
+
+	//--- build dependency graph ---
+	std::unordered_map< void const *, uint32_t > by_key;
+	for (uint32_t i = 0; i < entries.size(); ++i) {
+		if (entries[i].key) by_key.emplace(entries[i].key, i);
+	}
+
+	auto add_edge = [&entries](uint32_t before, uint32_t after) {
+		entries[before].dependents.emplace_back(after);
+		entries[after].waiting_on += 1;
+	};
+
+	for (uint32_t i = 0; i < entries.size(); ++i) {
+		LoadEntry &entry = entries[i];
+		//explicit dependencies:
+		for (void const *key : entry.after) {
+			auto f = by_key.find(key);
+			if (f == by_key.end()) {
+				throw std::runtime_error("A load depends on something that was never registered for loading (is the Load<> it names constructed?).");
+			}
+			add_edge(f->second, i);
+		}
+		if (entry.prepare) continue;
+		//tagged loads wait for everything with an earlier tag...
+		for (uint32_t j = 0; j < entries.size(); ++j) {
+			if (entries[j].tag < entry.tag) add_edge(j, i);
+		}
+		//...and for the previous tagged load with the same tag:
+		for (uint32_t j = i; j > 0; --j) {
+			if (!entries[j-1].prepare && entries[j-1].tag == entry.tag) {
+				add_edge(j-1, i);
+				break;
+			}
+		}
+	}
+
+	//--- run ---
+	//worker threads take loads from 'to_prepare', run their prepare phase, and put them in 'to_finish';
+	//the main thread runs the finish phase of loads in 'to_finish' and releases their dependents.
+
+	std::mutex mutex;
+	std::condition_variable prepare_cv; //signalled when 'to_prepare' gets work (or on shutdown)
+	std::condition_variable finish_cv; //signalled when 'to_finish' gets work (or a worker fails)
+	std::deque< uint32_t > to_prepare;
+	std::deque< uint32_t > to_finish;
+	std::exception_ptr failure;
+	bool quit = false;
+
+	//(called with mutex held)
+	auto make_ready = [&](uint32_t i) {
+		if (entries[i].prepare) {
+			to_prepare.emplace_back(i);
+			prepare_cv.notify_one();
+		} else {
+			to_finish.emplace_back(i);
+		}
+	};
+
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		for (uint32_t i = 0; i < entries.size(); ++i) {
+			if (entries[i].waiting_on == 0) make_ready(i);
 		}
 	}
+
+	uint32_t worker_count = std::max(1U, std::thread::hardware_concurrency());
+	worker_count = std::min(worker_count, uint32_t(entries.size()));
+	std::vector< std::thread > workers;
+	workers.reserve(worker_count);
+	for (uint32_t w = 0; w < worker_count; ++w) {
+		workers.emplace_back([&](){
+			std::unique_lock< std::mutex > lock(mutex);
+			while (true) {
+				prepare_cv.wait(lock, [&](){ return quit || !to_prepare.empty(); });
+				if (quit) break;
+				uint32_t i = to_prepare.front();
+				to_prepare.pop_front();
+
+				lock.unlock();
+				std::exception_ptr error;
+				try {
+					entries[i].prepare();
+				} catch (...) {
+					error = std::current_exception();
+				}
+				lock.lock();
+
+				if (error) {
+					if (!failure) failure = error;
+				} else {
+					to_finish.emplace_back(i);
+				}
+				finish_cv.notify_one();
+			}
+		});
+	}
+
+	//stop and join all the workers (called without mutex held):
+	auto stop_workers = [&](){
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			quit = true;
+		}
+		prepare_cv.notify_all();
+		for (auto &worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+	};
+
+	uint32_t finished = 0;
+	uint32_t in_flight = 0; //loads handed to the workers but not yet back
+	for (uint32_t i = 0; i < entries.size(); ++i) {
+		if (entries[i].waiting_on == 0 && entries[i].prepare) in_flight += 1;
+	}
+
+	try {
+		std::unique_lock< std::mutex > lock(mutex);
+		while (finished < entries.size()) {
+			if (to_finish.empty() && in_flight == 0 && !failure) {
+				throw std::runtime_error("Load dependencies form a cycle; " + std::to_string(entries.size() - finished) + " load(s) can never run.");
+			}
+			finish_cv.wait(lock, [&](){ return failure || !to_finish.empty(); });
+			if (failure) std::rethrow_exception(failure);
+
+			uint32_t i = to_finish.front();
+			to_finish.pop_front();
+			if (entries[i].prepare) in_flight -= 1;
+
+			lock.unlock();
+			entries[i].finish();
+			lock.lock();
+			finished += 1;
+
+			for (uint32_t d : entries[i].dependents) {
+				assert(entries[d].waiting_on > 0);
+				entries[d].waiting_on -= 1;
+				if (entries[d].waiting_on == 0) {
+					if (entries[d].prepare) in_flight += 1;
+					make_ready(d);
+				}
+			}
+		}
+	} catch (...) {
+		stop_workers();
+		throw;
+	}
+
+	stop_workers();
 }
@@ -20,10 +20,28 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Loads can also be split into two phases, with explicit dependencies instead of tags:
+ *
+ * Load< MeshBuffer > meshes(LoadAfter{ some_program }, []() -> MeshBuffer * {
+ *     //"prepare" runs on a worker thread -- read files, decode, parse; no OpenGL here!
+ *     return new MeshBuffer(data_path("meshes.pnct"), MeshBuffer::DeferUpload);
+ * }, [](MeshBuffer &buffer) {
+ *     //"finish" runs on the main thread -- upload to OpenGL, etc.
+ *     buffer.upload();
+ * });
+ *
+ * A load won't start its prepare phase until every load listed in its LoadAfter{ } has finished both phases.
+ * Prepare phases of independent loads run concurrently, so startup time scales with core count.
+ *
+ * Tagged loads run entirely on the main thread and act as though they depend on all
+ *  loads with an earlier tag (two-phase loads count as LoadTagDefault), and on the tagged
+ *  load registered just before them with the same tag (so the old ordering still holds).
+ *
  */
 
 #include <functional>
 #include <stdexcept>
+#include <vector>
 
 enum LoadTag : uint32_t {
 	LoadTagEarly,
@@ -34,10 +52,17 @@ enum LoadTag : uint32_t {
 
 //Add a function to an internal list of loading functions:
 // (only call *before* "call_load_functions()")
-void add_load_function(LoadTag tag, std::function< void() > const &fn);
+// 'key' (if not null) lets other loads name this one as a dependency.
+void add_load_function(LoadTag tag, std::function< void() > const &fn, void const *key = nullptr);
+
+//Add a two-phase loading function:
+// 'prepare' runs on a worker thread (and must not use OpenGL), then 'finish' runs on the main thread.
+// both start only after the loads whose keys are listed in 'after' have completely finished.
+// (only call *before* "call_load_functions()")
+void add_load_function(void const *key, std::vector< void const * > const &after, std::function< void() > const &prepare, std::function< void() > const &finish);
 
 //Call all loading functions:
-// (loading functions may throw exceptions if they fail.)
+// (loading functions may throw exceptions if they fail; exceptions from worker threads are rethrown here.)
 // (only call *once*)
 void call_load_functions();
 
@@ -46,6 +71,16 @@ void call_load_functions();
 template< typename T >
 T const *new_T() { return new T; }
 
+template< typename T >
+struct Load;
+
+//LoadAfter{ a, b, c } names the loads that a two-phase load depends on:
+struct LoadAfter {
+	template< typename... Loads >
+	LoadAfter(Loads const &... loads) : keys{ static_cast< void const * >(&loads)... } { }
+	std::vector< void const * > keys;
+};
+
 template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
@@ -55,6 +90,19 @@ struct Load {
 			if (!(this->value)) {
 				throw std::runtime_error("Loading failed.");
 			}
+		}, this);
+	}
+
+	//Two-phase load: 'prepare_fn' runs on a worker thread, 'finish_fn' (if any) on the main thread:
+	Load(LoadAfter const &after, const std::function< T *() > &prepare_fn, const std::function< void(T &) > &finish_fn = nullptr) : value(nullptr) {
+		add_load_function(this, after.keys, [this,prepare_fn](){
+			this->prepared = prepare_fn();
+			if (!(this->prepared)) {
+				throw std::runtime_error("Loading failed.");
+			}
+		}, [this,finish_fn](){
+			if (finish_fn) finish_fn(*this->prepared);
+			this->value = this->prepared;
 		});
 	}
 
@@ -65,6 +113,9 @@ struct Load {
 	T const *operator->() { return value; }
 
 	T const *value;
+
+	//-- internals --
+	T *prepared = nullptr; //result of prepare phase, waiting for finish phase
 };
 
 
@@ -74,7 +125,12 @@ template< >
 struct Load< void > {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
 	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+		add_load_function(tag, load_fn, this);
+	}
+
+	//Two-phase version:
+	Load(LoadAfter const &after, const std::function< void() > &prepare_fn, const std::function< void() > &finish_fn = nullptr) {
+		add_load_function(this, after.keys, prepare_fn, finish_fn ? finish_fn : [](){});
 	}
 };
 
@@ -1,5 +1,6 @@
 #include "Mesh.hpp"
-#include "read_write_chunk.hpp"
+#include "ChunkReader.hpp"
+#include "mesh_name_table.hpp"
 
 #include <glm/glm.hpp>
 
@@ -10,11 +11,17 @@
 #include <string>
 #include <set>
 #include <cstddef>
+#include <cassert>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &buffer);
+MeshBuffer::MeshBuffer(std::string const &filename) : MeshBuffer(filename, DeferUpload) {
+	upload();
+}
 
-	std::ifstream file(filename, std::ios::binary);
+MeshBuffer::MeshBuffer(std::string const &filename, DeferUploadTag) {
+	//chunks are read in place from a mapping of the file, so vertex data goes straight to glBufferData:
+	// (the mapping is held open until upload())
+	pending_file = std::make_unique< ChunkReader >(filename);
+	ChunkReader &file = *pending_file;
 
 	GLuint total = 0;
 
@@ -25,16 +32,40 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		glm::vec2 TexCoord;
 	};
 	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
+	Span< Vertex > data;
+
+	//compact version written by the quantize-meshes utility:
+	struct QuantizedVertex {
+		int16_t Position[4]; //xyz: snorm16, relative to the mesh's bounding box (see box0 chunk); w: padding
+		uint32_t Normal; //snorm 10:10:10:2 (w unused)
+		glm::u8vec4 Color;
+		uint16_t TexCoord[2]; //half floats
+	};
+	static_assert(sizeof(QuantizedVertex) == 4*2+4+4*1+2*2, "QuantizedVertex is packed.");
+	Span< QuantizedVertex > quantized;
+	bool is_quantized = false;
 
 	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct" && file.peek("pncq")) {
+		quantized = file.read< QuantizedVertex >("pncq");
+		is_quantized = true;
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		//remember data for upload:
+		pending_data = Span< uint8_t >(reinterpret_cast< uint8_t const * >(quantized.data()), quantized.size() * sizeof(QuantizedVertex));
+
+		total = GLuint(quantized.size()); //store total for later checks on index
+
+		//store attrib locations -- attributes are converted back to floats by the vertex fetch hardware:
+		// (positions come out in [-1,1]; Mesh::position_to_object maps them back to object space)
+		Position = Attrib(3, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Position));
+		Normal = Attrib(4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Normal));
+		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Color));
+		TexCoord = Attrib(2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, TexCoord));
+	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
+		data = file.read< Vertex >("pnct");
+
+		//remember data for upload:
+		pending_data = Span< uint8_t >(reinterpret_cast< uint8_t const * >(data.data()), data.size() * sizeof(Vertex));
 
 		total = GLuint(data.size()); //store total for later checks on index
 
@@ -47,66 +78,201 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	//(optional) element chunk, which makes mesh ranges ranges of indices:
+	Span< uint16_t > elements16;
+	Span< uint32_t > elements32;
+	GLenum index_type = GL_NONE;
+	if (file.peek("el16")) {
+		elements16 = file.read< uint16_t >("el16");
+		pending_elements = Span< uint8_t >(reinterpret_cast< uint8_t const * >(elements16.data()), elements16.size() * sizeof(uint16_t));
+		index_type = GL_UNSIGNED_SHORT;
+	} else if (file.peek("el32")) {
+		elements32 = file.read< uint32_t >("el32");
+		pending_elements = Span< uint8_t >(reinterpret_cast< uint8_t const * >(elements32.data()), elements32.size() * sizeof(uint32_t));
+		index_type = GL_UNSIGNED_INT;
+	}
+	GLuint element_total = GLuint(index_type == GL_UNSIGNED_SHORT ? elements16.size() : elements32.size());
+	auto element = [&](uint32_t i) -> uint32_t {
+		return (index_type == GL_UNSIGNED_SHORT ? elements16[i] : elements32[i]);
+	};
+
+	//quantized files store each mesh's bounding box (in the same order as the index chunk):
+	struct Box {
+		glm::vec3 min, max;
+	};
+	static_assert(sizeof(Box) == 4*6, "Box is packed.");
+	Span< Box > boxes;
+	if (is_quantized) {
+		boxes = file.read< Box >("box0");
+	}
+
+	Span< char > strings = file.read< char >("str0");
+	names.assign(strings.begin(), strings.end());
 
 	{ //read index chunk, add to meshes:
+		// (idx0 entries are ranges of vertices; idx1 entries are ranges of elements)
 		struct IndexEntry {
 			uint32_t name_begin, name_end;
-			uint32_t vertex_begin, vertex_end;
+			uint32_t vertex_begin, vertex_end; //(or element_begin, element_end for idx1)
 		};
 		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		Span< IndexEntry > index = file.read< IndexEntry >(index_type == GL_NONE ? "idx0" : "idx1");
+		if (is_quantized && boxes.size() != index.size()) {
+			throw std::runtime_error("mesh file has " + std::to_string(boxes.size()) + " bounding boxes for " + std::to_string(index.size()) + " meshes");
+		}
 
 		for (auto const &entry : index) {
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
 				throw std::runtime_error("index entry has out-of-range name begin/end");
 			}
-			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= (index_type == GL_NONE ? total : element_total))) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+			//(name only needed for error messages)
+			auto mesh_name = [&]() { return std::string(strings.data() + entry.name_begin, strings.data() + entry.name_end); };
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
 			mesh.start = entry.vertex_begin;
 			mesh.count = entry.vertex_end - entry.vertex_begin;
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
-			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+			mesh.index_type = index_type;
+			if (is_quantized) {
+				Box const &box = boxes[&entry - index.begin()];
+				mesh.min = box.min;
+				mesh.max = box.max;
+				//[-1,1] -> [min,max]:
+				glm::vec3 center = 0.5f * (box.max + box.min);
+				glm::vec3 radius = 0.5f * (box.max - box.min);
+				mesh.position_to_object = glm::mat4x3(
+					glm::vec3(radius.x, 0.0f, 0.0f),
+					glm::vec3(0.0f, radius.y, 0.0f),
+					glm::vec3(0.0f, 0.0f, radius.z),
+					center
+				);
+				if (index_type != GL_NONE) {
+					for (uint32_t e = entry.vertex_begin; e < entry.vertex_end; ++e) {
+						if (element(e) >= total) {
+							throw std::runtime_error("mesh '" + mesh_name() + "' has out-of-range element");
+						}
+					}
+				}
+			} else if (index_type == GL_NONE) {
+				for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+					mesh.min = glm::min(mesh.min, data[v].Position);
+					mesh.max = glm::max(mesh.max, data[v].Position);
+				}
+			} else {
+				for (uint32_t e = entry.vertex_begin; e < entry.vertex_end; ++e) {
+					uint32_t v = element(e);
+					if (v >= total) {
+						throw std::runtime_error("mesh '" + mesh_name() + "' has out-of-range element");
+					}
+					mesh.min = glm::min(mesh.min, data[v].Position);
+					mesh.max = glm::max(mesh.max, data[v].Position);
+				}
 			}
+			meshes.emplace_back(mesh);
+			name_ranges.emplace_back(entry.name_begin, entry.name_end);
 		}
 	}
 
-	if (file.peek() != EOF) {
+	//(optional) hash table over mesh names:
+	if (file.peek("hsh0")) {
+		Span< uint32_t > table = file.read< uint32_t >("hsh0");
+		uint32_t used = 0;
+		for (uint32_t slot : table) {
+			if (slot > meshes.size()) throw std::runtime_error("name table has out-of-range mesh");
+			if (slot != 0) used += 1;
+		}
+		//(size must be a power of two with room to spare, so probes always end at an empty slot)
+		if ((table.size() & (table.size() - 1)) != 0 || table.size() < 2 * meshes.size() || used > meshes.size()) {
+			throw std::runtime_error("name table has wrong size");
+		}
+		name_table.assign(table.begin(), table.end());
+	} else {
+		std::vector< uint32_t > duplicates;
+		name_table = make_mesh_name_table(uint32_t(meshes.size()), [this](uint32_t i) { return name(i); }, &duplicates);
+		for (uint32_t i : duplicates) {
+			std::cerr << "WARNING: mesh name '" << name(i) << "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+		}
+	}
+
+	if (!file.at_end()) {
 		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
 	}
 
 	/* //DEBUG:
 	std::cout << "File '" << filename << "' contained meshes";
-	for (auto const &m : meshes) {
-		if (&m.second == &meshes.rbegin()->second && meshes.size() > 1) std::cout << " and";
-		std::cout << " '" << m.first << "'";
-		if (&m.second != &meshes.rbegin()->second) std::cout << ",";
+	for (uint32_t i = 0; i < meshes.size(); ++i) {
+		if (i + 1 == meshes.size() && meshes.size() > 1) std::cout << " and";
+		std::cout << " '" << name(i) << "'";
+		if (i + 1 != meshes.size()) std::cout << ",";
 	}
 	std::cout << std::endl;
 	*/
 }
 
-const Mesh &MeshBuffer::lookup(std::string const &name) const {
-	auto f = meshes.find(name);
-	if (f == meshes.end()) {
-		throw std::runtime_error("Looking up mesh '" + name + "' that doesn't exist.");
+void MeshBuffer::upload() {
+	assert(pending_file && "upload() should be called exactly once");
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, pending_data.size(), pending_data.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (pending_elements.size()) {
+		glGenBuffers(1, &element_buffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, pending_elements.size(), pending_elements.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	//done with the file:
+	pending_data = Span< uint8_t >();
+	pending_elements = Span< uint8_t >();
+	pending_file.reset();
+}
+
+uint32_t MeshBuffer::find(std::string_view name_) const {
+	return find_in_mesh_name_table(name_table, name_, [this](uint32_t i) { return name(i); });
+}
+
+const Mesh &MeshBuffer::lookup(std::string_view name_) const {
+	uint32_t i = find(name_);
+	if (i == -1U) {
+		throw std::runtime_error("Looking up mesh '" + std::string(name_) + "' that doesn't exist.");
+	}
+	return meshes[i];
+}
+
+std::vector< Mesh const * > MeshBuffer::lookup_lods(std::string_view name_) const {
+	std::vector< Mesh const * > ret;
+	std::string lod_name;
+	while (true) {
+		lod_name.assign(name_);
+		lod_name += ".LOD" + std::to_string(ret.size() + 1);
+		uint32_t i = find(lod_name);
+		if (i == -1U) break;
+		ret.emplace_back(&meshes[i]);
+	}
+	return ret;
+}
+
+void MeshBuffer::set_lods(std::string_view name_, Scene::Drawable::Pipeline *pipeline) const {
+	assert(pipeline);
+	pipeline->lods.clear();
+	//(each level has about half the triangles of the one before; see simplify-meshes)
+	for (Mesh const *lod_mesh : lookup_lods(name_)) {
+		pipeline->lods.emplace_back();
+		Scene::Drawable::Pipeline::LOD &lod = pipeline->lods.back();
+		lod.start = lod_mesh->start;
+		lod.count = lod_mesh->count;
+		lod.position_to_object = lod_mesh->position_to_object;
+		lod.below = 0.5f / float(1 << pipeline->lods.size()); //(1/4 of the screen, 1/8, 1/16, ...)
 	}
-	return f->second;
 }
 
-GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
+GLuint MeshBuffer::make_vao_for_program(GLuint program, std::function< void(std::set< GLuint > *) > const &bind_extra) const {
 	//create a new vertex array object:
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
@@ -128,7 +294,11 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	bind_attribute("Color", Color);
 	bind_attribute("TexCoord", TexCoord);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//(element array binding is part of vao state, so leave it bound until the vao is unbound)
+	if (element_buffer) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+	if (bind_extra) bind_extra(&bound);
 	glBindVertexArray(0);
+	if (element_buffer) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 	//Check that all active attributes were bound:
 	GLint active = 0;
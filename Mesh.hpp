@@ -6,27 +6,58 @@
  * A "MeshBuffer" holds a collection of such meshes (loaded from a file) in
  *  a single OpenGL array buffer. Individual meshes can be looked up by name
  *  using the MeshBuffer::lookup() function.
+ *  (lookups go through a hash table over the names, which mesh files written by
+ *   the mesh utilities carry precomputed; see mesh_name_table.hpp)
+ *
+ * Mesh files may also be indexed, in which case the MeshBuffer also has an
+ *  element array buffer and meshes are ranges of indices into it.
+ *  (the weld-meshes utility converts mesh files to this form)
+ *
+ * A mesh named (e.g.) "Tree" may have coarser versions named "Tree.LOD1",
+ *  "Tree.LOD2", ... (each simpler than the last) which MeshBuffer::lookup_lods finds
+ *  and MeshBuffer::set_lods turns into Scene::Drawable::Pipeline::lods.
+ *  (the simplify-meshes utility generates these)
+ *
+ * Mesh files may also be quantized (20-byte vertices instead of 36-byte);
+ *  attributes are declared so that they reach shaders as the usual floats,
+ *  except positions, which need Mesh::position_to_object applied.
+ *  (the quantize-meshes utility converts mesh files to this form)
  *
  */
 
 #include "GL.hpp"
+#include "ChunkReader.hpp"
+#include "Scene.hpp"
 #include <glm/glm.hpp>
-#include <map>
+#include <set>
+#include <functional>
+#include <memory>
 #include <limits>
 #include <string>
+#include <string_view>
+#include <vector>
 
 
 struct Mesh {
 	//Meshes are vertex ranges (and primitive types) in their MeshBuffer:
 
 	GLenum type = GL_TRIANGLES; //type of primitives in mesh
-	GLuint start = 0; //index of first vertex
-	GLuint count = 0; //count of vertices
+	GLuint start = 0; //index of first vertex (or, if indexed, of first index)
+	GLuint count = 0; //count of vertices (or, if indexed, of indices)
+
+	//GL_NONE for plain vertex ranges (drawn with glDrawArrays);
+	// otherwise the type of the indices (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT) in the buffer's element array (drawn with glDrawElements):
+	GLenum index_type = GL_NONE;
 
 	//Bounding box.
 	//useful for debug visualization and (perhaps, eventually) collision detection:
 	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+	//maps the Position attribute to object space:
+	// identity, except for quantized meshes, whose positions are stored relative to their bounding box.
+	// (copy to Scene::Drawable::Pipeline::position_to_object)
+	glm::mat4x3 position_to_object = glm::mat4x3(1.0f);
 };
 
 struct MeshBuffer {
@@ -34,21 +65,60 @@ struct MeshBuffer {
 	// note: will throw if file fails to read.
 	MeshBuffer(std::string const &filename);
 
+	//construct from a file without touching OpenGL (e.g., on a loader thread):
+	// note: call upload() on the main thread before using 'buffer'.
+	enum DeferUploadTag { DeferUpload };
+	MeshBuffer(std::string const &filename, DeferUploadTag);
+
+	//create 'buffer' (and 'element_buffer', if indexed) from the data read by the constructor:
+	void upload();
+
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
-	const Mesh &lookup(std::string const &name) const;
+	const Mesh &lookup(std::string_view name) const;
+
+	//look up the coarser levels of detail for a mesh -- name.LOD1, name.LOD2, ... up to the first one missing:
+	// (returns an empty list if the mesh has none)
+	std::vector< Mesh const * > lookup_lods(std::string_view name) const;
+
+	//fill in a drawable's coarser levels of detail from lookup_lods(name), each taking over as the drawable shrinks on screen:
+	// (replaces pipeline->lods; leaves it empty if the mesh has none)
+	void set_lods(std::string_view name, Scene::Drawable::Pipeline *pipeline) const;
+
+	//position of the mesh with this name in 'meshes', or -1U if there isn't one:
+	uint32_t find(std::string_view name) const;
+
+	//name of meshes[index]:
+	std::string_view name(uint32_t index) const {
+		return std::string_view(names.data() + name_ranges[index].first, name_ranges[index].second - name_ranges[index].first);
+	}
 	
 	//build a vertex array object that links this vbo to attributes to a program:
 	// note: will throw if program defines attributes not contained in this buffer
-	GLuint make_vao_for_program(GLuint program) const;
+	// (the vao also binds 'element_buffer', if there is one)
+	// 'bind_extra' (if given) is called with the vao bound to set up any other attributes (e.g., per-instance data);
+	//   it should add the locations it binds to the passed set.
+	GLuint make_vao_for_program(GLuint program, std::function< void(std::set< GLuint > *) > const &bind_extra = nullptr) const;
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
+	//...and the element array buffer containing indices (if the file was indexed):
+	GLuint element_buffer = 0;
 
 	//-- internals ---
 
-	//used by the lookup() function:
-	std::map< std::string, Mesh > meshes;
+	//file (and vertex and index data within it) waiting for upload():
+	std::unique_ptr< ChunkReader > pending_file;
+	Span< uint8_t > pending_data;
+	Span< uint8_t > pending_elements;
+
+	//all meshes, in file order:
+	std::vector< Mesh > meshes;
+
+	//used by the lookup() functions:
+	std::string names; //copy of the file's string chunk
+	std::vector< std::pair< uint32_t, uint32_t > > name_ranges; //[begin,end) of each mesh's name in 'names'
+	std::vector< uint32_t > name_table; //hash table over mesh names (read from the file, or built if the file has none)
 
 	//These 'Attrib' structures describe the location of various attributes within the buffer (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
 	struct Attrib {
@@ -0,0 +1,117 @@
+#include "OpusStream.hpp"
+
+#include <opusfile.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+//samples decoded before rewind() returns, so playback can start right away
+// (a bit more than one of Sound's 1024-sample mix blocks):
+constexpr uint32_t const PrefillSamples = 2048;
+
+//most samples decoded per call of decode_some() (40ms):
+constexpr uint32_t const DecodeSamples = 1920;
+
+OpusStream::OpusStream(std::string const &filename_, float buffer_ms) : filename(filename_) {
+	int err = 0;
+	op = op_open_file(filename.c_str(), &err);
+	if (err != 0 || op == nullptr) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
+	}
+
+	ring.assign(std::max(PrefillSamples, uint32_t(std::ceil(buffer_ms * 48.0f))), 0.0f);
+	nap_us = uint32_t(std::clamp(buffer_ms * 1000.0f / 8.0f, 1000.0f, 20000.0f));
+
+	rewind(false);
+}
+
+OpusStream::~OpusStream() {
+	stop_decoder();
+	op_free(op);
+}
+
+void OpusStream::rewind(bool loop_) {
+	stop_decoder();
+
+	if (written.load(std::memory_order_relaxed) != 0) {
+		int ret = op_pcm_seek(op, 0);
+		if (ret != 0) {
+			throw std::runtime_error("opusfile error " + std::to_string(ret) + " seeking in \"" + filename + "\".");
+		}
+	}
+	written.store(0, std::memory_order_relaxed);
+	read.store(0, std::memory_order_relaxed);
+	ended.store(false, std::memory_order_relaxed);
+	loop = loop_;
+
+	while (written.load(std::memory_order_relaxed) < std::min< uint64_t >(PrefillSamples, ring.size()) && decode_some()) {
+	}
+
+	start_decoder();
+}
+
+uint32_t OpusStream::readable(float const **at) const {
+	uint64_t r = read.load(std::memory_order_relaxed);
+	uint64_t w = written.load(std::memory_order_acquire);
+	uint64_t offset = r % ring.size();
+	*at = ring.data() + offset;
+	return uint32_t(std::min< uint64_t >(w - r, ring.size() - offset));
+}
+
+void OpusStream::consume(uint32_t count) {
+	read.store(read.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
+
+bool OpusStream::drained() const {
+	return ended.load(std::memory_order_acquire)
+	    && read.load(std::memory_order_relaxed) == written.load(std::memory_order_relaxed);
+}
+
+bool OpusStream::decode_some() {
+	if (ended.load(std::memory_order_relaxed)) return false;
+
+	uint64_t w = written.load(std::memory_order_relaxed);
+	uint64_t space = ring.size() - (w - read.load(std::memory_order_acquire));
+	if (space == 0) return false;
+
+	pcm.resize(2 * DecodeSamples);
+	int ret = op_read_float_stereo(op, pcm.data(), 2 * int(std::min< uint64_t >(space, DecodeSamples)));
+	if (ret < 0) {
+		std::cerr << "WARNING: opusfile read error " << ret << " streaming \"" << filename << "\"; stopping stream." << std::endl;
+		ended.store(true, std::memory_order_release);
+		return false;
+	}
+	if (ret == 0) {
+		//end of file: loop (as long as there was something to loop) or stop:
+		if (loop && w > 0 && op_pcm_seek(op, 0) == 0) return true;
+		ended.store(true, std::memory_order_release);
+		return false;
+	}
+
+	for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+		ring[(w + i) % ring.size()] = (pcm[2*i] + pcm[2*i+1]) * 0.5f; //downmix to mono by averaging
+	}
+	written.store(w + uint32_t(ret), std::memory_order_release); //(publishes the samples)
+	return true;
+}
+
+void OpusStream::start_decoder() {
+	quit.store(false, std::memory_order_relaxed);
+	decoder = std::thread([this]() {
+		while (!quit.load(std::memory_order_relaxed)) {
+			if (!decode_some()) {
+				std::this_thread::sleep_for(std::chrono::microseconds(nap_us));
+			}
+		}
+	});
+}
+
+void OpusStream::stop_decoder() {
+	if (decoder.joinable()) {
+		quit.store(true, std::memory_order_relaxed);
+		decoder.join();
+	}
+}
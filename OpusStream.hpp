@@ -0,0 +1,66 @@
+#pragma once
+
+/*
+ * OpusStream decodes an '.opus' file a little at a time, for playing long
+ *  sounds (music) without decoding all of them into memory up front:
+ *  - the file stays open, and a background thread decodes ahead of playback
+ *    into a ring buffer of 48kHz mono floats
+ *  - the audio callback reads from the ring without locks (readable/consume)
+ *  - the ring holds 'buffer_ms' milliseconds of audio; playback underruns
+ *    (the reader finds the ring empty) are counted and played as silence
+ *
+ * (used by Sound::Stream; rewind() and the constructor/destructor are only
+ *  safe to call when the audio callback isn't reading the stream)
+ *
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef struct OggOpusFile OggOpusFile;
+
+struct OpusStream {
+	//opens the file and starts decoding; throws on error:
+	OpusStream(std::string const &filename, float buffer_ms);
+	~OpusStream();
+
+	OpusStream(OpusStream const &) = delete;
+	OpusStream &operator=(OpusStream const &) = delete;
+
+	//restart decoding from the beginning of the file (and, if 'loop', wrap around at the end forever):
+	void rewind(bool loop);
+
+	//-- reader (audio callback) side --
+
+	//the next contiguous run of decoded samples ('*at' points to it); returns its length (0 if none are ready):
+	uint32_t readable(float const **at) const;
+	//mark the first 'count' readable samples as played:
+	void consume(uint32_t count);
+	//has the decoder reached the end of the (non-looping) file, and all of it been consumed?
+	bool drained() const;
+
+	std::string filename;
+	std::atomic< uint32_t > underruns{0}; //(incremented by Sound's mixer when it needs samples that aren't ready)
+
+	//-- internals --
+	OggOpusFile *op = nullptr;
+	std::vector< float > ring;
+	std::atomic< uint64_t > written{0}; //samples decoded into the ring (only written by the decode thread)
+	std::atomic< uint64_t > read{0}; //samples consumed from the ring (only written by the reader)
+	std::atomic< bool > ended{false}; //decoder reached the end (set after the last 'written' update)
+	bool loop = false;
+
+	std::vector< float > pcm; //stereo scratch space for decoding
+
+	std::thread decoder;
+	std::atomic< bool > quit{false};
+	uint32_t nap_us = 0; //how long the decode thread sleeps when the ring is full
+
+	//decode into free space in the ring; returns false if there was nothing to do (ring full or at end):
+	bool decode_some();
+	void start_decoder();
+	void stop_decoder();
+};
@@ -1,6 +1,7 @@
 #include "PlayMode.hpp"
 
 #include "LitColorTextureProgram.hpp"
+#include "LitColorTextureInstancedProgram.hpp"
 #include "ColorTextureProgram.hpp"
 
 #include "DrawLines.hpp"
@@ -12,19 +13,23 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <random>
-#include <fstream>
 
 #define FONT_SIZE 36
 #define MARGIN (FONT_SIZE * .5)
 
 GLuint hexapod_meshes_for_lit_color_texture_program = 0;
-Load< MeshBuffer > hexapod_meshes(LoadTagDefault, []() -> MeshBuffer const * {
-	MeshBuffer const *ret = new MeshBuffer(data_path("hexapod.pnct"));
-	hexapod_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
-	return ret;
+GLuint hexapod_meshes_for_lit_color_texture_instanced_program = 0;
+Load< MeshBuffer > hexapod_meshes(LoadAfter{ lit_color_texture_program, lit_color_texture_instanced_program }, []() -> MeshBuffer * {
+	return new MeshBuffer(data_path("hexapod.pnct"), MeshBuffer::DeferUpload);
+}, [](MeshBuffer &ret) {
+	ret.upload();
+	hexapod_meshes_for_lit_color_texture_program = ret.make_vao_for_program(lit_color_texture_program->program);
+	hexapod_meshes_for_lit_color_texture_instanced_program = ret.make_vao_for_program(lit_color_texture_instanced_program->program, [](std::set< GLuint > *bound){
+		lit_color_texture_instanced_program->bind_instance_attributes(bound);
+	});
 });
 
-Load< Scene > hexapod_scene(LoadTagDefault, []() -> Scene const * {
+Load< Scene > hexapod_scene(LoadAfter{ hexapod_meshes }, []() -> Scene * {
 	return new Scene(data_path("hexapod.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 		Mesh const &mesh = hexapod_meshes->lookup(mesh_name);
 
@@ -34,16 +39,30 @@ Load< Scene > hexapod_scene(LoadTagDefault, []() -> Scene const * {
 		drawable.pipeline = lit_color_texture_program_pipeline;
 
 		drawable.pipeline.vao = hexapod_meshes_for_lit_color_texture_program;
+		drawable.pipeline.instancing.vao = hexapod_meshes_for_lit_color_texture_instanced_program;
 		drawable.pipeline.type = mesh.type;
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.index_type = mesh.index_type;
+		drawable.pipeline.position_to_object = mesh.position_to_object;
+		drawable.pipeline.min = mesh.min;
+		drawable.pipeline.max = mesh.max;
+
+		//coarser levels of detail (if any) take over as the drawable shrinks on screen:
+		hexapod_meshes->set_lods(mesh_name, &drawable.pipeline);
 
 	});
 });
 
+// Story is compiled ahead of time from dist/story.json by compile-story
+Load< Story > story(LoadAfter{ }, []() -> Story * {
+	return new Story(data_path("story.graph"));
+});
+
 /*
-Load< Sound::Sample > dusty_floor_sample(LoadTagDefault, []() -> Sound::Sample const * {
-	return new Sound::Sample(data_path("dusty-floor.opus"));
+//(streamed, since it's long -- decoding all of it up front would take a while and tens of megabytes)
+Load< Sound::Stream > dusty_floor_stream(LoadAfter{ }, []() -> Sound::Stream * {
+	return new Sound::Stream(data_path("dusty-floor.opus"));
 });
 */
 
@@ -69,25 +88,10 @@ PlayMode::PlayMode() : scene(*hexapod_scene) {
 
 	//start music loop playing:
 	// (note: position will be over-ridden in update())
-	leg_tip_loop = Sound::loop_3D(*dusty_floor_sample, 1.0f, get_leg_tip_position(), 10.0f);
+	leg_tip_loop = Sound::loop_3D(*dusty_floor_stream, 1.0f, get_leg_tip_position(), 10.0f);
 	*/
 
-	// Read from JSON file
-	// Referenced:
-	// 	 https://github.com/nlohmann/json#examples
-	//   Tyler Thompson and Pavan Paravasthu's S20 game4: https://github.com/friskydingo0/15-466-f20-base4/blob/master/TextMode.cpp
-	try {
-		std::ifstream in("dist/story.json");
-		in >> json;
-	}
-	catch (int e) {
-		std::cout << "A JSON exception occurred: #" << e << std::endl;
-	}
-
-	//std::string json_txt = json["start"]["text"];
-	//std::cout << "json_txt: " << json_txt << std::endl;
-
-	curr_state = "start"; // First state upon beginning
+	curr_state = Story::Start; // First state upon beginning
 
 	// The following font handling referenced from:
 	//   https://learnopengl.com/In-Practice/Text-Rendering
@@ -115,12 +119,18 @@ PlayMode::PlayMode() : scene(*hexapod_scene) {
 	// internalFormat and format args
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
+	// Glyphs get packed into atlas pages as they are first drawn
+	glyph_atlas.reset(new GlyphAtlas(ft_face));
+
 	// Create hb-ft font
 	hb_font = hb_ft_font_create(ft_face, NULL);
 
 	// Create hb buffer
 	hb_buffer = hb_buffer_create();
 
+	// Shaped text is cached, so HarfBuzz only runs when the text changes
+	shape_cache.reset(new ShapeCache(hb_font, hb_buffer));
+
 	/*
 	std::string sample_txt = "heyyy bestie\nwhat's good, b";
 	// TODO: make sure to change last arg (-1) to length of string
@@ -132,20 +142,15 @@ PlayMode::PlayMode() : scene(*hexapod_scene) {
 	// Enable blending
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-	// Create VBO and VAO for rendering the quads (one glyph per quad)
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glBindVertexArray(VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
 }
 
 PlayMode::~PlayMode() {
+	shape_cache->print_stats(std::cout);
+	shape_cache.reset();
+
+	glyph_atlas->print_stats(std::cout);
+	glyph_atlas.reset();
+
 	// Referenced: https://github.com/harfbuzz/harfbuzz-tutorial/blob/master/hello-harfbuzz-freetype.c
 	hb_buffer_destroy(hb_buffer);
 	hb_font_destroy(hb_font);
@@ -191,15 +196,15 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 	} else if (evt.type == SDL_KEYUP) {
 		if (evt.key.keysym.sym == SDLK_1) {
 			one.pressed = false;
-			if (json[curr_state]["choice1"][0] != "none") {
-				curr_state = json[curr_state]["choice1"][1];
+			if (Story::Choice const *choice = story->choice(curr_state, 1)) {
+				curr_state = choice->target;
 			}
 			return true;
 		}
 		else if (evt.key.keysym.sym == SDLK_2) {
 			two.pressed = false;
-			if (json[curr_state]["choice2"][0] != "none") {
-				curr_state = json[curr_state]["choice2"][1];
+			if (Story::Choice const *choice = story->choice(curr_state, 2)) {
+				curr_state = choice->target;
 			}
 			return true;
 		}
@@ -262,7 +267,7 @@ void PlayMode::update(float elapsed) {
 	);
 
 	//move sound to follow leg tip position:
-	leg_tip_loop->set_position(get_leg_tip_position(), 1.0f / 60.0f);
+	leg_tip_loop.set_position(get_leg_tip_position(), 1.0f / 60.0f);
 	
 	//move camera:
 	{
@@ -295,10 +300,10 @@ void PlayMode::update(float elapsed) {
 	*/
 
 	// Update current state based on what the user chooses (so long as that choice exists)
-	//if (one.pressed && (json[curr_state]["choice1"][0] != "none")) {
-	//	curr_state = json[curr_state]["choice1"][1];
-	//} else if (two.pressed && (json[curr_state]["choice2"][0] != "none")) {
-	//	curr_state = json[curr_state]["choice2"][1];
+	//if (one.pressed && story->choice(curr_state, 1)) {
+	//	curr_state = story->choice(curr_state, 1)->target;
+	//} else if (two.pressed && story->choice(curr_state, 2)) {
+	//	curr_state = story->choice(curr_state, 2)->target;
 	//}
 
 	//reset button press counters:
@@ -320,6 +325,11 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
 	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, -1.0f)));
 	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
+	//(same light for instanced drawables:)
+	glUseProgram(lit_color_texture_instanced_program->program);
+	glUniform1i(lit_color_texture_instanced_program->LIGHT_TYPE_int, 1);
+	glUniform3fv(lit_color_texture_instanced_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, -1.0f)));
+	glUniform3fv(lit_color_texture_instanced_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
 	glUseProgram(0);
 
 	//glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
@@ -360,142 +370,36 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	//float y = y_start;
 	float scale = 1.0f;
 
-	// Render text
-	// Prompt
-	draw_text(json[curr_state]["text"], x_start, y_prompt_start, 1.2f);
+	// Lay out text again only when the state changes
+	if (shown_state != curr_state) {
+		// Prompt
+		prompt_layout.set(story->text(curr_state), glm::vec2(x_start, y_prompt_start), 1.2f, x_wrap - x_start);
 
-	// Choice 1 (if it exists)
-	if (json[curr_state]["choice1"][0] != "none") {
-		std::string choice_txt = "1. " + (std::string)(json[curr_state]["choice1"][0]);
-		draw_text(choice_txt, x_start, y_choice_start, scale);
-	}
+		// Choices (if they exist)
+		for (uint32_t c = 0; c < 2; ++c) {
+			std::string choice_txt;
+			if (Story::Choice const *choice = story->choice(curr_state, c + 1)) {
+				choice_txt = std::to_string(c + 1) + ". " + std::string(story->label(*choice));
+			}
+			choice_layouts[c].set(choice_txt, glm::vec2(x_start, y_choice_start - (60.0f * scale) * c), scale, x_wrap - x_start);
+		}
 
-	// Choice 2 (if it exists)
-	if (json[curr_state]["choice2"][0] != "none") {
-		std::string choice_txt = "2. " + (std::string)(json[curr_state]["choice2"][0]);
-		draw_text(choice_txt, x_start, y_choice_start - (60.0f * scale), scale);
+		shown_state = curr_state;
 	}
 
-	GL_ERRORS();
-}
-
-// Referenced:
-//   https://learnopengl.com/In-Practice/Text-Rendering
-//   Alyssa Lee and Madeline Anthony's F20 game4: https://github.com/lassyla/game4/blob/master/PlayMode.cpp
-void PlayMode::draw_text(std::string text, float x, float y, float scale) {
-	//float left_margin = 50.0f;
-	//float x = 50.0f;
-	//float y = 650.0f;
-	//float scale = 1.0f;
-
-	hb_buffer_clear_contents(hb_buffer);
-	hb_buffer_add_utf8(hb_buffer, text.c_str(), -1, 0, -1); // Reference for conversion from string to const char *: https://stackoverflow.com/questions/68339345/how-to-convert-string-to-const-char-in-c
-	hb_buffer_set_direction(hb_buffer, HB_DIRECTION_LTR);
-	hb_buffer_set_script(hb_buffer, HB_SCRIPT_LATIN);
-	hb_buffer_set_language(hb_buffer, hb_language_from_string("en", -1));
-	hb_shape(hb_font, hb_buffer, NULL, 0);
-
+	// Render text (rebuilding vertex buffers only if something changed)
 	glDisable(GL_DEPTH_TEST);
-
-	// Activate corresponding render state
-	glUseProgram(color_texture_program->program);
-	glUniform3f(color_texture_program->Color_vec3, text_color.x, text_color.y, text_color.z);
 	glm::mat4 projection = glm::ortho(0.0f, 1280.0f, 0.0f, 720.0f); // Window dimensions yoinked from main
-	glUniformMatrix4fv(color_texture_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, &projection[0][0]);
-	glActiveTexture(GL_TEXTURE0);
-	glBindVertexArray(VAO);
-
-	// Get glyph info from buffer
-	unsigned int num_glyphs;
-	hb_glyph_info_t *glynfo = hb_buffer_get_glyph_infos(hb_buffer, &num_glyphs);
-
-	// Generate a texture for each glyph we encounter in the buffer, unless it's
-	// already been loaded
-	for (unsigned int i = 0; i < num_glyphs; i++) {
-		FT_UInt cp = (FT_UInt)glynfo[i].codepoint; // TODO: type stuff ??
-
-		// If not in Chars map yet, load this glyph and add to Chars
-		if (Chars.count(cp) == 0) {
-			//std::cout << "codepoint: " << cp << std::endl;
-			// Load char glyph
-			if (FT_Load_Glyph(ft_face, cp, FT_LOAD_RENDER)) {
-				throw std::runtime_error("Failed to load glyph");
-				continue;
-			}
-
-			// Generate texture
-			unsigned int texture;
-			glGenTextures(1, &texture);
-			glBindTexture(GL_TEXTURE_2D, texture);
-			glTexImage2D(
-				GL_TEXTURE_2D,
-				0, GL_RED,
-				ft_face->glyph->bitmap.width,
-				ft_face->glyph->bitmap.rows,
-				0,
-				GL_RED,
-				GL_UNSIGNED_BYTE,
-				ft_face->glyph->bitmap.buffer
-			);
-
-			// Set texture options
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-			// Store character for later use
-			Character character = {
-				texture,
-				glm::ivec2(ft_face->glyph->bitmap.width, ft_face->glyph->bitmap.rows),
-				glm::ivec2(ft_face->glyph->bitmap_left,  ft_face->glyph->bitmap_top),
-				(unsigned int)(ft_face->glyph->advance.x)
-			};
-			Chars.insert(std::pair<FT_UInt, Character>(cp, character));
-		}
 
-		// Update VBO for each character
-		Character ch = Chars[cp];
+	prompt_layout.update(*shape_cache, *glyph_atlas);
+	prompt_layout.draw(projection, text_color);
 
-		float xpos = x + ch.Bearing.x * scale;
-		float ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
-		float w = ch.Size.x * scale;
-		float h = ch.Size.y * scale;
-
-		float vertices[6][4] = {
-			{ xpos,     ypos + h, 0.0f, 0.0f },
-			{ xpos,     ypos,     0.0f, 1.0f },
-			{ xpos + w, ypos,     1.0f, 1.0f },
-
-			{ xpos,     ypos + h, 0.0f, 0.0f },
-			{ xpos + w, ypos,     1.0f, 1.0f },
-			{ xpos + w, ypos + h, 1.0f, 0.0f }
-		};
-
-		// Render glyph texture over quad
-		glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-
-		// Update content of VBO memory
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-		// Render quad
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-
-		// Advance cursors for next glyph (advance is number of 1/64 pixels)
-		x += (ch.Advance >> 6) * scale; // bitshift by 6 to get value in pixels (2^6 = 64)
-
-		// New line if this is a space and your cup overfloweth,
-		// OR if it's just a newline char lol
-		if ((x > 900.0f && (cp == 3)) || (cp == 0)) {
-			y -= 50.0f * scale;
-			x = x_start;
-		}
+	for (auto &layout : choice_layouts) {
+		layout.update(*shape_cache, *glyph_atlas);
+		layout.draw(projection, text_color);
 	}
 
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GL_ERRORS();
 }
 
 /*
@@ -2,9 +2,10 @@
 
 #include "Scene.hpp"
 #include "Sound.hpp"
-
-#include "json.hpp"
-using JSON = nlohmann::json;
+#include "GlyphAtlas.hpp"
+#include "ShapeCache.hpp"
+#include "TextLayout.hpp"
+#include "Story.hpp"
 
 #include <glm/glm.hpp>
 
@@ -17,6 +18,7 @@ using JSON = nlohmann::json;
 #include <vector>
 #include <deque>
 #include <map>
+#include <memory>
 
 struct PlayMode : Mode {
 	PlayMode();
@@ -51,7 +53,7 @@ struct PlayMode : Mode {
 	glm::vec3 get_leg_tip_position();
 
 	//music coming from the tip of the leg (as a demonstration):
-	std::shared_ptr< Sound::PlayingSample > leg_tip_loop;
+	Sound::PlayingSample leg_tip_loop;
 	*/
 
 	//camera:
@@ -66,26 +68,24 @@ struct PlayMode : Mode {
 	FT_Face    ft_face; // Loading font into ft as a face
 	std::string font_file = "VT323-Regular.ttf";
 
-	struct Character {
-		unsigned int TextureID; // ID handle of glyph texture
-		glm::ivec2   Size;      // Size of glyph
-		glm::ivec2   Bearing;   // Offset from baseline to top left of glyph
-		unsigned int Advance;   // Offset to advance to next glyph
-	};
+	// Shaped + line-broken strings, so unchanged text isn't re-shaped every frame:
+	std::unique_ptr< ShapeCache > shape_cache;
 
-	std::map< FT_UInt, Character > Chars;
+	// Rendered glyphs, packed into a few large textures as they are first seen:
+	std::unique_ptr< GlyphAtlas > glyph_atlas;
 
-	GLuint VBO, VAO; // Vertex buffer object & vertex array object
+	// Laid-out text for the current state; only rebuilt when the state changes:
+	TextLayout prompt_layout;
+	TextLayout choice_layouts[2];
+	uint32_t shown_state = -1U; // state whose text is in the layouts above
 
 	// RGB text color, each value in range of 0 to 1
 	glm::vec3 text_color = glm::vec3(179.0f/256.0f, 207.0f/256.0f, 120.0f/256.0f);
 
-	void draw_text(std::string text, float x, float y, float scale);
-
 	float x_start = 50.0f;
+	float x_wrap = 900.0f; // lines break at the first space past this x
 	float y_prompt_start = 650.0f;
 	float y_choice_start = 300.0f;
 
-	JSON json;
-	std::string curr_state;
+	uint32_t curr_state = Story::Start; // index into story->states
 };
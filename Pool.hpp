@@ -0,0 +1,222 @@
+#pragma once
+
+/*
+ * A Pool< T > stores T's in fixed-size chunks of contiguous memory.
+ *
+ * It is meant as a replacement for std::list< T > where things hold on to
+ *  pointers to elements:
+ *  - elements never move once created, so pointers to them stay valid until they are erased
+ *  - iteration walks chunks linearly instead of chasing list nodes
+ *  - erased slots are recycled, with a per-slot generation number that is bumped on
+ *    erase, so a Handle< T > to an erased element reports itself as empty instead of dangling
+ *
+ * Copying a pool puts every element into the same slot (with the same
+ *  generation) in the copy, so handles into the original can be
+ *  re-pointed at the copy without any lookups (see Handle::rebind).
+ *
+ * Iteration order is slot order, which is creation order as long as nothing
+ *  has been erased.
+ *
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template< typename T >
+struct Pool;
+
+//A generation-checked reference to an element of a Pool< T >:
+template< typename T >
+struct Handle {
+	Pool< T > *pool = nullptr;
+	uint32_t index = 0;
+	uint32_t generation = 0;
+
+	Handle() = default;
+	Handle(std::nullptr_t) { }
+	Handle(Pool< T > *pool_, uint32_t index_, uint32_t generation_) : pool(pool_), index(index_), generation(generation_) { }
+
+	//the element, or nullptr if the handle is empty or the element was erased:
+	T *get() const { return pool ? pool->get(*this) : nullptr; }
+
+	//act like a T *:
+	explicit operator bool() const { return get() != nullptr; }
+	T *operator->() const { T *t = get(); assert(t); return t; }
+	T &operator*() const { T *t = get(); assert(t); return *t; }
+
+	//same slot in a different pool (e.g., after the pool was copied):
+	Handle rebind(Pool< T > *to) const { return pool ? Handle(to, index, generation) : Handle(); }
+
+	bool operator==(Handle const &o) const { return pool == o.pool && index == o.index && generation == o.generation; }
+	bool operator!=(Handle const &o) const { return !(*this == o); }
+};
+
+template< typename T >
+struct Pool {
+	enum : uint32_t { ChunkSize = 1024 }; //elements per chunk
+
+	Pool() = default;
+	~Pool() { clear(); }
+
+	Pool(Pool const &other) { *this = other; }
+	Pool &operator=(Pool const &other) {
+		if (&other == this) return *this;
+		clear();
+		reserve_slots(other.slots);
+		for (uint32_t i = 0; i < other.slots; ++i) {
+			if (other.alive[i]) new (slot(i)) T(*other.slot(i));
+		}
+		slots = other.slots;
+		live = other.live;
+		last = other.last;
+		generations = other.generations;
+		alive = other.alive;
+		free_slots = other.free_slots;
+		return *this;
+	}
+
+	//---- std::list-like interface ----
+
+	template< typename... Args >
+	T &emplace_back(Args&&... args) {
+		uint32_t i;
+		if (!free_slots.empty()) {
+			i = free_slots.back();
+			free_slots.pop_back();
+		} else {
+			reserve_slots(slots + 1);
+			i = slots;
+			slots += 1;
+			generations.emplace_back(0);
+			alive.emplace_back(0);
+		}
+		T *t = new (slot(i)) T(std::forward< Args >(args)...);
+		alive[i] = 1;
+		live += 1;
+		last = i;
+		return *t;
+	}
+
+	//most recently created element:
+	T &back() { assert(live && alive[last]); return *slot(last); }
+	T const &back() const { assert(live && alive[last]); return *slot(last); }
+
+	//first live element in iteration order:
+	T &front() { assert(live); return *begin(); }
+	T const &front() const { assert(live); return *begin(); }
+
+	size_t size() const { return live; }
+	bool empty() const { return live == 0; }
+
+	void clear() {
+		for (uint32_t i = 0; i < slots; ++i) {
+			if (alive[i]) slot(i)->~T();
+		}
+		chunks.clear();
+		chunk_order.clear();
+		generations.clear();
+		alive.clear();
+		free_slots.clear();
+		slots = live = last = 0;
+	}
+
+	//remove an element (handles and pointers to it become invalid):
+	void erase(T const *t) {
+		uint32_t i = index_of(t);
+		assert(i != -1U && "erasing element not in pool");
+		slot(i)->~T();
+		alive[i] = 0;
+		generations[i] += 1;
+		live -= 1;
+		free_slots.emplace_back(i);
+	}
+
+	//---- handles ----
+
+	//(const, like get(), so code holding a const pool -- e.g., a viewer of a const Scene -- can keep handles too)
+	Handle< T > handle(T const *t) const {
+		if (!t) return Handle< T >();
+		uint32_t i = index_of(t);
+		assert(i != -1U && "element not in pool");
+		return Handle< T >(const_cast< Pool * >(this), i, generations[i]);
+	}
+
+	T *get(Handle< T > const &h) const {
+		if (h.index >= slots || !alive[h.index] || generations[h.index] != h.generation) return nullptr;
+		return const_cast< T * >(slot(h.index));
+	}
+
+	//slot index of an element (or -1U if it isn't in this pool):
+	uint32_t index_of(T const *t) const {
+		//binary search chunks by address:
+		auto f = std::upper_bound(chunk_order.begin(), chunk_order.end(), t, [](T const *a, std::pair< T const *, uint32_t > const &b) {
+			return std::less< T const * >()(a, b.first);
+		});
+		if (f == chunk_order.begin()) return -1U;
+		--f;
+		if (!std::less< T const * >()(t, f->first + ChunkSize)) return -1U;
+		uint32_t i = f->second * ChunkSize + uint32_t(t - f->first);
+		if (i >= slots || !alive[i]) return -1U;
+		return i;
+	}
+
+	//element in slot 'i' (must be alive):
+	T &at(uint32_t i) { assert(i < slots && alive[i]); return *slot(i); }
+	T const &at(uint32_t i) const { assert(i < slots && alive[i]); return *slot(i); }
+
+	//---- iteration over live elements ----
+
+	template< typename P, typename V >
+	struct Iterator {
+		P *pool;
+		uint32_t i;
+		Iterator(P *pool_, uint32_t i_) : pool(pool_), i(i_) { skip(); }
+		void skip() { while (i < pool->slots && !pool->alive[i]) ++i; }
+		V &operator*() const { return *pool->slot(i); }
+		V *operator->() const { return pool->slot(i); }
+		Iterator &operator++() { ++i; skip(); return *this; }
+		bool operator==(Iterator const &o) const { return i == o.i; }
+		bool operator!=(Iterator const &o) const { return i != o.i; }
+	};
+	using iterator = Iterator< Pool, T >;
+	using const_iterator = Iterator< Pool const, T const >;
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, slots); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, slots); }
+
+	//-- internals --
+	using Storage = typename std::aligned_storage< sizeof(T), alignof(T) >::type;
+	std::vector< std::unique_ptr< Storage[] > > chunks;
+	std::vector< std::pair< T const *, uint32_t > > chunk_order; //chunk base addresses, sorted (for index_of)
+
+	//per-slot bookkeeping, kept separately so element memory stays dense:
+	std::vector< uint32_t > generations;
+	std::vector< uint8_t > alive;
+	std::vector< uint32_t > free_slots;
+
+	uint32_t slots = 0; //slots ever used
+	uint32_t live = 0; //slots currently holding an element
+	uint32_t last = 0; //slot of most recent emplace_back
+
+	T *slot(uint32_t i) { return reinterpret_cast< T * >(&chunks[i / ChunkSize][i % ChunkSize]); }
+	T const *slot(uint32_t i) const { return reinterpret_cast< T const * >(&chunks[i / ChunkSize][i % ChunkSize]); }
+
+	void reserve_slots(uint32_t count) {
+		while (chunks.size() * ChunkSize < count) {
+			chunks.emplace_back(new Storage[ChunkSize]);
+			T const *base = reinterpret_cast< T const * >(chunks.back().get());
+			auto pos = std::upper_bound(chunk_order.begin(), chunk_order.end(), base, [](T const *a, std::pair< T const *, uint32_t > const &b) {
+				return std::less< T const * >()(a, b.first);
+			});
+			chunk_order.insert(pos, std::make_pair(base, uint32_t(chunks.size() - 1)));
+		}
+	}
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ * An SPSCRing< T, Capacity > is a fixed-size queue for handing values from
+ *  one thread (the producer) to one other thread (the consumer) without locks:
+ *  - try_push() is only called by the producer, try_pop() only by the consumer
+ *  - neither ever blocks or allocates; try_push() fails when the ring is full
+ *    and try_pop() fails when it is empty
+ *  - values are moved in and out of preallocated slots
+ *
+ * (used by Sound to pass commands to the audio callback)
+ *
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+template< typename T, uint32_t Capacity >
+struct SPSCRing {
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity should be a power of two.");
+
+	//producer: add a value to the back of the ring (returns false, leaving 'value' alone, if full):
+	bool try_push(T &&value) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+		slots[t & (Capacity - 1)] = std::move(value);
+		tail.store(t + 1, std::memory_order_release); //(publishes the slot)
+		return true;
+	}
+
+	//consumer: remove the value at the front of the ring (returns false if empty):
+	bool try_pop(T *value) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		*value = std::move(slots[h & (Capacity - 1)]);
+		head.store(h + 1, std::memory_order_release); //(gives the slot back to the producer)
+		return true;
+	}
+
+	//number of values in the ring (exact when called by either side with the other side idle; otherwise a snapshot):
+	uint32_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+	//-- internals --
+	T slots[Capacity];
+	//head and tail count pops and pushes (wrapping); kept on separate cache lines so the two threads don't contend:
+	alignas(64) std::atomic< uint32_t > head{0}; //written by consumer
+	alignas(64) std::atomic< uint32_t > tail{0}; //written by producer
+};
@@ -0,0 +1,116 @@
+#include "SampleCache.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace {
+	struct Entry {
+		SampleCache::Buffer buffer; //(null while some thread is decoding it)
+		uint64_t last_loaded = 0; //value of 'loads' when last returned from load()
+	};
+
+	//everything below is guarded by 'mutex':
+	std::mutex mutex;
+	std::condition_variable decoded_cv; //notified when a decode finishes (or fails)
+	std::map< std::tuple< std::string, int64_t, SampleData::Encoding >, Entry > entries; //(canonical path, modification time, encoding) -> entry
+	size_t resident = 0;
+	size_t budget = std::numeric_limits< size_t >::max();
+	uint64_t loads = 0;
+
+	size_t buffer_bytes(SampleCache::Buffer const &buffer) {
+		return buffer->bytes();
+	}
+
+	//drop unused buffers, least recently loaded first, until resident <= target (call with mutex held):
+	size_t evict_to(size_t target) {
+		std::vector< decltype(entries)::iterator > unused;
+		for (auto ei = entries.begin(); ei != entries.end(); ++ei) {
+			//(use_count can't go up without the mutex, since only the cache hands out references)
+			if (ei->second.buffer && ei->second.buffer.use_count() == 1) unused.emplace_back(ei);
+		}
+		std::sort(unused.begin(), unused.end(), [](auto const &a, auto const &b) {
+			return a->second.last_loaded < b->second.last_loaded;
+		});
+
+		size_t freed = 0;
+		for (auto const &ei : unused) {
+			if (resident <= target) break;
+			size_t bytes = buffer_bytes(ei->second.buffer);
+			resident -= bytes;
+			freed += bytes;
+			entries.erase(ei);
+		}
+		return freed;
+	}
+}
+
+SampleCache::Buffer SampleCache::load(std::string const &filename, SampleData::Encoding encoding, std::function< void(std::string const &, std::vector< float > *, uint32_t *) > const &decode) {
+	//key on where the file really is and when it last changed
+	// (if either can't be found out, fall back to the name as given and let 'decode' report any problem):
+	std::tuple< std::string, int64_t, SampleData::Encoding > key(filename, 0, encoding);
+	{
+		std::error_code ec;
+		std::filesystem::path canonical = std::filesystem::canonical(filename, ec);
+		if (!ec) std::get< 0 >(key) = canonical.string();
+		auto mtime = std::filesystem::last_write_time(filename, ec);
+		if (!ec) std::get< 1 >(key) = int64_t(mtime.time_since_epoch().count());
+	}
+
+	std::unique_lock< std::mutex > lock(mutex);
+	for (auto f = entries.find(key); f != entries.end(); f = entries.find(key)) {
+		if (f->second.buffer) {
+			f->second.last_loaded = ++loads;
+			return f->second.buffer;
+		}
+		//another thread is decoding this file, so wait for it:
+		decoded_cv.wait(lock);
+	}
+	entries.emplace(key, Entry()); //(marks the file as being decoded)
+	lock.unlock();
+
+	std::shared_ptr< SampleData const > data;
+	try {
+		std::vector< float > samples;
+		uint32_t rate = 48000;
+		decode(filename, &samples, &rate);
+		data = std::make_shared< SampleData const >(samples, encoding, rate);
+	} catch (...) {
+		//(any waiting threads will try decoding for themselves)
+		lock.lock();
+		entries.erase(key);
+		decoded_cv.notify_all();
+		throw;
+	}
+
+	lock.lock();
+	Entry &entry = entries[key];
+	entry.buffer = data;
+	entry.last_loaded = ++loads;
+	resident += buffer_bytes(entry.buffer);
+	decoded_cv.notify_all();
+
+	if (resident > budget) evict_to(budget); //(won't drop 'data', which is still referenced here)
+	return data;
+}
+
+size_t SampleCache::resident_bytes() {
+	std::unique_lock< std::mutex > lock(mutex);
+	return resident;
+}
+
+void SampleCache::set_budget(size_t bytes) {
+	std::unique_lock< std::mutex > lock(mutex);
+	budget = bytes;
+	if (resident > budget) evict_to(budget);
+}
+
+size_t SampleCache::evict_unused() {
+	std::unique_lock< std::mutex > lock(mutex);
+	return evict_to(0);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+/*
+ * Process-wide cache of decoded sample data (used by Sound::Sample):
+ *  - entries are keyed by canonical path + modification time (+ encoding), so
+ *    loading the same file twice (e.g., from two Load<> objects, even at the
+ *    same time) decodes it once, and a file that has changed is decoded again
+ *  - buffers are shared and immutable, and stay alive as long as anything
+ *    (a Sample, a playing voice) references them
+ *  - the cache's own reference keeps a buffer resident after everything else
+ *    lets go of it, until it is evicted: when load() or set_budget() finds the
+ *    resident total over the budget, unused buffers are dropped, least
+ *    recently loaded first (evict_unused() drops them all)
+ *
+ * All functions are thread-safe.
+ *
+ */
+
+#include "SampleData.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SampleCache {
+
+typedef std::shared_ptr< SampleData const > Buffer;
+
+//get the data for 'filename' in 'encoding', calling 'decode' to fill in (float) samples to encode
+// and their rate if it isn't cached:
+Buffer load(std::string const &filename, SampleData::Encoding encoding, std::function< void(std::string const &, std::vector< float > *, uint32_t *) > const &decode);
+
+//total bytes of (encoded) sample data held by the cache:
+size_t resident_bytes();
+
+//keep resident_bytes() at or under 'bytes' (as far as possible without dropping buffers still in use):
+void set_budget(size_t bytes); //(default: no limit)
+
+//drop every buffer that only the cache references; returns the number of bytes freed:
+size_t evict_unused();
+
+} //namespace SampleCache
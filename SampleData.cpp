@@ -0,0 +1,190 @@
+#include "SampleData.hpp"
+#include "mix_kernels.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+//IMA ADPCM tables:
+static int8_t const ADPCMIndexTable[16] = {
+	-1, -1, -1, -1, 2, 4, 6, 8,
+	-1, -1, -1, -1, 2, 4, 6, 8,
+};
+static int16_t const ADPCMStepTable[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+	253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+	1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+	3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+	12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+//helper: apply one 4-bit code to the decoder state (shared by encoder and decoder so they stay in step):
+static inline void adpcm_step(uint8_t code, int32_t *predictor, int32_t *index) {
+	int32_t step = ADPCMStepTable[*index];
+	int32_t diff = step >> 3;
+	if (code & 4) diff += step;
+	if (code & 2) diff += step >> 1;
+	if (code & 1) diff += step >> 2;
+	*predictor += (code & 8) ? -diff : diff;
+	*predictor = std::max(-32768, std::min(32767, *predictor));
+	*index = std::max(0, std::min(88, *index + ADPCMIndexTable[code]));
+}
+
+static inline int16_t to_int16(float value) {
+	return int16_t(std::max(-32768.0f, std::min(32767.0f, std::round(value * 32768.0f))));
+}
+
+//helper: decode the first 'count' samples of ADPCM block 'block' into 'out':
+static void decode_adpcm_block(uint8_t const *block, uint32_t count, float *out) {
+	int32_t predictor = int16_t(uint16_t(block[0]) | (uint16_t(block[1]) << 8));
+	int32_t index = std::min< int32_t >(88, block[2]);
+	uint8_t const *codes = block + 4;
+	for (uint32_t i = 0; i < count; ++i) {
+		uint8_t code = (i & 1) ? (codes[i/2] >> 4) : (codes[i/2] & 0xf);
+		adpcm_step(code, &predictor, &index);
+		out[i] = float(predictor) * (1.0f / 32768.0f);
+	}
+}
+
+SampleData::SampleData(std::vector< float > const &samples, Encoding encoding_, uint32_t rate_) : encoding(encoding_), length(uint32_t(samples.size())), rate(rate_) {
+	if (encoding == Float32) {
+		floats = samples;
+	} else if (encoding == Int16) {
+		int16s.resize(samples.size());
+		for (uint32_t i = 0; i < length; ++i) {
+			int16s[i] = to_int16(samples[i]);
+		}
+	} else if (encoding == ADPCM) {
+		uint32_t blocks = (length + ADPCMBlockSamples - 1) / ADPCMBlockSamples;
+		adpcm.assign(blocks * ADPCMBlockBytes, 0);
+
+		//encode block 'b' starting from step index 'index' into 'block' (if not null); returns squared error in the block:
+		auto encode_block = [&](uint32_t b, int32_t *index, uint8_t *block) {
+			uint32_t begin = b * ADPCMBlockSamples;
+			auto sample = [&](uint32_t i) -> int32_t {
+				return (begin + i < length ? to_int16(samples[begin + i]) : 0);
+			};
+
+			int32_t predictor = sample(0);
+			if (block) {
+				block[0] = uint8_t(uint16_t(predictor) & 0xff);
+				block[1] = uint8_t(uint16_t(predictor) >> 8);
+				block[2] = uint8_t(*index);
+			}
+
+			double error = 0.0;
+			for (uint32_t i = 0; i < ADPCMBlockSamples; ++i) {
+				int32_t step = ADPCMStepTable[*index];
+				int32_t diff = sample(i) - predictor;
+				uint8_t code = 0;
+				if (diff < 0) {
+					code = 8;
+					diff = -diff;
+				}
+				if (diff >= step) { code |= 4; diff -= step; }
+				if (diff >= (step >> 1)) { code |= 2; diff -= (step >> 1); }
+				if (diff >= (step >> 2)) { code |= 1; }
+				adpcm_step(code, &predictor, index);
+				error += double(sample(i) - predictor) * double(sample(i) - predictor);
+				if (block) block[4 + i/2] |= (i & 1) ? uint8_t(code << 4) : code;
+			}
+			return error;
+		};
+
+		//the step index carries from block to block (so each block starts well-adapted),
+		// except the first block's, which is picked to fit its samples best:
+		int32_t index = 0;
+		double best = std::numeric_limits< double >::infinity();
+		for (int32_t start = 0; start <= 88 && blocks > 0; ++start) {
+			int32_t trial = start;
+			double error = encode_block(0, &trial, nullptr);
+			if (error < best) {
+				best = error;
+				index = start;
+			}
+		}
+		for (uint32_t b = 0; b < blocks; ++b) {
+			encode_block(b, &index, adpcm.data() + b * ADPCMBlockBytes);
+		}
+	} else {
+		throw std::runtime_error("Unknown sample encoding " + std::to_string(int(encoding)) + ".");
+	}
+}
+
+size_t SampleData::bytes() const {
+	return floats.size() * sizeof(float) + int16s.size() * sizeof(int16_t) + adpcm.size();
+}
+
+void SampleData::decode(uint32_t begin, uint32_t count, float *out) const {
+	assert(begin + count <= length);
+	if (encoding == Float32) {
+		std::copy(floats.begin() + begin, floats.begin() + begin + count, out);
+	} else if (encoding == Int16) {
+		for (uint32_t i = 0; i < count; ++i) {
+			out[i] = float(int16s[begin + i]) * (1.0f / 32768.0f);
+		}
+	} else if (encoding == ADPCM) {
+		float block[ADPCMBlockSamples];
+		for (uint32_t done = 0; done < count; /* later */) {
+			uint32_t at = begin + done;
+			uint32_t offset = at % ADPCMBlockSamples;
+			uint32_t run = std::min(count - done, ADPCMBlockSamples - offset);
+			decode_adpcm_block(adpcm.data() + (at / ADPCMBlockSamples) * ADPCMBlockBytes, offset + run, block);
+			std::copy(block + offset, block + offset + run, out + done);
+			done += run;
+		}
+	}
+}
+
+void SampleData::window(int64_t begin, uint32_t count, bool loop, float *out) const {
+	int64_t const end = int64_t(length);
+	for (uint32_t done = 0; done < count; /* later */) {
+		int64_t at = begin + done;
+		uint32_t run;
+		if (loop && end > 0) {
+			at = ((at % end) + end) % end;
+			run = uint32_t(std::min< int64_t >(count - done, end - at));
+			decode(uint32_t(at), run, out + done);
+		} else if (at < 0) {
+			run = uint32_t(std::min< int64_t >(count - done, -at));
+			std::fill(out + done, out + done + run, 0.0f);
+		} else if (at >= end) {
+			run = count - done;
+			std::fill(out + done, out + done + run, 0.0f);
+		} else {
+			run = uint32_t(std::min< int64_t >(count - done, end - at));
+			decode(uint32_t(at), run, out + done);
+		}
+		done += run;
+	}
+}
+
+void SampleData::mix(MixKernel const &kernel, uint32_t begin, uint32_t count, float left, float right, float left_step, float right_step, float *out) const {
+	assert(begin + count <= length);
+	if (encoding == Float32) {
+		kernel.mix_mono_to_stereo(floats.data() + begin, count, left, right, left_step, right_step, out);
+	} else if (encoding == Int16) {
+		kernel.mix_int16_mono_to_stereo(int16s.data() + begin, count, left, right, left_step, right_step, out);
+	} else if (encoding == ADPCM) {
+		//(ADPCM doesn't vectorize, so decode a block at a time into scratch space and mix that)
+		float block[ADPCMBlockSamples];
+		for (uint32_t done = 0; done < count; /* later */) {
+			uint32_t at = begin + done;
+			uint32_t offset = at % ADPCMBlockSamples;
+			uint32_t run = std::min(count - done, ADPCMBlockSamples - offset);
+			decode_adpcm_block(adpcm.data() + (at / ADPCMBlockSamples) * ADPCMBlockBytes, offset + run, block);
+			kernel.mix_mono_to_stereo(block + offset, run, left + float(done) * left_step, right + float(done) * right_step, left_step, right_step, out + 2*done);
+			done += run;
+		}
+	}
+}
+
+char const *sample_encoding_name(SampleData::Encoding encoding) {
+	if (encoding == SampleData::Float32) return "float32";
+	if (encoding == SampleData::Int16) return "int16";
+	if (encoding == SampleData::ADPCM) return "adpcm";
+	return "unknown";
+}
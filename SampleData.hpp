@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+ * SampleData holds the audio of a Sound::Sample (mono, at its native rate) in one of a few encodings,
+ *  trading memory for a little decoding work in the mixer:
+ *  - Float32: 4 bytes per sample (stored as-is)
+ *  - Int16: 2 bytes per sample
+ *  - ADPCM: IMA ADPCM, about half a byte per sample: blocks of 256 samples,
+ *    each a 4-byte header (int16 predictor, uint8 step index, uint8 unused) followed by
+ *    128 bytes of 4-bit codes (low nibble first); blocks decode independently, so
+ *    playback can start anywhere
+ *
+ * mix() is the mixer's inner loop for a run of a sample; it decodes on the fly
+ *  (using the int16 mix kernel, or a small scratch buffer for ADPCM).
+ *
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct MixKernel;
+
+struct SampleData {
+	enum Encoding : uint8_t {
+		Float32,
+		Int16,
+		ADPCM,
+	};
+	static constexpr uint32_t ADPCMBlockSamples = 256;
+	static constexpr uint32_t ADPCMBlockBytes = 4 + ADPCMBlockSamples / 2;
+
+	//encode 'samples' (which should be in [-1,1]; Int16 and ADPCM clamp to that range):
+	SampleData(std::vector< float > const &samples, Encoding encoding, uint32_t rate = 48000);
+
+	Encoding encoding;
+	uint32_t length = 0; //in samples
+	uint32_t rate = 48000; //samples per second (Sound's mixer resamples anything other than its own 48kHz)
+
+	//only the member for 'encoding' is used:
+	std::vector< float > floats;
+	std::vector< int16_t > int16s;
+	std::vector< uint8_t > adpcm;
+
+	//memory used by the encoded samples:
+	size_t bytes() const;
+
+	//decode samples [begin, begin + count) into 'out':
+	void decode(uint32_t begin, uint32_t count, float *out) const;
+
+	//decode samples [begin, begin + count), where out-of-range indices wrap around if 'loop' and are silent otherwise:
+	void window(int64_t begin, uint32_t count, bool loop, float *out) const;
+
+	//add samples [begin, begin + count) into interleaved stereo 'out' with ramped gains (see mix_kernels.hpp):
+	void mix(MixKernel const &kernel, uint32_t begin, uint32_t count, float left, float right, float left_step, float right_step, float *out) const;
+};
+
+//name of an encoding (e.g., for reports):
+char const *sample_encoding_name(SampleData::Encoding encoding);
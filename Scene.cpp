@@ -1,11 +1,13 @@
 #include "Scene.hpp"
 
 #include "gl_errors.hpp"
-#include "read_write_chunk.hpp"
+#include "ChunkReader.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <cmath>
 #include <fstream>
+#include <algorithm>
 
 //-------------------------
 
@@ -73,13 +75,283 @@ glm::mat4x3 Scene::Transform::make_world_to_local() const {
 
 //-------------------------
 
+void Scene::update_world() const {
+	//--- check if hierarchy changed since it was last flattened ---
+	if (!world.rebuild) {
+		if (transforms.size() != world.transform.size()) {
+			world.rebuild = true;
+		} else {
+			for (auto const &t : transforms) {
+				uint32_t i = t.world_index;
+				if (i >= world.transform.size() || world.transform[i] != &t || world.parent_ptr[i] != t.parent.get()) {
+					world.rebuild = true;
+					break;
+				}
+			}
+		}
+	}
+
+	//--- flatten hierarchy into topological order ---
+	bool force = false;
+	if (world.rebuild) {
+		uint32_t count = uint32_t(transforms.size());
+
+		std::vector< Transform const * > list;
+		list.reserve(count);
+		for (auto const &t : transforms) {
+			t.world_index = uint32_t(list.size());
+			list.emplace_back(&t);
+		}
+		auto index_of = [&list](Transform const *t) -> uint32_t {
+			if (t && t->world_index < list.size() && list[t->world_index] == t) return t->world_index;
+			return -1U; //null or not in this scene
+		};
+
+		//depth in hierarchy (parents are shallower than their children):
+		std::vector< uint32_t > depth(count, -1U);
+		std::vector< uint32_t > stack;
+		for (uint32_t i = 0; i < count; ++i) {
+			uint32_t at = i;
+			while (depth[at] == -1U) {
+				uint32_t p = index_of(list[at]->parent.get());
+				if (p == -1U) {
+					depth[at] = 0;
+					break;
+				}
+				stack.emplace_back(at);
+				if (stack.size() > count) {
+					throw std::runtime_error("transform hierarchy contains a cycle (at '" + list[i]->name + "')");
+				}
+				at = p;
+			}
+			while (!stack.empty()) {
+				uint32_t child = stack.back();
+				stack.pop_back();
+				depth[child] = depth[index_of(list[child]->parent.get())] + 1;
+			}
+		}
+
+		std::vector< uint32_t > order(count);
+		for (uint32_t i = 0; i < count; ++i) order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&depth](uint32_t a, uint32_t b) {
+			return depth[a] < depth[b];
+		});
+
+		world.transform.resize(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			world.transform[i] = list[order[i]];
+		}
+		for (uint32_t i = 0; i < count; ++i) {
+			world.transform[i]->world_index = i;
+		}
+
+		world.parent_ptr.resize(count);
+		world.parent.resize(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			Transform const *parent = world.transform[i]->parent.get();
+			world.parent_ptr[i] = parent;
+			world.parent[i] = -1U;
+			if (parent && parent->world_index < count && world.transform[parent->world_index] == parent) {
+				world.parent[i] = parent->world_index;
+				assert(world.parent[i] < i);
+			}
+		}
+
+		world.position.resize(count);
+		world.rotation.resize(count);
+		world.scale.resize(count);
+		world.local_to_world.resize(count);
+		world.dirty.resize(count);
+		world.changed.resize(count);
+
+		world.rebuild = false;
+		world.rebuilds += 1;
+		force = true;
+	}
+
+	//--- update world matrices (parents always come before children) ---
+	world.recomputed = 0;
+	world.updates += 1;
+	for (uint32_t i = 0; i < world.transform.size(); ++i) {
+		Transform const &t = *world.transform[i];
+		uint32_t parent = world.parent[i];
+
+		bool dirty = force
+			|| t.position != world.position[i]
+			|| t.rotation != world.rotation[i]
+			|| t.scale != world.scale[i]
+			|| (parent != -1U && world.dirty[parent])
+			|| (parent == -1U && world.parent_ptr[i]); //(parents outside this scene can't be tracked)
+		world.dirty[i] = dirty;
+		if (!dirty) continue;
+		world.changed[i] = world.updates;
+
+		world.position[i] = t.position;
+		world.rotation[i] = t.rotation;
+		world.scale[i] = t.scale;
+
+		glm::mat4x3 local_to_parent = t.make_local_to_parent();
+		if (parent != -1U) {
+			world.local_to_world[i] = world.local_to_world[parent] * glm::mat4(local_to_parent);
+		} else if (world.parent_ptr[i]) {
+			world.local_to_world[i] = world.parent_ptr[i]->make_local_to_world() * glm::mat4(local_to_parent);
+		} else {
+			world.local_to_world[i] = local_to_parent;
+		}
+		world.recomputed += 1;
+	}
+}
+
+glm::mat4x3 Scene::world_matrix(Transform const *transform) const {
+	assert(transform);
+	uint32_t i = transform->world_index;
+	if (i < world.transform.size() && world.transform[i] == transform && world.parent_ptr[i] == transform->parent.get()) {
+		return world.local_to_world[i];
+	} else {
+		return transform->make_local_to_world();
+	}
+}
+
+//-------------------------
+
+//size (in bytes) of an element of type 'index_type':
+static size_t index_size(GLenum index_type) {
+	if (index_type == GL_UNSIGNED_SHORT) return 2;
+	if (index_type == GL_UNSIGNED_INT) return 4;
+	assert(index_type == GL_UNSIGNED_BYTE && "index_type should be a valid glDrawElements type");
+	return 1;
+}
+
+//does this drawable have (object-space) bounds?
+static bool has_bounds(Scene::Drawable const &drawable) {
+	Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+	return pipeline.min.x <= pipeline.max.x && pipeline.min.y <= pipeline.max.y && pipeline.min.z <= pipeline.max.z;
+}
+
+BVH::Box Scene::world_bounds(Drawable const &drawable) const {
+	if (!has_bounds(drawable)) return BVH::Box();
+	assert(drawable.transform); //drawables *must* have a transform
+	glm::mat4x3 to_world = world_matrix(drawable.transform);
+
+	//same as BoxBatch::add -- center transforms as a point, extent by the absolute value of the linear part:
+	glm::vec3 center = 0.5f * (drawable.pipeline.max + drawable.pipeline.min);
+	glm::vec3 extent = 0.5f * (drawable.pipeline.max - drawable.pipeline.min);
+	glm::vec3 world_center = to_world * glm::vec4(center, 1.0f);
+	glm::vec3 world_extent =
+		  glm::abs(to_world[0]) * extent.x
+		+ glm::abs(to_world[1]) * extent.y
+		+ glm::abs(to_world[2]) * extent.z;
+	return BVH::Box(world_center - world_extent, world_center + world_extent);
+}
+
+void Scene::update_bvh() const {
+	update_world();
+
+	//--- check if the set of drawables with bounds (or the hierarchy) changed ---
+	bool rebuild = (bvh.world_rebuilds != world.rebuilds);
+	if (!rebuild) {
+		uint32_t i = 0;
+		for (auto const &drawable : drawables) {
+			if (!has_bounds(drawable)) continue;
+			if (i >= bvh.drawables.size() || bvh.drawables[i] != &drawable) {
+				rebuild = true;
+				break;
+			}
+			++i;
+		}
+		if (i != bvh.drawables.size()) rebuild = true;
+	}
+
+	if (rebuild) {
+		//--- build from scratch ---
+		bvh.drawables.clear();
+		bvh.min.clear();
+		bvh.max.clear();
+		std::vector< BVH::Box > boxes;
+		for (auto const &drawable : drawables) {
+			if (!has_bounds(drawable)) continue;
+			bvh.drawables.emplace_back(&drawable);
+			bvh.min.emplace_back(drawable.pipeline.min);
+			bvh.max.emplace_back(drawable.pipeline.max);
+			boxes.emplace_back(world_bounds(drawable));
+		}
+		bvh.tree.build(boxes);
+		bvh.world_rebuilds = world.rebuilds;
+	} else {
+		//--- refit drawables whose world matrix or bounds changed since the last update ---
+		for (uint32_t i = 0; i < bvh.drawables.size(); ++i) {
+			Drawable const &drawable = *bvh.drawables[i];
+			uint32_t w = drawable.transform->world_index;
+			bool moved = !(w < world.transform.size() && world.transform[w] == drawable.transform) //(transforms outside this scene can't be tracked)
+				|| world.changed[w] > bvh.world_updates;
+			if (!moved && drawable.pipeline.min == bvh.min[i] && drawable.pipeline.max == bvh.max[i]) continue;
+			bvh.min[i] = drawable.pipeline.min;
+			bvh.max[i] = drawable.pipeline.max;
+			bvh.tree.set_box(i, world_bounds(drawable));
+		}
+		bvh.tree.refit();
+	}
+	bvh.world_updates = world.updates;
+}
+
+void Scene::query_frustum(Frustum const &frustum, std::vector< Drawable const * > *drawables_) const {
+	assert(drawables_);
+	update_bvh();
+	bvh.items.clear();
+	bvh.tree.query_frustum(frustum, &bvh.items);
+	for (uint32_t i : bvh.items) {
+		drawables_->emplace_back(bvh.drawables[i]);
+	}
+}
+
+void Scene::query_box(glm::vec3 const &min, glm::vec3 const &max, std::vector< Drawable const * > *drawables_) const {
+	assert(drawables_);
+	update_bvh();
+	bvh.items.clear();
+	bvh.tree.query_box(BVH::Box(min, max), &bvh.items);
+	for (uint32_t i : bvh.items) {
+		drawables_->emplace_back(bvh.drawables[i]);
+	}
+}
+
+Scene::Drawable const *Scene::pick(glm::vec3 const &origin, glm::vec3 const &direction, float *t) const {
+	update_bvh();
+	uint32_t i = bvh.tree.raycast(origin, direction, std::numeric_limits< float >::infinity(), t);
+	return (i == -1U ? nullptr : bvh.drawables[i]);
+}
+
+//-------------------------
+
 glm::mat4 Scene::Camera::make_projection() const {
 	return glm::infinitePerspective( fovy, aspect, near );
 }
 
+void Scene::Camera::make_ray(glm::vec2 const &ndc, glm::vec3 *origin, glm::vec3 *direction) const {
+	assert(origin && direction);
+	assert(transform);
+	//camera looks along -z, with the image plane at z = -1 spanning [-tan(fovy/2)*aspect, tan(fovy/2)*aspect] x [-tan(fovy/2), tan(fovy/2)]:
+	float scale = std::tan(0.5f * fovy);
+	glm::vec3 local = glm::vec3(ndc.x * scale * aspect, ndc.y * scale, -1.0f);
+	glm::mat4x3 local_to_world = transform->make_local_to_world();
+	*origin = local_to_world[3];
+	*direction = glm::mat3(local_to_world) * local;
+}
+
 //-------------------------
 
 
+//level of detail for a drawable whose bounding sphere covers 'size' of the viewport height, given the level it was drawn at last:
+// thresholds the drawable is already past must be crossed back by the hysteresis margin before the level changes again.
+static uint32_t select_lod(Scene::Drawable::Pipeline const &pipeline, float size, uint32_t current, float hysteresis) {
+	uint32_t lod = 0;
+	while (lod < pipeline.lods.size()) {
+		float below = pipeline.lods[lod].below * (lod < current ? 1.0f + hysteresis : 1.0f - hysteresis);
+		if (!(size < below)) break;
+		lod += 1;
+	}
+	return lod;
+}
+
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
 	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
@@ -89,7 +361,71 @@ void Scene::draw(Camera const &camera) const {
 
 void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
 
-	//Iterate through all drawables, sending each one to OpenGL:
+	//bring cached world matrices up to date:
+	update_world();
+
+	draw_stats = DrawStats();
+
+	//--- build render queue ---
+	//drawables are submitted sorted by (program, vao, textures) so that drawables sharing state are adjacent:
+	render_queue.clear();
+	render_queue.reserve(drawables.size());
+
+	//drawables with bounds are culled in a batch once all of them have been gathered:
+	Frustum frustum(world_to_clip);
+	cull_batch.clear();
+	cull_drawables.clear();
+	uint32_t bvh_candidates = 0; //drawables that the BVH query could return
+
+	//projected size of a sphere is radius * (length of the clip y row) / (clip w):
+	glm::vec3 clip_y = glm::vec3(world_to_clip[0][1], world_to_clip[1][1], world_to_clip[2][1]);
+	glm::vec4 clip_w = glm::vec4(world_to_clip[0][3], world_to_clip[1][3], world_to_clip[2][3], world_to_clip[3][3]);
+	float clip_y_scale = glm::length(clip_y);
+
+	auto enqueue = [&,this](Drawable const &drawable) {
+		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+
+		RenderQueueEntry entry;
+		entry.start = pipeline.start;
+		entry.count = pipeline.count;
+		entry.position_to_object = &pipeline.position_to_object;
+
+		//pick level of detail:
+		uint32_t lod = 0;
+		if (lod_selection && !pipeline.lods.empty() && has_bounds(drawable)) {
+			assert(drawable.transform); //drawables *must* have a transform
+			glm::mat4x3 to_world = world_matrix(drawable.transform);
+			glm::vec3 center = to_world * glm::vec4(0.5f * (pipeline.max + pipeline.min), 1.0f);
+			float scale = std::max(glm::length(to_world[0]), std::max(glm::length(to_world[1]), glm::length(to_world[2])));
+			float radius = scale * glm::length(0.5f * (pipeline.max - pipeline.min));
+			float w = glm::dot(clip_w, glm::vec4(center, 1.0f));
+			//(camera inside the sphere => as big as it gets)
+			float size = (w > radius ? lod_scale * radius * clip_y_scale / w : std::numeric_limits< float >::infinity());
+			lod = select_lod(pipeline, size, drawable.lod, lod_hysteresis);
+		}
+		drawable.lod = lod;
+		if (lod != 0) {
+			Drawable::Pipeline::LOD const &level = pipeline.lods[lod-1];
+			entry.start = level.start;
+			entry.count = level.count;
+			entry.position_to_object = &level.position_to_object;
+			draw_stats.lod_reduced += 1;
+		}
+
+		//textures only affect sort order, so a hash is good enough here:
+		uint32_t textures_hash = 0;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			textures_hash = textures_hash * 0x01000193 ^ pipeline.textures[i].texture;
+			textures_hash = textures_hash * 0x01000193 ^ pipeline.textures[i].target;
+		}
+
+		entry.key = (uint64_t(pipeline.program & 0xffff) << 48)
+		          | (uint64_t(pipeline.vao & 0xffff) << 32)
+		          | uint64_t(textures_hash);
+		entry.drawable = &drawable;
+		render_queue.emplace_back(entry);
+	};
+
 	for (auto const &drawable : drawables) {
 		//Reference to drawable's pipeline for convenience:
 		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
@@ -101,67 +437,238 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 		//skip any drawables that don't contain any vertices:
 		if (pipeline.count == 0) continue;
 
+		if (frustum_culling && has_bounds(drawable)) {
+			if (bvh_culling) {
+				bvh_candidates += 1;
+				continue; //(found by BVH query below)
+			}
+			assert(drawable.transform); //drawables *must* have a transform
+			cull_batch.add(world_matrix(drawable.transform), pipeline.min, pipeline.max);
+			cull_drawables.emplace_back(&drawable);
+		} else {
+			enqueue(drawable);
+		}
+	}
+
+	//--- frustum culling ---
+	cull_visible.resize(cull_drawables.size());
+	uint32_t visible = ::cull_boxes(frustum, cull_batch, cull_visible.data());
+	for (uint32_t i = 0; i < cull_drawables.size(); ++i) {
+		if (cull_visible[i]) enqueue(*cull_drawables[i]);
+	}
+	draw_stats.culled = uint32_t(cull_drawables.size()) - visible;
+
+	if (frustum_culling && bvh_culling) {
+		cull_drawables.clear();
+		query_frustum(frustum, &cull_drawables);
+		for (Drawable const *drawable : cull_drawables) {
+			//same skip tests as above:
+			if (drawable->pipeline.program == 0 || drawable->pipeline.vao == 0 || drawable->pipeline.count == 0) continue;
+			enqueue(*drawable);
+			visible += 1;
+		}
+		draw_stats.culled = bvh_candidates - visible;
+	}
+	draw_stats.visible = uint32_t(render_queue.size());
+	//(stable, so drawables with identical state keep their relative order)
+	// ...with drawables of the same vertex range adjacent, so they can be instanced:
+	std::stable_sort(render_queue.begin(), render_queue.end(), [](RenderQueueEntry const &a, RenderQueueEntry const &b) {
+		if (a.key != b.key) return a.key < b.key;
+		if (a.start != b.start) return a.start < b.start;
+		if (a.count != b.count) return a.count < b.count;
+		return a.drawable->pipeline.index_type < b.drawable->pipeline.index_type;
+	});
+
+	//--- submit ---
+	//GL state as set by this function (so redundant calls can be skipped):
+	GLuint current_program = 0;
+	GLuint current_vao = 0;
+	Drawable::Pipeline::TextureInfo current_textures[Drawable::Pipeline::TextureCount];
+	uint32_t current_unit = 0;
+	bool first = true;
+
+	uint32_t state_calls = 0; //program/vao/texture calls actually made
+	uint32_t naive_state_calls = 0; //calls that binding everything for every drawable would have made
+
+	auto set_unit = [&](uint32_t unit) {
+		if (unit == current_unit) return;
+		glActiveTexture(GL_TEXTURE0 + unit);
+		current_unit = unit;
+		state_calls += 1;
+	};
 
+	auto bind = [&](GLuint program, GLuint vao, Drawable::Pipeline const &pipeline) {
 		//Set shader program:
-		glUseProgram(pipeline.program);
+		if (first || program != current_program) {
+			glUseProgram(program);
+			current_program = program;
+			draw_stats.program_binds += 1;
+			state_calls += 1;
+		}
 
 		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
-
-		//Configure program uniforms:
+		if (first || vao != current_vao) {
+			glBindVertexArray(vao);
+			current_vao = vao;
+			draw_stats.vao_binds += 1;
+			state_calls += 1;
+		}
+		first = false;
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+		//set up textures (leaving units this drawable doesn't use alone; nothing samples them):
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			auto const &want = pipeline.textures[i];
+			if (want.texture == 0) continue;
+			auto &have = current_textures[i];
+			if (want.texture == have.texture && want.target == have.target) continue;
+			set_unit(i);
+			if (have.texture != 0 && have.target != want.target) {
+				//different target -- unbind old one so it doesn't linger:
+				glBindTexture(have.target, 0);
+				state_calls += 1;
+			}
+			glBindTexture(want.target, want.texture);
+			have = want;
+			draw_stats.texture_binds += 1;
+			state_calls += 1;
+		}
+	};
 
-		//OBJECT_TO_CLIP takes vertices from object space to clip space:
-		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+	//can drawables 'a' and 'b' be drawn with the same instanced draw call?
+	auto same_instance_batch = [](RenderQueueEntry const &ea, RenderQueueEntry const &eb) {
+		Drawable::Pipeline const &a = ea.drawable->pipeline;
+		Drawable::Pipeline const &b = eb.drawable->pipeline;
+		if (a.instancing.program != b.instancing.program) return false;
+		if (a.instancing.vao != b.instancing.vao) return false;
+		if (a.instancing.instance_buffer != b.instancing.instance_buffer) return false;
+		if (a.type != b.type || ea.start != eb.start || ea.count != eb.count || a.index_type != b.index_type) return false;
+		if (*ea.position_to_object != *eb.position_to_object) return false;
+		if (b.set_uniforms) return false;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			if (a.textures[i].texture != b.textures[i].texture) return false;
+			if (a.textures[i].target != b.textures[i].target) return false;
 		}
+		return true;
+	};
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+	for (uint32_t begin = 0; begin < render_queue.size(); /* later */) {
+		RenderQueueEntry const &entry = render_queue[begin];
+		Scene::Drawable::Pipeline const &pipeline = entry.drawable->pipeline;
 
-		//OBJECT_TO_CLIP takes vertices from object space to light space:
-		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+		//find run of drawables that could share one instanced draw:
+		uint32_t end = begin + 1;
+		if (pipeline.instancing.program != 0 && pipeline.instancing.vao != 0 && pipeline.instancing.instance_buffer != 0 && !pipeline.set_uniforms) {
+			while (end < render_queue.size() && same_instance_batch(entry, render_queue[end])) {
+				++end;
+			}
 		}
 
-		//NORMAL_TO_CLIP takes normals from object space to light space:
-		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+		//(program, vao, per-texture bind + unbind, and final glActiveTexture -- for each drawable:)
+		uint32_t textures_used = 0;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			if (pipeline.textures[i].texture != 0) textures_used += 1;
 		}
+		naive_state_calls += (end - begin) * (3 + 4 * textures_used);
+
+		if (end - begin >= 2) {
+			//---- instanced ----
+			instance_data.clear();
+			instance_data.reserve(end - begin);
+			for (uint32_t i = begin; i < end; ++i) {
+				Scene::Drawable const &drawable = *render_queue[i].drawable;
+				assert(drawable.transform); //drawables *must* have a transform
+				glm::mat4x3 object_to_world = world_matrix(drawable.transform);
+				glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+				glm::mat4 position_to_object = glm::mat4(*entry.position_to_object);
+
+				instance_data.emplace_back();
+				Drawable::Pipeline::Instance &instance = instance_data.back();
+				instance.OBJECT_TO_CLIP = world_to_clip * glm::mat4(object_to_world) * position_to_object;
+				instance.OBJECT_TO_LIGHT = glm::mat4(object_to_light) * position_to_object;
+				instance.NORMAL_TO_LIGHT = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
+			}
 
-		//set any requested custom uniforms:
-		if (pipeline.set_uniforms) pipeline.set_uniforms();
+			//stream instance data (orphaning the old contents so there's no stall on draws still using them):
+			glBindBuffer(GL_ARRAY_BUFFER, pipeline.instancing.instance_buffer);
+			glBufferData(GL_ARRAY_BUFFER, instance_data.size() * sizeof(instance_data[0]), nullptr, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, instance_data.size() * sizeof(instance_data[0]), instance_data.data());
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-		//set up textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+			bind(pipeline.instancing.program, pipeline.instancing.vao, pipeline);
+
+			if (pipeline.index_type != GL_NONE) {
+				glDrawElementsInstanced(pipeline.type, entry.count, pipeline.index_type, (GLbyte *)0 + entry.start * index_size(pipeline.index_type), GLsizei(instance_data.size()));
+			} else {
+				glDrawArraysInstanced(pipeline.type, entry.start, entry.count, GLsizei(instance_data.size()));
 			}
-		}
+			draw_stats.drawn += end - begin;
+			draw_stats.instanced_batches += 1;
+			draw_stats.instanced_drawables += end - begin;
+		} else {
+			//---- single ----
+			Scene::Drawable const &drawable = *render_queue[begin].drawable;
 
-		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+			bind(pipeline.program, pipeline.vao, pipeline);
 
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
+			//Configure program uniforms:
+
+			//the object-to-world matrix is used in all three of these uniforms:
+			assert(drawable.transform); //drawables *must* have a transform
+			glm::mat4x3 object_to_world = world_matrix(drawable.transform);
+			//(vertex positions may need to be mapped to object space first)
+			glm::mat4 position_to_object = glm::mat4(*entry.position_to_object);
+
+			//OBJECT_TO_CLIP takes vertices from object space to clip space:
+			if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
+				glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world) * position_to_object;
+				glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+			}
+
+			//the object-to-light matrix is used in the next two uniforms:
+			glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+
+			//OBJECT_TO_CLIP takes vertices from object space to light space:
+			if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
+				glm::mat4x3 position_to_light = glm::mat4(object_to_light) * position_to_object;
+				glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(position_to_light));
+			}
+
+			//NORMAL_TO_CLIP takes normals from object space to light space:
+			if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
+				glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
+				glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+			}
+
+			//set any requested custom uniforms:
+			if (pipeline.set_uniforms) pipeline.set_uniforms();
+
+			//draw the object:
+			if (pipeline.index_type != GL_NONE) {
+				glDrawElements(pipeline.type, entry.count, pipeline.index_type, (GLbyte *)0 + entry.start * index_size(pipeline.index_type));
+			} else {
+				glDrawArrays(pipeline.type, entry.start, entry.count);
 			}
+			draw_stats.drawn += 1;
 		}
-		glActiveTexture(GL_TEXTURE0);
 
+		begin = end;
+	}
+
+	//un-bind textures once at the end:
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (current_textures[i].texture != 0) {
+			set_unit(i);
+			glBindTexture(current_textures[i].target, 0);
+			state_calls += 1;
+		}
 	}
+	set_unit(0);
 
 	glUseProgram(0);
 	glBindVertexArray(0);
 
+	draw_stats.gl_calls_saved = (naive_state_calls > state_calls ? naive_state_calls - state_calls : 0);
+
 	GL_ERRORS();
 }
 
@@ -169,10 +676,10 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
 
-	std::ifstream file(filename, std::ios::binary);
+	//chunks are read in place from a mapping of the file (no intermediate copies):
+	ChunkReader file(filename);
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	Span< char > names = file.read< char >("str0");
 
 	struct HierarchyEntry {
 		uint32_t parent;
@@ -183,8 +690,7 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	Span< HierarchyEntry > hierarchy = file.read< HierarchyEntry >("xfh0");
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -192,8 +698,7 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	Span< MeshEntry > meshes = file.read< MeshEntry >("msh0");
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -202,8 +707,7 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > cameras;
-	read_chunk(file, "cam0", &cameras);
+	Span< CameraEntry > cameras = file.read< CameraEntry >("cam0");
 
 	struct LightEntry {
 		uint32_t transform;
@@ -214,8 +718,7 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > lights;
-	read_chunk(file, "lmp0", &lights);
+	Span< LightEntry > lights = file.read< LightEntry >("lmp0");
 
 
 	//--------------------------------
@@ -231,7 +734,7 @@ void Scene::load(std::string const &filename,
 			if (h.parent >= hierarchy_transforms.size()) {
 				throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
 			}
-			t->parent = hierarchy_transforms[h.parent];
+			t->parent = transforms.handle(hierarchy_transforms[h.parent]);
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
@@ -302,9 +805,10 @@ void Scene::load(std::string const &filename,
 	}
 
 	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
+	std::istream &rest = file.rest();
+	load_extra(rest, names, hierarchy_transforms);
 
-	if (file.peek() != EOF) {
+	if (rest.peek() != EOF) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
 
@@ -327,51 +831,50 @@ Scene &Scene::operator=(Scene const &other) {
 	return *this;
 }
 
-void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map_) {
-
-	std::unordered_map< Transform const *, Transform * > t2t_temp;
-	std::unordered_map< Transform const *, Transform * > &transform_to_transform = *(transform_map_ ? transform_map_ : &t2t_temp);
-
-	transform_to_transform.clear();
+void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map) {
+	if (&other == this) return;
 
-	//null transform maps to itself:
-	transform_to_transform.insert(std::make_pair(nullptr, nullptr));
+	//copy transforms slot-for-slot (so slot indices are the same in both scenes):
+	transforms = other.transforms;
+	world = World(); //cache will be rebuilt on next update
+	bvh = DrawableBVH(); //...as will the BVH
 
-	//Copy transforms and store mapping:
-	transforms.clear();
-	for (auto const &t : other.transforms) {
-		transforms.emplace_back();
-		transforms.back().name = t.name;
-		transforms.back().position = t.position;
-		transforms.back().rotation = t.rotation;
-		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
-
-		//store mapping between transforms old and new:
-		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
-		assert(ret.second);
-	}
-
-	//update transform parents:
+	//point parent handles at this scene's transforms:
+	Pool< Transform > *other_transforms = const_cast< Pool< Transform > * >(&other.transforms);
 	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+		if (t.parent.pool == other_transforms) t.parent = t.parent.rebind(&transforms);
 	}
 
+	//transform pointers map by slot index:
+	auto remap = [this,&other](Transform *transform) -> Transform * {
+		uint32_t i = other.transforms.index_of(transform);
+		return (i == -1U ? transform : &transforms.at(i)); //(pointers to transforms outside 'other' are left alone)
+	};
+
 	//copy other's drawables, updating transform pointers:
 	drawables = other.drawables;
 	for (auto &d : drawables) {
-		d.transform = transform_to_transform.at(d.transform);
+		d.transform = remap(d.transform);
 	}
 
 	//copy other's cameras, updating transform pointers:
 	cameras = other.cameras;
 	for (auto &c : cameras) {
-		c.transform = transform_to_transform.at(c.transform);
+		c.transform = remap(c.transform);
 	}
 
 	//copy other's lights, updating transform pointers:
 	lights = other.lights;
 	for (auto &l : lights) {
-		l.transform = transform_to_transform.at(l.transform);
+		l.transform = remap(l.transform);
+	}
+
+	//report mapping, if requested:
+	if (transform_map) {
+		transform_map->clear();
+		transform_map->insert(std::make_pair(nullptr, nullptr)); //null transform maps to itself
+		for (auto t = other.transforms.begin(); t != other.transforms.end(); ++t) {
+			transform_map->insert(std::make_pair(&*t, &transforms.at(t.i)));
+		}
 	}
 }
@@ -11,13 +11,17 @@
  */
 
 #include "GL.hpp"
+#include "ChunkReader.hpp"
+#include "Pool.hpp"
+#include "Frustum.hpp"
+#include "BVH.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
-#include <list>
 #include <memory>
 #include <functional>
+#include <limits>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -33,7 +37,8 @@ struct Scene {
 		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
 
 		//The transform above may be relative to some parent transform:
-		Transform *parent = nullptr;
+		// (to set: transform->parent = scene.transforms.handle(other_transform); )
+		Handle< Transform > parent;
 
 		//It is often convenient to construct matrices representing this transformation:
 		// ..relative to its parent:
@@ -43,10 +48,9 @@ struct Scene {
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
 
-		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
-		Transform(Transform const &) = delete;
-		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
-		Transform() = default;
+		//position of this transform in its scene's world matrix cache (maintained by Scene::update_world):
+		mutable uint32_t world_index = -1U;
+
 	};
 
 	struct Drawable {
@@ -65,6 +69,30 @@ struct Scene {
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
 
+			//if not GL_NONE, start/count are a range of indices (of this type) in the vao's element array buffer, drawn with glDrawElements:
+			// (e.g., copied from Mesh::index_type)
+			GLenum index_type = GL_NONE;
+
+			//maps the vertex Position attribute to object space:
+			// (e.g., copied from Mesh::position_to_object; identity unless positions are quantized)
+			// applied to OBJECT_TO_CLIP and OBJECT_TO_LIGHT but not NORMAL_TO_LIGHT.
+			glm::mat4x3 position_to_object = glm::mat4x3(1.0f);
+
+			//(optional) coarser versions of the vertex range above, finest first, drawn when the drawable is small on screen:
+			// (e.g., filled in by MeshBuffer::set_lods; they share type, index_type, and bounds with the range above)
+			struct LOD {
+				GLuint start = 0;
+				GLuint count = 0;
+				glm::mat4x3 position_to_object = glm::mat4x3(1.0f);
+				float below = 0.0f; //used when bounding sphere's projected diameter is less than this fraction of the viewport height
+			};
+			std::vector< LOD > lods;
+
+			//object-space bounding box of the vertices above (e.g., copied from Mesh::min/max), used for culling:
+			// (if min > max -- the default -- bounds are unknown and the drawable is never culled)
+			glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
 			//uniforms:
 			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
 			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
@@ -78,7 +106,30 @@ struct Scene {
 				GLuint texture = 0;
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
+
+			//(optional) instanced variant of this pipeline:
+			// when several drawables share a pipeline and vertex range (and have no set_uniforms),
+			// Scene::draw draws them with one glDrawArraysInstanced call using this program and vao,
+			// streaming an 'Instance' per drawable into instance_buffer.
+			// (see LitColorTextureInstancedProgram for a program that works this way)
+			struct Instancing {
+				GLuint program = 0; //0 => don't instance
+				GLuint vao = 0; //must also source per-instance attributes from instance_buffer
+				GLuint instance_buffer = 0;
+			} instancing;
+
+			//per-instance data, as streamed into instancing.instance_buffer:
+			struct Instance {
+				glm::mat4 OBJECT_TO_CLIP;
+				glm::mat4x3 OBJECT_TO_LIGHT;
+				glm::mat3 NORMAL_TO_LIGHT;
+			};
+			static_assert(sizeof(Instance) == 4*16 + 4*12 + 4*9, "Instance is packed.");
 		} pipeline;
+
+		//level of detail drawn by the most recent draw(): 0 for the pipeline's own range, i for pipeline.lods[i-1]
+		// (remembered so that selection can have hysteresis)
+		mutable uint32_t lod = 0;
 	};
 
 	struct Camera {
@@ -93,6 +144,9 @@ struct Scene {
 		float near = 0.01f; //near plane
 		//computed from the above:
 		glm::mat4 make_projection() const;
+		//world-space ray through a point on screen (given in normalized device coordinates, i.e., [-1,1]x[-1,1]):
+		// (e.g., for mouse picking with Scene::pick; direction is not normalized)
+		void make_ray(glm::vec2 const &ndc, glm::vec3 *origin, glm::vec3 *direction) const;
 	};
 
 	struct Light {
@@ -117,10 +171,18 @@ struct Scene {
 	};
 
 	//Scenes, of course, may have many of the above objects:
-	std::list< Transform > transforms;
-	std::list< Drawable > drawables;
-	std::list< Camera > cameras;
-	std::list< Light > lights;
+	// (pools keep elements at stable addresses in contiguous chunks; see Pool.hpp)
+	Pool< Transform > transforms;
+	Pool< Drawable > drawables;
+	Pool< Camera > cameras;
+	Pool< Light > lights;
+
+	//World matrices for every transform, computed in one linear pass over a flattened copy of the hierarchy:
+	// update_world() recomputes only transforms whose position/rotation/scale (or an ancestor's) changed since the last call.
+	// (draw() calls update_world() itself; call it directly if you want world matrices outside of draw())
+	void update_world() const;
+	//cached local-to-world matrix (falls back to make_local_to_world() if transform isn't in the cache):
+	glm::mat4x3 world_matrix(Transform const *transform) const;
 
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera) const;
@@ -128,6 +190,51 @@ struct Scene {
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
 
+	//if set, draw() skips drawables whose (world-space) bounds are outside the view frustum:
+	bool frustum_culling = true;
+	//if set (along with frustum_culling), draw() finds visible drawables with a BVH query instead of testing every box:
+	// (worth it when most of a large scene is off-screen; the flat test is faster when most things are visible)
+	bool bvh_culling = false;
+
+	//if set, draw() draws drawables with pipeline.lods at a level picked from their projected size:
+	// (a level is used once the drawable's bounding sphere covers less than its 'below' fraction of the viewport height)
+	bool lod_selection = true;
+	//projected sizes are multiplied by this before comparing with thresholds (< 1 => coarser levels sooner):
+	float lod_scale = 1.0f;
+	//drawables switch levels only once they are this fraction past a threshold (so levels don't flicker at a boundary):
+	float lod_hysteresis = 0.1f;
+
+	//Bounding volume hierarchy over drawables' world-space bounds (drawables without bounds aren't included):
+	// update_bvh() refits the boxes of drawables that moved (or whose bounds changed) since the last call,
+	// and only rebuilds the tree when drawables are added/removed or the transform hierarchy changes.
+	// (the query functions below call update_bvh() themselves)
+	void update_bvh() const;
+	//drawables whose world-space bounds are (at least partly) inside the frustum:
+	void query_frustum(Frustum const &frustum, std::vector< Drawable const * > *drawables) const;
+	//drawables whose world-space bounds overlap the box [min,max]:
+	void query_box(glm::vec3 const &min, glm::vec3 const &max, std::vector< Drawable const * > *drawables) const;
+	//drawable whose world-space bounds are hit first by the ray origin + t * direction (t >= 0), or nullptr:
+	// (sets *t to the distance along the ray to the box)
+	Drawable const *pick(glm::vec3 const &origin, glm::vec3 const &direction, float *t = nullptr) const;
+	//world-space bounds of a drawable, as stored in the BVH (empty box if the drawable has no bounds):
+	BVH::Box world_bounds(Drawable const &drawable) const;
+
+	//Statistics from the most recent draw():
+	// drawables are submitted sorted by (program, vao, textures), and binds that wouldn't change state are skipped.
+	struct DrawStats {
+		uint32_t visible = 0; //drawables that passed frustum culling (or had no bounds)
+		uint32_t culled = 0; //drawables skipped by frustum culling
+		uint32_t drawn = 0; //drawables submitted
+		uint32_t program_binds = 0; //glUseProgram calls
+		uint32_t vao_binds = 0; //glBindVertexArray calls
+		uint32_t texture_binds = 0; //glBindTexture calls (not counting unbinds)
+		uint32_t gl_calls_saved = 0; //state-setting calls skipped compared to binding (and unbinding) everything per drawable
+		uint32_t instanced_batches = 0; //glDrawArraysInstanced calls
+		uint32_t instanced_drawables = 0; //drawables drawn by those calls
+		uint32_t lod_reduced = 0; //drawables drawn with one of their pipeline's coarser lods
+	};
+	mutable DrawStats draw_stats;
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
@@ -137,7 +244,7 @@ struct Scene {
 
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
-	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
+	virtual void load_extra(std::istream &from, Span< char > const &str0, std::vector< Transform * > const &xfh0) { }
 
 	//empty scene:
 	Scene() = default;
@@ -146,8 +253,63 @@ struct Scene {
 	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable);
 
 	//copy a scene (with proper pointer fixup):
+	// (pools are copied slot-for-slot, so fixup is just re-pointing handles and indexing; no lookups)
 	Scene(Scene const &); //...as a constructor
 	Scene &operator=(Scene const &); //...as scene = scene
 	//... as a set() function that optionally returns the transform->transform mapping:
 	void set(Scene const &, std::unordered_map< Transform const *, Transform * > *transform_map = nullptr);
+
+	//-- internals --
+
+	//structure-of-arrays copy of the transform hierarchy, in topological order (parents before children):
+	struct World {
+		std::vector< Transform const * > transform;
+		std::vector< Transform const * > parent_ptr; //parent pointer when hierarchy was flattened (to notice re-parenting)
+		std::vector< uint32_t > parent; //index of parent in these arrays, or -1U for roots (and parents outside this scene)
+
+		//local transformation as of the last update (to notice changes):
+		std::vector< glm::vec3 > position;
+		std::vector< glm::quat > rotation;
+		std::vector< glm::vec3 > scale;
+
+		std::vector< glm::mat4x3 > local_to_world;
+		std::vector< uint8_t > dirty; //was local_to_world recomputed in the last update?
+		std::vector< uint32_t > changed; //update (as counted by 'updates') at which local_to_world was last recomputed
+
+		bool rebuild = true; //does the hierarchy need to be re-flattened?
+
+		//stats, handy for checking that caching is working:
+		uint32_t recomputed = 0; //matrices recomputed in the last update
+		uint32_t rebuilds = 0; //times hierarchy was flattened
+		uint32_t updates = 0; //times update_world() has run
+	};
+	mutable World world;
+
+	//BVH over drawables with bounds, plus what's needed to notice changes (see update_bvh):
+	struct DrawableBVH {
+		BVH tree; //item i is drawables[i]
+		std::vector< Drawable const * > drawables;
+		std::vector< glm::vec3 > min, max; //object-space bounds when last synced
+		uint32_t world_rebuilds = -1U; //world.rebuilds when tree was built
+		uint32_t world_updates = 0; //world.updates when last synced
+		std::vector< uint32_t > items; //scratch for query results
+	};
+	mutable DrawableBVH bvh;
+
+	//drawables in submission order, rebuilt by each draw() (kept to avoid re-allocating):
+	struct RenderQueueEntry {
+		uint64_t key; //program : 16 | vao : 16 | hash of textures : 32
+		Drawable const *drawable;
+		//vertex range to draw (the pipeline's own, or that of the selected lod):
+		GLuint start;
+		GLuint count;
+		glm::mat4x3 const *position_to_object;
+	};
+	mutable std::vector< RenderQueueEntry > render_queue;
+	mutable std::vector< Drawable::Pipeline::Instance > instance_data; //staging for instance_buffer uploads
+
+	//scratch space for frustum culling:
+	mutable BoxBatch cull_batch;
+	mutable std::vector< Drawable const * > cull_drawables;
+	mutable std::vector< uint8_t > cull_visible;
 };
@@ -0,0 +1,111 @@
+#include "ShapeCache.hpp"
+
+#include <functional>
+#include <cassert>
+
+ShapeCache::ShapeCache(hb_font_t *font_, hb_buffer_t *buffer_, size_t capacity_)
+	: font(font_), buffer(buffer_), capacity(capacity_) {
+	assert(font);
+	assert(buffer);
+	assert(capacity > 0);
+	language = hb_language_from_string("en", -1);
+}
+
+//helper: fold the non-text parts of the key into the text hash:
+static size_t combine_hash(size_t seed, size_t value) {
+	return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+ShapedRun const &ShapeCache::get(std::string const &text, float scale, float wrap_width) {
+	size_t hash = std::hash< std::string >()(text);
+	hash = combine_hash(hash, std::hash< float >()(scale));
+	hash = combine_hash(hash, std::hash< float >()(wrap_width));
+	hash = combine_hash(hash, std::hash< uint32_t >()(uint32_t(script)));
+	hash = combine_hash(hash, std::hash< void const * >()(language));
+
+	auto f = lookup.find(hash);
+	if (f != lookup.end()) {
+		Entry &entry = *f->second;
+		if (entry.scale == scale && entry.wrap_width == wrap_width
+		 && entry.script == script && entry.language == language
+		 && entry.text == text) {
+			hits += 1;
+			//move to front of LRU order (no allocation; just relinks the node):
+			entries.splice(entries.begin(), entries, f->second);
+			return entry.run;
+		}
+		//hash collision with a different key -- replace the old entry:
+		entries.erase(f->second);
+		lookup.erase(f);
+	}
+
+	misses += 1;
+
+	if (entries.size() >= capacity) {
+		lookup.erase(entries.back().hash);
+		entries.pop_back();
+		evictions += 1;
+	}
+
+	entries.emplace_front();
+	Entry &entry = entries.front();
+	entry.hash = hash;
+	entry.text = text;
+	entry.scale = scale;
+	entry.wrap_width = wrap_width;
+	entry.script = script;
+	entry.language = language;
+	shape(entry);
+
+	lookup.emplace(hash, entries.begin());
+
+	return entry.run;
+}
+
+void ShapeCache::clear() {
+	entries.clear();
+	lookup.clear();
+}
+
+void ShapeCache::shape(Entry &entry) {
+	hb_buffer_clear_contents(buffer);
+	hb_buffer_add_utf8(buffer, entry.text.c_str(), int(entry.text.size()), 0, int(entry.text.size()));
+	hb_buffer_set_direction(buffer, HB_DIRECTION_LTR);
+	hb_buffer_set_script(buffer, entry.script);
+	hb_buffer_set_language(buffer, entry.language);
+	hb_shape(font, buffer, NULL, 0);
+
+	unsigned int num_glyphs = 0;
+	hb_glyph_info_t *infos = hb_buffer_get_glyph_infos(buffer, &num_glyphs);
+	hb_glyph_position_t *positions = hb_buffer_get_glyph_positions(buffer, &num_glyphs);
+
+	ShapedRun &run = entry.run;
+	run.glyphs.clear();
+	run.glyphs.reserve(num_glyphs);
+	run.line_breaks.clear();
+
+	float const scale = entry.scale;
+	glm::vec2 pen = glm::vec2(0.0f);
+	for (unsigned int i = 0; i < num_glyphs; ++i) {
+		run.glyphs.emplace_back();
+		ShapedRun::Glyph &glyph = run.glyphs.back();
+		glyph.index = infos[i].codepoint;
+		glyph.origin = pen + glm::vec2(positions[i].x_offset >> 6, positions[i].y_offset >> 6) * scale;
+
+		//advance is in 1/64 pixels; bitshift by 6 to get value in pixels (2^6 = 64):
+		pen.x += (positions[i].x_advance >> 6) * scale;
+
+		//new line after a space once the line is too long, or after a newline:
+		char c = (infos[i].cluster < entry.text.size() ? entry.text[infos[i].cluster] : '\0');
+		if ((pen.x > entry.wrap_width && c == ' ') || c == '\n') {
+			pen.x = 0.0f;
+			pen.y -= line_height * scale;
+			run.line_breaks.emplace_back(i + 1);
+		}
+	}
+}
+
+void ShapeCache::print_stats(std::ostream &out) const {
+	out << "Shape cache: " << entries.size() << "/" << capacity << " runs; "
+	    << hits << " hits, " << misses << " misses, " << evictions << " evictions." << std::endl;
+}
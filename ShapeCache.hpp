@@ -0,0 +1,78 @@
+#pragma once
+
+/*
+ * ShapeCache remembers the result of shaping (HarfBuzz) and line-breaking a
+ * string so that text which doesn't change between frames isn't re-shaped.
+ *
+ * Entries are keyed by the text (via its hash, with a full comparison on hit),
+ * the scale it was laid out at, the wrap width, and the script + language used
+ * for shaping. The least-recently-used entry is dropped when the cache is full.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <hb.h>
+
+#include <list>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+
+struct ShapedRun {
+	struct Glyph {
+		uint32_t index = 0;      //glyph index in font (a.k.a. FT_UInt / hb codepoint after shaping)
+		glm::vec2 origin;        //pen position of this glyph relative to the run origin, already scaled
+	};
+	std::vector< Glyph > glyphs;
+
+	//index of the first glyph of each line after the first:
+	std::vector< uint32_t > line_breaks;
+};
+
+struct ShapeCache {
+	//'buffer' is used as scratch space for shaping:
+	ShapeCache(hb_font_t *font, hb_buffer_t *buffer, size_t capacity = 64);
+
+	//line layout parameters (in unscaled pixels):
+	float line_height = 50.0f;
+
+	//shaping parameters (part of the cache key, so changing them is safe):
+	hb_script_t script = HB_SCRIPT_LATIN;
+	hb_language_t language = nullptr; //set to "en" by constructor
+
+	//get a (possibly cached) shaped + line-broken version of 'text':
+	// lines are broken at the first space after the pen passes 'wrap_width', and at newlines.
+	// note: the returned reference is valid until the next call to get().
+	ShapedRun const &get(std::string const &text, float scale, float wrap_width);
+
+	//drop all cached runs (e.g., if the font size changes):
+	void clear();
+
+	//----- stats -----
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t evictions = 0;
+	void print_stats(std::ostream &out) const;
+
+	//-- internals --
+	hb_font_t *font;
+	hb_buffer_t *buffer;
+	size_t capacity;
+
+	struct Entry {
+		size_t hash = 0;
+		std::string text;
+		float scale = 0.0f;
+		float wrap_width = 0.0f;
+		hb_script_t script = HB_SCRIPT_LATIN;
+		hb_language_t language = nullptr;
+		ShapedRun run;
+	};
+	std::list< Entry > entries; //front is most-recently used
+	std::unordered_map< size_t, std::list< Entry >::iterator > lookup;
+
+	void shape(Entry &entry);
+};
@@ -28,6 +28,8 @@ ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
 		scene_drawable->pipeline.count = 0;
+		scene_drawable->pipeline.index_type = GL_NONE;
+		scene_drawable->pipeline.position_to_object = glm::mat4x3(1.0f);
 	}
 
 	//select first mesh in buffer:
@@ -49,6 +51,25 @@ bool ShowMeshesMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window
 		}
 	}
 
+	//----- picking -----
+	if (evt.type == SDL_MOUSEBUTTONDOWN && evt.button.button == SDL_BUTTON_RIGHT) {
+		glm::vec2 ndc;
+		ndc.x = (evt.button.x + 0.5f) / float(window_size.x) * 2.0f - 1.0f;
+		ndc.y = (evt.button.y + 0.5f) / float(window_size.y) *-2.0f + 1.0f;
+		glm::vec3 origin, direction;
+		scene_camera->make_ray(ndc, &origin, &direction);
+		float t = 0.0f;
+		picked = (scene.pick(origin, direction, &t) != nullptr);
+		if (picked) {
+			picked_at = origin + t * direction;
+			//orbit around the clicked point, at the distance it is from the camera now:
+			camera.radius = glm::length(scene_camera->transform->position - picked_at);
+			if (camera.radius < 1e-1f) camera.radius = 1e-1f;
+			camera.target = picked_at;
+		}
+		return true;
+	}
+
 	//----- trackball-style camera controls -----
 	if (evt.type == SDL_MOUSEBUTTONDOWN) {
 		if (evt.button.button == SDL_BUTTON_LEFT) {
@@ -141,6 +162,14 @@ void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 		);
 		draw_lines.draw_box(mat, glm::u8vec4(0xdd, 0xdd, 0xdd, 0xff));
 
+		//last pick:
+		if (picked) {
+			float s = 0.02f * camera.radius;
+			draw_lines.draw(picked_at - glm::vec3(s, 0.0f, 0.0f), picked_at + glm::vec3(s, 0.0f, 0.0f), glm::u8vec4(0xff, 0x88, 0x00, 0xff));
+			draw_lines.draw(picked_at - glm::vec3(0.0f, s, 0.0f), picked_at + glm::vec3(0.0f, s, 0.0f), glm::u8vec4(0xff, 0x88, 0x00, 0xff));
+			draw_lines.draw(picked_at - glm::vec3(0.0f, 0.0f, s), picked_at + glm::vec3(0.0f, 0.0f, s), glm::u8vec4(0xff, 0x88, 0x00, 0xff));
+		}
+
 		//mesh name:
 		draw_lines.draw_text("'" + current_mesh_name + "'",
 			current_mesh_min + glm::vec3(0.0f, -0.20f, 0.0f),
@@ -152,52 +181,61 @@ void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 }
 
 void ShowMeshesMode::select_prev_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) --f;
-	if (f == buffer.meshes.end()) f = buffer.meshes.begin();
-
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
+	//(meshes are in file order)
+	uint32_t i = buffer.find(current_mesh_name);
+	if (i == -1U) i = 0;
+	else if (i > 0) i -= 1;
+
+	if (i < buffer.meshes.size()) {
+		Mesh const &mesh = buffer.meshes[i];
+		current_mesh_name = buffer.name(i);
+		scene_drawable->pipeline.type = mesh.type;
+		scene_drawable->pipeline.start = mesh.start;
+		scene_drawable->pipeline.count = mesh.count;
+		scene_drawable->pipeline.index_type = mesh.index_type;
+		scene_drawable->pipeline.position_to_object = mesh.position_to_object;
+		scene_drawable->pipeline.min = mesh.min;
+		scene_drawable->pipeline.max = mesh.max;
+		current_mesh_min = mesh.min;
+		current_mesh_max = mesh.max;
 	} else {
 		current_mesh_name = "";
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
 		scene_drawable->pipeline.count = 0;
+		scene_drawable->pipeline.index_type = GL_NONE;
+		scene_drawable->pipeline.position_to_object = glm::mat4x3(1.0f);
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
 }
 
 void ShowMeshesMode::select_next_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) ++f;
-	if (f == buffer.meshes.end()) {
-		auto temp = buffer.meshes.rbegin();
-		if (temp != buffer.meshes.rend()) {
-			++temp;
-			f = temp.base();
-			assert(f != buffer.meshes.end());
-		}
-	}
-
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
+	uint32_t i = buffer.find(current_mesh_name);
+	if (i == -1U) i = uint32_t(buffer.meshes.size()) - 1;
+	else if (i + 1 < buffer.meshes.size()) i += 1;
+
+	if (i < buffer.meshes.size()) {
+		Mesh const &mesh = buffer.meshes[i];
+		current_mesh_name = buffer.name(i);
+		scene_drawable->pipeline.type = mesh.type;
+		scene_drawable->pipeline.start = mesh.start;
+		scene_drawable->pipeline.count = mesh.count;
+		scene_drawable->pipeline.index_type = mesh.index_type;
+		scene_drawable->pipeline.position_to_object = mesh.position_to_object;
+		scene_drawable->pipeline.min = mesh.min;
+		scene_drawable->pipeline.max = mesh.max;
+		current_mesh_min = mesh.min;
+		current_mesh_max = mesh.max;
 	} else {
 		current_mesh_name = "";
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
 		scene_drawable->pipeline.count = 0;
+		scene_drawable->pipeline.index_type = GL_NONE;
+		scene_drawable->pipeline.position_to_object = glm::mat4x3(1.0f);
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
 }
+
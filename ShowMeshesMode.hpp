@@ -44,4 +44,8 @@ struct ShowMeshesMode : Mode {
 	Scene scene;
 	Scene::Camera *scene_camera = nullptr;
 	Scene::Drawable *scene_drawable = nullptr;
+
+	//right-click on the mesh's bounds moves the camera target to the clicked point (using Scene::pick):
+	bool picked = false;
+	glm::vec3 picked_at = glm::vec3(0.0f);
 };
@@ -20,6 +20,22 @@ ShowSceneMode::~ShowSceneMode() {
 }
 
 bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
+	//----- picking -----
+	if (evt.type == SDL_MOUSEBUTTONDOWN && evt.button.button == SDL_BUTTON_RIGHT) {
+		glm::vec2 ndc;
+		ndc.x = (evt.button.x + 0.5f) / float(window_size.x) * 2.0f - 1.0f;
+		ndc.y = (evt.button.y + 0.5f) / float(window_size.y) *-2.0f + 1.0f;
+		glm::vec3 origin, direction;
+		scene_camera->make_ray(ndc, &origin, &direction);
+		float t = 0.0f;
+		picked = scene.drawables.handle(scene.pick(origin, direction, &t));
+		if (picked) {
+			picked_at = origin + t * direction;
+			std::cout << "Picked '" << picked->transform->name << "'." << std::endl;
+		}
+		return true;
+	}
+
 	//----- trackball-style camera controls -----
 	if (evt.type == SDL_MOUSEBUTTONDOWN) {
 		if (evt.button.button == SDL_BUTTON_LEFT) {
@@ -95,8 +111,9 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 
 	{ //decorate with some lines:
 		DrawLines draw_lines(scene_camera->make_projection() * glm::mat4(scene_camera->transform->make_world_to_local()));
+		scene.update_world(); //(already up-to-date from draw(), so this is cheap)
 		for (auto &transform : scene.transforms) {
-			glm::mat4 local_to_world = transform.make_local_to_world();
+			glm::mat4 local_to_world = scene.world_matrix(&transform);
 			auto xf = [&local_to_world](glm::vec3 const &vec) {
 				return glm::vec3(local_to_world * glm::vec4(vec, 1.0f));
 			};
@@ -106,7 +123,7 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 
 			if (transform.parent) {
 				//connect to parent:
-				glm::vec3 p = glm::vec3(transform.parent->make_local_to_world()[3]);
+				glm::vec3 p = glm::vec3(scene.world_matrix(transform.parent.get())[3]);
 				draw_lines.draw(p, xf(glm::vec3(0.0f)), glm::u8vec4(0xff, 0xff, 0x00, 0xff));
 			}
 
@@ -128,6 +145,26 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 				glm::u8vec4(0xff, 0xff, 0xff, 0xff)
 			);
 		}
+
+		//picked drawable (if it's still in the scene -- the handle won't follow a different drawable into its slot):
+		if (Scene::Drawable const *drawable = picked.get()) {
+			BVH::Box box = scene.world_bounds(*drawable);
+			glm::vec3 r = 0.5f * (box.max - box.min);
+			glm::vec3 c = 0.5f * (box.max + box.min);
+			draw_lines.draw_box(glm::mat4x3(
+				glm::vec3(r.x,  0.0f, 0.0f),
+				glm::vec3(0.0f,  r.y, 0.0f),
+				glm::vec3(0.0f, 0.0f,  r.z),
+				c
+			), glm::u8vec4(0xff, 0x88, 0x00, 0xff));
+			draw_lines.draw(picked_at, c, glm::u8vec4(0xff, 0x88, 0x00, 0xff));
+			draw_lines.draw_text("'" + drawable->transform->name + "'",
+				box.max + glm::vec3(0.0f, 0.0f, 0.05f),
+				0.15f * glm::vec3(1.0f, 0.0f, 0.0f),
+				0.15f * glm::vec3(0.0f, 0.0f, 1.0f),
+				glm::u8vec4(0xff, 0x88, 0x00, 0xff)
+			);
+		}
 		/*
 		glEnable(GL_LINE_SMOOTH);
 		glEnable(GL_BLEND);
@@ -33,4 +33,8 @@ struct ShowSceneMode : Mode {
 	//mode uses a secondary Scene to hold a camera:
 	Scene camera_scene;
 	Scene::Camera *scene_camera = nullptr;
+
+	//right-click picks a drawable (using Scene::pick); it is outlined and labeled while it stays in the scene:
+	Handle< Scene::Drawable > picked;
+	glm::vec3 picked_at = glm::vec3(0.0f); //world-space point where the pick ray hit the drawable's bounds
 };
@@ -1,12 +1,18 @@
 #include "Sound.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
+#include "OpusStream.hpp"
+#include "SampleCache.hpp"
+#include "SPSCRing.hpp"
+#include "mix_kernels.hpp"
 
 #include <SDL.h>
 
-#include <list>
+#include <memory>
+#include <deque>
 #include <cassert>
 #include <exception>
+#include <stdexcept>
 #include <iostream>
 #include <algorithm>
 
@@ -14,14 +20,185 @@
 namespace {
 
 	//handy constants:
-	constexpr uint32_t const AUDIO_RATE = 48000; //sampling rate
-	constexpr uint32_t const MIX_SAMPLES = 1024; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+	constexpr uint32_t const AUDIO_RATE = Sound::OutputRate; //sampling rate
+	constexpr uint32_t const MIX_SAMPLES = Sound::BlockFrames; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+	constexpr uint32_t const MAX_RESAMPLE_STEP = 8; //fastest a sample can play (in input samples per output sample), counting both its rate and the voice's
 
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
+	bool offline = false; //no device; Sound::render() calls the mixer instead
+
+	//Voices are the mixer's slots for playing samples, allocated once by Sound::init().
+	//Each slot has a game-side half (which the game thread uses to hand out voices and check handles)
+	// and a mixer-side half (the playback state, only touched by the audio callback); the two sides
+	// talk only through the 'commands' and 'retired' rings, so neither side ever waits and the audio
+	// callback never allocates or frees memory.
+
+	//mixer side:
+	struct Voice {
+		SampleData const *data = nullptr; //sample data being played...
+		OpusStream *stream = nullptr; //...or stream being played (one or the other)
+		uint32_t i = 0; //next data value to read (samples only)...
+		uint32_t frac = 0; //...plus a fraction (in 1/2^32ths) when resampling
+		bool loop = false; //should playback loop after data runs out?
+		bool stopping = false; //is playing stopping?
+		enum State : uint8_t {
+			Idle, //not playing
+			Playing,
+			Finished, //done playing, but not yet reported to the game thread (because 'retired' was full)
+		} state = Idle;
+		uint32_t generation = 0; //generation of the handle that started this playback
+
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+		Sound::Ramp< float > rate = Sound::Ramp< float >(1.0f);
+
+		//2D playback panning control: ('NaN' if sound played in 3D mode)
+		Sound::Ramp< float > pan = Sound::Ramp< float >(std::numeric_limits< float >::quiet_NaN());
+
+		//3D playback panning control: ('NaN' if sound played in 2D mode)
+		Sound::Ramp< glm::vec3 > position = Sound::Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
+		Sound::Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
+	};
+	std::vector< Voice > voices;
+	std::vector< uint32_t > active_voices; //indices of non-Idle voices (capacity reserved for all voices)
+
+	//loudness of each voice as of the last mixed block (written by the audio callback; read by the game thread when stealing):
+	std::unique_ptr< std::atomic< float >[] > voice_loudness;
+
+	//game side:
+	struct VoiceSlot {
+		uint32_t generation = 0; //bumped every time the voice is handed out
+		bool busy = false; //handed out and not yet retired
+		int32_t priority = 0;
+		uint64_t started = 0; //value of 'voice_plays' when handed out
+		uint64_t play_command = 0; //value of 'commands_queued' for the Play command that started it (until applied, 'voice_loudness' is stale)
+		SampleCache::Buffer data; //keeps the sample data the voice is playing alive (until retired)
+	};
+	std::vector< VoiceSlot > voice_slots;
+	std::vector< uint32_t > free_voices; //indices of non-busy slots (capacity reserved for all voices)
+	uint64_t voice_plays = 0;
+	Sound::StealPolicy steal_policy = Sound::StealPolicy::LowestPriority;
+
+	//voices that finished playing, passed from the audio callback back to the game thread:
+	struct Retired {
+		uint32_t voice = -1U;
+		uint32_t generation = 0;
+	};
+	SPSCRing< Retired, 1024 > retired;
+
+	//changes requested by the game thread, applied by the audio callback at the start of each block:
+	struct Command {
+		enum Type : uint8_t {
+			Play, //start playing 'data' on 'voice' (replacing whatever was there)
+			SetVolume, SetPan, SetPosition, SetHalfVolumeRadius, SetRate, Stop, //change 'voice' (using value.x or value)
+			StopAll,
+			SetGlobalVolume, //(value.x)
+			SetListener, //(value is position, value2 is right)
+		} type = Play;
+		uint32_t voice = -1U;
+		uint32_t generation = 0; //voice commands are ignored unless this matches the voice's current playback
+		glm::vec3 value = glm::vec3(0.0f);
+		glm::vec3 value2 = glm::vec3(0.0f);
+		float ramp = 0.0f;
+		//Play only:
+		SampleData const *data = nullptr;
+		OpusStream *stream = nullptr;
+		bool loop = false;
+		float volume = 1.0f;
+		float pan = 0.0f; //(NaN for 3D)
+		float half_volume_radius = 0.0f; //(NaN for 2D; 'value' holds the position)
+	};
+	SPSCRing< Command, 1024 > commands;
+	uint64_t commands_queued = 0; //(game thread)
+	std::atomic< uint64_t > commands_applied{0}; //(written by the audio callback)
+
+	//sample data of stolen voices, kept alive until the audio callback has applied the command
+	// (numbered as in 'commands_queued') that replaced it (game thread):
+	std::vector< std::pair< uint64_t, SampleCache::Buffer > > releasing;
+
+	//commands that didn't fit in the ring (only touched by the game thread; pushed before any newer command):
+	std::deque< Command > overflow;
+
+	//move as many overflowed commands into the ring as fit:
+	void flush_overflow() {
+		while (!overflow.empty() && commands.try_push(std::move(overflow.front()))) {
+			overflow.pop_front();
+		}
+	}
+
+	void push_command(Command &&command) {
+		if (device == 0 && !offline) return; //no audio callback to apply the command
+		commands_queued += 1;
+		flush_overflow();
+		if (!overflow.empty() || !commands.try_push(std::move(command))) {
+			overflow.emplace_back(std::move(command));
+		}
+	}
+
+	//mark voices the audio callback has finished with as free, and release sample data it no longer reads (game thread):
+	void collect_retired_voices() {
+		flush_overflow(); //(also a good time to retry commands that didn't fit in the ring)
+
+		uint64_t applied = commands_applied.load(std::memory_order_acquire);
+		releasing.erase(std::remove_if(releasing.begin(), releasing.end(), [&](auto const &r) {
+			return r.first <= applied;
+		}), releasing.end());
+
+		Retired r;
+		while (retired.try_pop(&r)) {
+			VoiceSlot &slot = voice_slots[r.voice];
+			//(a voice that was stolen after it finished is already in use again -- generation won't match)
+			if (slot.busy && slot.generation == r.generation) {
+				slot.busy = false;
+				slot.data.reset();
+				free_voices.emplace_back(r.voice);
+			}
+		}
+	}
+
+	//pick a voice for a new sample, stealing one if needed (game thread); returns -1U if none is available:
+	uint32_t claim_voice(int32_t priority) {
+		if (device == 0 && !offline) return -1U;
+		collect_retired_voices();
+
+		uint32_t v = -1U;
+		if (!free_voices.empty()) {
+			v = free_voices.back();
+			free_voices.pop_back();
+		} else {
+			//every voice is busy, so steal one:
+			//(voices the audio callback hasn't mixed yet count as loudest, so new sounds don't steal each other)
+			uint64_t applied = commands_applied.load(std::memory_order_acquire);
+			auto loudness = [applied](uint32_t v) {
+				if (voice_slots[v].play_command > applied) return std::numeric_limits< float >::infinity();
+				return voice_loudness[v].load(std::memory_order_relaxed);
+			};
+			auto better_victim = [&loudness](uint32_t a, uint32_t b) {
+				VoiceSlot const &sa = voice_slots[a];
+				VoiceSlot const &sb = voice_slots[b];
+				if (steal_policy == Sound::StealPolicy::LowestPriority && sa.priority != sb.priority) {
+					return sa.priority < sb.priority;
+				} else if (steal_policy == Sound::StealPolicy::Quietest) {
+					float la = loudness(a);
+					float lb = loudness(b);
+					if (la != lb) return la < lb;
+				}
+				return sa.started < sb.started;
+			};
+			for (uint32_t c = 0; c < voice_slots.size(); ++c) {
+				if (voice_slots[c].priority > priority) continue;
+				if (v == -1U || better_victim(c, v)) v = c;
+			}
+			if (v == -1U) return -1U;
+		}
 
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+		VoiceSlot &slot = voice_slots[v];
+		slot.generation += 1;
+		slot.busy = true;
+		slot.priority = priority;
+		slot.started = voice_plays++;
+		return v;
+	}
 
 }
 
@@ -38,22 +215,55 @@ void mix_audio(void *, Uint8 *buffer_, int len);
 
 //------------------------ public-facing --------------------------------
 
-Sound::Sample::Sample(std::string const &filename) {
-	if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
-		load_wav(filename, &data);
-	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
-		load_opus(filename, &data);
-	} else {
-		throw std::runtime_error("Sample '" + filename + "' doesn't end in either \".png\" or \".opus\" -- unsure how to load.");
-	}
+Sound::Sample::Sample(std::string const &filename, SampleData::Encoding encoding) {
+	data = SampleCache::load(filename, encoding, [](std::string const &filename, std::vector< float > *data, uint32_t *rate) {
+		if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
+			load_wav(filename, data, rate);
+		} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
+			load_opus(filename, data);
+		} else {
+			throw std::runtime_error("Sample '" + filename + "' doesn't end in either \".png\" or \".opus\" -- unsure how to load.");
+		}
+	});
 }
 
-Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
+Sound::Sample::Sample(std::vector< float > const &data_, SampleData::Encoding encoding, uint32_t rate) : data(std::make_shared< SampleData const >(data_, encoding, rate)) {
 }
 
+Sound::Stream::Stream(std::string const &filename, float buffer_ms) : opus(std::make_unique< OpusStream >(filename, buffer_ms)) {
+}
+
+Sound::Stream::~Stream() {
+}
 
 
-void Sound::init() {
+
+//helper: set up voices and tables (before the audio callback can run):
+static void init_voices(uint32_t max_voices) {
+	//pick the mix kernel (mix_kernels() allocates on its first call) and build resampling tables, before the audio callback can need them:
+	mix_kernel();
+	resample_table(1.0f);
+
+	//allocate voice storage (before the audio callback can run):
+	max_voices = std::max(1U, max_voices);
+	voices.assign(max_voices, Voice());
+	active_voices.clear();
+	active_voices.reserve(max_voices);
+	voice_loudness.reset(new std::atomic< float >[max_voices]);
+	for (uint32_t v = 0; v < max_voices; ++v) {
+		voice_loudness[v].store(0.0f, std::memory_order_relaxed);
+	}
+	voice_slots.assign(max_voices, VoiceSlot());
+	free_voices.clear();
+	free_voices.reserve(max_voices);
+	for (uint32_t v = max_voices; v > 0; --v) {
+		free_voices.emplace_back(v - 1); //(so voice 0 is handed out first)
+	}
+}
+
+void Sound::init(uint32_t max_voices) {
+	init_voices(max_voices);
+
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
 		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
@@ -88,8 +298,41 @@ void Sound::shutdown() {
 		SDL_CloseAudioDevice(device);
 		device = 0;
 	}
+	offline = false;
 }
 
+void Sound::init_offline(uint32_t max_voices) {
+	if (device != 0) {
+		throw std::runtime_error("Sound::init_offline() called while an audio device is open; call Sound::shutdown() first.");
+	}
+	init_voices(max_voices);
+	offline = true;
+}
+
+void Sound::render(uint32_t blocks, std::vector< float > *out) {
+	assert(out);
+	if (!offline) {
+		throw std::runtime_error("Sound::render() needs Sound::init_offline() (the audio device runs the mixer otherwise).");
+	}
+	for (uint32_t b = 0; b < blocks; ++b) {
+		flush_overflow(); //(with a device, commands stuck here would wait for the next push)
+		size_t at = out->size();
+		out->resize(at + 2 * MIX_SAMPLES);
+		mix_audio(nullptr, reinterpret_cast< Uint8 * >(out->data() + at), int(2 * MIX_SAMPLES * sizeof(float)));
+	}
+}
+
+void Sound::render_wav(std::string const &filename, uint32_t blocks) {
+	std::vector< float > out;
+	out.reserve(size_t(blocks) * 2 * MIX_SAMPLES);
+	render(blocks, &out);
+	save_wav(filename, out, AUDIO_RATE, 2);
+}
+
+
+void Sound::update() {
+	collect_retired_voices();
+}
 
 void Sound::lock() {
 	if (device) SDL_LockAudioDevice(device);
@@ -99,110 +342,173 @@ void Sound::unlock() {
 	if (device) SDL_UnlockAudioDevice(device);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+void Sound::set_steal_policy(StealPolicy policy) {
+	steal_policy = policy;
+}
+
+//helper: claim a voice and queue a command to start playing a sample (or stream) on it:
+static Sound::PlayingSample start_playing(SampleCache::Buffer const &data, OpusStream *stream, float volume, float pan, glm::vec3 const &position, float half_volume_radius, bool loop, int32_t priority) {
+	Sound::PlayingSample handle;
+	handle.voice = claim_voice(priority);
+	if (handle.voice == -1U) return handle;
+	VoiceSlot &slot = voice_slots[handle.voice];
+	handle.generation = slot.generation;
+
+	//(if the voice was stolen, the audio callback may read its old data until it applies the command below)
+	SampleCache::Buffer stolen_data = std::move(slot.data);
+	slot.data = data;
+
+	Command command;
+	command.type = Command::Play;
+	command.voice = handle.voice;
+	command.generation = handle.generation;
+	command.data = data.get();
+	command.stream = stream;
+	command.loop = loop;
+	command.volume = volume;
+	command.pan = pan;
+	command.value = position;
+	command.half_volume_radius = half_volume_radius;
+	push_command(std::move(command));
+	slot.play_command = commands_queued;
+
+	if (stolen_data) releasing.emplace_back(commands_queued, std::move(stolen_data));
+	return handle;
+}
+
+static Sound::PlayingSample start_playing(Sound::Sample const &sample, float volume, float pan, glm::vec3 const &position, float half_volume_radius, bool loop, int32_t priority) {
+	if (!sample.data || sample.data->length == 0) return Sound::PlayingSample();
+	return start_playing(sample.data, nullptr, volume, pan, position, half_volume_radius, loop, priority);
+}
+
+static Sound::PlayingSample start_playing(Sound::Stream &stream, float volume, float pan, glm::vec3 const &position, float half_volume_radius, bool loop, int32_t priority) {
+	//a stream's ring can only feed one voice:
+	if (!stream.playing.stopped()) {
+		std::cerr << "WARNING: stream '" << stream.opus->filename << "' is already playing; not playing it again." << std::endl;
+		return Sound::PlayingSample();
+	}
+	//if the voice was handed out again (e.g., stolen), the audio callback reads the stream until it applies
+	// the Play that took the voice, and the stream's ring has only one reader, so it can't restart before then:
+	if (stream.playing.voice < voice_slots.size()) {
+		VoiceSlot const &slot = voice_slots[stream.playing.voice];
+		if (slot.generation != stream.playing.generation && slot.play_command > commands_applied.load(std::memory_order_acquire)) {
+			std::cerr << "WARNING: stream '" << stream.opus->filename << "' lost its voice and the audio callback may still be reading it; not playing it again yet." << std::endl;
+			return Sound::PlayingSample();
+		}
+	}
+	//restart decoding if needed (safe: the audio callback isn't reading the stream):
+	if (stream.played || loop) stream.opus->rewind(loop);
+	stream.played = true;
+	stream.playing = start_playing(nullptr, stream.opus.get(), volume, pan, position, half_volume_radius, loop, priority);
+	return stream.playing;
+}
+
+Sound::PlayingSample Sound::play(Sample const &sample, float volume, float pan, int32_t priority) {
+	return start_playing(sample, volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), false, priority);
+}
+
+Sound::PlayingSample Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius, int32_t priority) {
+	return start_playing(sample, volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, false, priority);
+}
+
+Sound::PlayingSample Sound::loop(Sample const &sample, float volume, float pan, int32_t priority) {
+	return start_playing(sample, volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), true, priority);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius, int32_t priority) {
+	return start_playing(sample, volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, true, priority);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play(Stream &stream, float volume, float pan, int32_t priority) {
+	return start_playing(stream, volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), false, priority);
 }
 
+Sound::PlayingSample Sound::play_3D(Stream &stream, float volume, glm::vec3 const &position, float half_volume_radius, int32_t priority) {
+	return start_playing(stream, volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, false, priority);
+}
 
+Sound::PlayingSample Sound::loop(Stream &stream, float volume, float pan, int32_t priority) {
+	return start_playing(stream, volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), true, priority);
+}
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::loop_3D(Stream &stream, float volume, glm::vec3 const &position, float half_volume_radius, int32_t priority) {
+	return start_playing(stream, volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, true, priority);
 }
 
 
 void Sound::stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
-	}
-	unlock();
+	Command command;
+	command.type = Command::StopAll;
+	push_command(std::move(command));
 }
 
 void Sound::set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	Command command;
+	command.type = Command::SetGlobalVolume;
+	command.value.x = new_volume;
+	command.ramp = ramp;
+	push_command(std::move(command));
 }
 
 //------------------
 
+//helper: queue a command that changes a playing sample:
+static void push_sample_command(Sound::PlayingSample const &playing_sample, Command::Type type, glm::vec3 const &value, float ramp) {
+	if (playing_sample.stopped()) return;
+	Command command;
+	command.type = type;
+	command.voice = playing_sample.voice;
+	command.generation = playing_sample.generation;
+	command.value = value;
+	command.ramp = ramp;
+	push_command(std::move(command));
+}
+
+bool Sound::PlayingSample::stopped() const {
+	if (voice >= voice_slots.size()) return true;
+	collect_retired_voices();
+	VoiceSlot const &slot = voice_slots[voice];
+	return !(slot.busy && slot.generation == generation);
+}
+
 void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
-	Sound::lock();
-	if (!stopping) {
-		volume.set(new_volume, ramp);
-	}
-	Sound::unlock();
+	push_sample_command(*this, Command::SetVolume, glm::vec3(new_volume, 0.0f, 0.0f), ramp);
 }
 
 void Sound::PlayingSample::set_pan(float new_pan, float ramp) {
-	if (!(pan.value == pan.value)) return; //ignore if not in '2D' mode
-	Sound::lock();
-	pan.set(new_pan, ramp);
-	Sound::unlock();
+	push_sample_command(*this, Command::SetPan, glm::vec3(new_pan, 0.0f, 0.0f), ramp);
 }
 
 void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	position.set(new_position, ramp);
-	Sound::unlock();
+	push_sample_command(*this, Command::SetPosition, new_position, ramp);
 }
 
 void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	half_volume_radius.set(new_radius, ramp);
-	Sound::unlock();
+	push_sample_command(*this, Command::SetHalfVolumeRadius, glm::vec3(new_radius, 0.0f, 0.0f), ramp);
+}
+
+void Sound::PlayingSample::set_rate(float new_rate, float ramp) {
+	push_sample_command(*this, Command::SetRate, glm::vec3(new_rate, 0.0f, 0.0f), ramp);
 }
 
 void Sound::PlayingSample::stop(float ramp) {
-	Sound::lock();
-	if (!(stopping || stopped)) {
-		stopping = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
-	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
-	}
-	Sound::unlock();
+	push_sample_command(*this, Command::Stop, glm::vec3(0.0f), ramp);
 }
 
 //------------------
 
 void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
-	Sound::lock();
-	position.set(new_position, ramp);
+	Command command;
+	command.type = Command::SetListener;
+	command.value = new_position;
 	//some extra code to make sure right is always a unit vector:
 	if (new_right == glm::vec3(0.0f)) {
-		right.set(glm::vec3(1.0f, 0.0f, 0.0f), ramp);
+		command.value2 = glm::vec3(1.0f, 0.0f, 0.0f);
 	} else {
-		right.set(glm::normalize(new_right), ramp);
+		command.value2 = glm::normalize(new_right);
 	}
-	Sound::unlock();
+	command.ramp = ramp;
+	push_command(std::move(command));
 }
 
 //------------------------ internals --------------------------------
@@ -310,6 +616,140 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 }
 
 
+//helper: start fading out a voice:
+static void stop_voice(Voice &voice, float ramp) {
+	if (!voice.stopping) {
+		voice.stopping = true;
+		voice.volume.target = 0.0f;
+		voice.volume.ramp = ramp;
+	} else {
+		voice.volume.ramp = std::min(voice.volume.ramp, ramp);
+	}
+}
+
+//helper: apply a command from the game thread (called only by the audio callback):
+static void apply_command(Command const &command) {
+	if (command.type == Command::Play) {
+		//(if the voice is still busy, its old playback was stolen and is replaced outright)
+		Voice &voice = voices[command.voice];
+		if (voice.state == Voice::Idle) active_voices.emplace_back(command.voice); //(never exceeds reserved capacity)
+		voice.state = Voice::Playing;
+		voice.generation = command.generation;
+		voice.data = command.data;
+		voice.stream = command.stream;
+		voice.i = 0;
+		voice.frac = 0;
+		voice.loop = command.loop;
+		voice.stopping = false;
+		voice.volume = Sound::Ramp< float >(command.volume);
+		voice.rate = Sound::Ramp< float >(1.0f);
+		voice.pan = Sound::Ramp< float >(command.pan);
+		voice.position = Sound::Ramp< glm::vec3 >(command.value);
+		voice.half_volume_radius = Sound::Ramp< float >(command.half_volume_radius);
+		return;
+	}
+
+	if (command.voice != -1U) {
+		Voice &voice = voices[command.voice];
+		//ignore commands for playback that has already finished (or whose voice has been stolen):
+		if (voice.state != Voice::Playing || voice.generation != command.generation) return;
+		bool is_2D = (voice.pan.value == voice.pan.value);
+		switch (command.type) {
+			case Command::SetVolume:
+				if (!voice.stopping) voice.volume.set(command.value.x, command.ramp);
+				break;
+			case Command::SetPan:
+				if (is_2D) voice.pan.set(command.value.x, command.ramp); //(ignored if not in '2D' mode)
+				break;
+			case Command::SetPosition:
+				if (!is_2D) voice.position.set(command.value, command.ramp); //(ignored if not in '3D' mode)
+				break;
+			case Command::SetHalfVolumeRadius:
+				if (!is_2D) voice.half_volume_radius.set(command.value.x, command.ramp); //(ignored if not in '3D' mode)
+				break;
+			case Command::SetRate:
+				voice.rate.set(command.value.x, command.ramp);
+				break;
+			case Command::Stop:
+				stop_voice(voice, command.ramp);
+				break;
+			default:
+				break;
+		}
+		return;
+	}
+
+	switch (command.type) {
+		case Command::StopAll:
+			for (uint32_t v : active_voices) {
+				if (voices[v].state == Voice::Playing && !voices[v].stopping) {
+					stop_voice(voices[v], 1.0f / 60.0f);
+				}
+			}
+			break;
+		case Command::SetGlobalVolume:
+			Sound::volume.set(command.value.x, command.ramp);
+			break;
+		case Command::SetListener:
+			Sound::listener.position.set(command.value, command.ramp);
+			Sound::listener.right.set(command.value2, command.ramp);
+			break;
+		default:
+			break;
+	}
+}
+
+//helper: mix a block of a sample that isn't playing at exactly AUDIO_RATE, stepping 'step' (32.32 fixed point) input samples per output sample;
+// filters a chunk at a time into scratch space on the stack (so nothing is allocated) and then mixes that as usual:
+static void mix_resampled(MixKernel const &kernel, SampleData const &data, Voice &voice, uint64_t step, float left, float right, float left_step, float right_step, float *out) {
+	constexpr uint32_t Chunk = 256;
+	float const *table = resample_table(float(step) / 4294967296.0f);
+	float window[Chunk * MAX_RESAMPLE_STEP + ResampleTaps + 1];
+	float resampled[Chunk];
+
+	uint64_t const end = uint64_t(data.length) << 32;
+	uint64_t position = (uint64_t(voice.i) << 32) | voice.frac;
+	for (uint32_t mixed = 0; mixed < MIX_SAMPLES; /* later */) {
+		uint32_t count = std::min(Chunk, MIX_SAMPLES - mixed);
+		if (!voice.loop) {
+			count = uint32_t(std::min< uint64_t >(count, (end - position + step - 1) / step));
+		}
+
+		//the input samples under the filter for this chunk (ResampleTaps/2 - 1 before the first position through ResampleTaps/2 after the last):
+		int64_t first = int64_t(position >> 32) - int64_t(ResampleTaps / 2 - 1);
+		uint32_t span = uint32_t(((uint64_t(uint32_t(position)) + uint64_t(count - 1) * step) >> 32) + ResampleTaps);
+		assert(span <= sizeof(window) / sizeof(window[0]));
+		data.window(first, span, voice.loop, window);
+
+		kernel.resample(window, uint32_t(position), step, count, table, resampled);
+		kernel.mix_mono_to_stereo(
+			resampled, count,
+			left + float(mixed) * left_step, right + float(mixed) * right_step,
+			left_step, right_step,
+			out + 2 * mixed
+		);
+		mixed += count;
+
+		//update position in sample:
+		position += uint64_t(count) * step;
+		if (position >= end) {
+			if (voice.loop) {
+				position = ((position >> 32) % data.length) << 32 | (position & 0xffffffffull);
+			} else {
+				break;
+			}
+		}
+	}
+
+	if (position >= end) {
+		voice.i = data.length;
+		voice.frac = 0;
+	} else {
+		voice.i = uint32_t(position >> 32);
+		voice.frac = uint32_t(position);
+	}
+}
+
 //The audio callback -- invoked by SDL when it needs more sound to play:
 void mix_audio(void *, Uint8 *buffer_, int len) {
 	assert(buffer_); //should always have some audio buffer
@@ -322,12 +762,23 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
 	LR *buffer = reinterpret_cast< LR * >(buffer_);
 
+	//apply everything the game thread has asked for since the last block:
+	Command command;
+	uint64_t applied = commands_applied.load(std::memory_order_relaxed);
+	while (commands.try_pop(&command)) {
+		apply_command(command);
+		applied += 1;
+	}
+
 	//zero the output buffer:
 	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
 		buffer[s].l = 0.0f;
 		buffer[s].r = 0.0f;
 	}
 
+	//fastest mixing loop this CPU can run:
+	MixKernel const &kernel = mix_kernel();
+
 	//update global values:
 	float start_volume = Sound::volume.value;
 	glm::vec3 start_position =  Sound::listener.position.value;
@@ -342,8 +793,21 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	glm::vec3 end_right =  Sound::listener.right.value;
 
 	//add audio from each playing sample into the buffer:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
+	for (uint32_t ai = 0; ai < active_voices.size(); /* later */) {
+		uint32_t v = active_voices[ai];
+		Voice &playing_sample = voices[v];
+
+		//finished voices wait here until the game thread has room to hear about them:
+		if (playing_sample.state == Voice::Finished) {
+			if (retired.try_push(Retired{ v, playing_sample.generation })) {
+				playing_sample.state = Voice::Idle;
+				active_voices[ai] = active_voices.back();
+				active_voices.pop_back();
+			} else {
+				++ai;
+			}
+			continue;
+		}
 
 		//Figure out sample panning/volume at start...
 		LR start_pan;
@@ -386,51 +850,98 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 		end_pan.r *= end_volume * playing_sample.volume.value;
 
 		//figure out a step to add at each sample so that pan will move smoothly from start to end:
-		LR pan = start_pan;
 		LR pan_step;
 		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
 		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
 
-		assert(playing_sample.i < playing_sample.data.size());
+		bool finished = false;
+		if (playing_sample.stream) {
+			OpusStream &stream = *playing_sample.stream;
+			//mix whatever the decode thread has ready (in up to two runs, since the ring wraps):
+			uint32_t mixed = 0;
+			while (mixed < MIX_SAMPLES) {
+				float const *at = nullptr;
+				uint32_t run = std::min(MIX_SAMPLES - mixed, stream.readable(&at));
+				if (run == 0) break;
+				kernel.mix_mono_to_stereo(
+					at, run,
+					start_pan.l + float(mixed) * pan_step.l, start_pan.r + float(mixed) * pan_step.r,
+					pan_step.l, pan_step.r,
+					&buffer[mixed].l
+				);
+				stream.consume(run);
+				mixed += run;
+			}
+			finished = stream.drained();
+			if (mixed < MIX_SAMPLES && !finished) {
+				//decoder fell behind; rest of the block is silent:
+				stream.underruns.fetch_add(1, std::memory_order_relaxed);
+			}
+		} else {
+			SampleData const &data = *playing_sample.data;
+			assert(playing_sample.i < data.length);
 
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
+			//input samples to read per output sample (as 32.32 fixed point), from the data's rate and the voice's playback rate:
+			double step_ratio = double(data.rate) / double(AUDIO_RATE) * double(playing_sample.rate.value);
+			step_ratio = std::max(1.0 / 64.0, std::min(double(MAX_RESAMPLE_STEP), step_ratio));
+			uint64_t step = uint64_t(step_ratio * 4294967296.0);
+			step_value_ramp(playing_sample.rate);
 
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
-				} else {
-					break;
+			if (step != (1ull << 32) || playing_sample.frac != 0) {
+				mix_resampled(kernel, data, playing_sample, step, start_pan.l, start_pan.r, pan_step.l, pan_step.r, &buffer[0].l);
+			} else {
+				//mix in contiguous runs of the sample (each up to the end of the data, where it loops or stops),
+				// decoding as needed:
+				for (uint32_t mixed = 0; mixed < MIX_SAMPLES; /* later */) {
+					uint32_t run = std::min(MIX_SAMPLES - mixed, data.length - playing_sample.i);
+					data.mix(kernel,
+						playing_sample.i, run,
+						start_pan.l + float(mixed) * pan_step.l, start_pan.r + float(mixed) * pan_step.r,
+						pan_step.l, pan_step.r,
+						&buffer[mixed].l
+					);
+					mixed += run;
+
+					//update position in sample:
+					playing_sample.i += run;
+					if (playing_sample.i == data.length) {
+						if (playing_sample.loop) {
+							playing_sample.i = 0;
+						} else {
+							break;
+						}
+					}
 				}
 			}
-
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+			finished = (playing_sample.i >= data.length);
 		}
 
-		if (playing_sample.i >= playing_sample.data.size()
-		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
-		 	playing_sample.stopped = true;
-			//erase from list:
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
-		} else {
-			++si;
+		voice_loudness[v].store(std::max(end_pan.l, end_pan.r), std::memory_order_relaxed);
+
+		if (finished || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
+			//hand the voice back to the game thread (or try again next block if 'retired' is full):
+			voice_loudness[v].store(0.0f, std::memory_order_relaxed);
+			if (retired.try_push(Retired{ v, playing_sample.generation })) {
+				playing_sample.state = Voice::Idle;
+				active_voices[ai] = active_voices.back();
+				active_voices.pop_back();
+				continue; //(a different voice is now at 'ai')
+			}
+			playing_sample.state = Voice::Finished;
 		}
+		++ai;
 	}
 
+	//(stored after mixing, so voices started by these commands have up-to-date 'voice_loudness' by the time the game thread sees them applied;
+	// this also lets the game thread release data of stolen voices)
+	commands_applied.store(applied, std::memory_order_release);
+
 	/*//DEBUG: report output power:
 	float max_power = 0.0f;
 	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
 		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
 	}
-	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
+	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << active_voices.size() << std::endl; //DEBUG
 	*/
 
 }
@@ -1,7 +1,11 @@
 #pragma once
 
+#include "SampleData.hpp"
+
 #include <glm/glm.hpp>
 
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <vector>
 #include <string>
@@ -9,20 +13,30 @@
 
 //Game audio system. Simplified from f18-base3.
 //Uses 48kHz sampling rate.
+//
+//The functions below don't lock the audio callback; they queue commands that the
+// callback applies at the start of its next block (so changes made in one frame take
+// effect together). Call them from one thread -- the game thread.
+
+struct OpusStream;
 
 namespace Sound {
 
 //Sample objects hold mono (one-channel) audio.
 struct Sample {
 	//Load from a '.wav' or '.opus' file.
-	//  will warn and convert if sound is not already 48kHz mono:
-	Sample(std::string const &filename);
+	//  will warn and convert if sound is not already mono (WAV files keep their sample rate; the mixer resamples).
+	//  (data is shared through SampleCache, so every Sample of the same file and encoding uses one copy)
+	//  'encoding' trades memory for mixing work (see SampleData.hpp): Int16 halves it, ADPCM cuts it about 8x:
+	Sample(std::string const &filename, SampleData::Encoding encoding = SampleData::Float32);
 	
-	//Directly supply an audio buffer:
-	Sample(std::vector< float > const &data);
+	//Directly supply an audio buffer (at 'rate' samples per second):
+	Sample(std::vector< float > const &data, SampleData::Encoding encoding = SampleData::Float32, uint32_t rate = 48000);
 
-	//sample data is stored as 48kHz, mono, floating-point:
-	std::vector< float > data;
+	//sample data is stored as mono, at 'data->rate', in 'data->encoding';
+	// it is immutable, and lives as long as any Sample or playing voice uses it
+	// (so a Sample may be destroyed while it is playing):
+	std::shared_ptr< SampleData const > data;
 };
 
 //Ramp<> manages values that should be smoothly interpolated
@@ -48,9 +62,13 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+// 'PlayingSample' is a handle to a sample that play()/loop() started on one of the mixer's voices:
+// - it is small and copyable, and stays safe to use after the sample is done -- even after its
+//   voice has been reused for another sample -- because each use of a voice gets a new generation
+//   number, and a handle whose generation doesn't match its voice's just does nothing
+// - a default-constructed handle (or one from a play() that found no voice) is already stopped
 struct PlayingSample {
-	//change the panning or volume of a playing sample (and do proper locking);
+	//change the panning or volume of a playing sample;
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
 	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
@@ -59,70 +77,111 @@ struct PlayingSample {
 	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
 	//set the half-volume radius (use only on "3D" playing sounds):
 	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f);
+	//set the playback rate (1.0 == normal; 2.0 == twice as fast and an octave higher), e.g., for pitch variation or Doppler;
+	// the mixer resamples (with a windowed-sinc filter) as needed. Streams always play at 1.0:
+	void set_rate(float new_rate, float ramp = 1.0f / 60.0f);
 
-	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
+	//'stop' will fade sample out over 'ramp' seconds and then release its voice:
 	void stop(float ramp = 1.0f / 60.0f);
 
+	//was playback stopped (by running out of sample, by stop(), or by having its voice stolen)?
+	// (the audio callback reports finished voices asynchronously, so this may lag by a block)
+	bool stopped() const;
+
+	//internals:
+	uint32_t voice = -1U; //index in the voice pool
+	uint32_t generation = 0; //which use of that voice this handle refers to
+};
+
+//Stream objects play long '.opus' files (e.g., music) without decoding them up front:
+// the file stays open, and a background thread decodes about 'buffer_ms' ahead of playback.
+//A stream plays on one voice at a time (playing it again after that playback stops starts over
+// from the beginning), and must not be destroyed while it is playing.
+//If its voice is stolen, the audio callback keeps reading it until it starts the stealing sample,
+// so playing it again is refused (with a warning) until then -- at most a block later.
+struct Stream {
+	Stream(std::string const &filename, float buffer_ms = 500.0f);
+	~Stream();
+
 	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopping = false; //is playing stopping?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-
-	//2D playback panning control: ('NaN' if sound played in 3D mode)
-	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
-
-	//3D playback panning control: ('NaN' if sound played in 2D mode)
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
-	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	std::unique_ptr< OpusStream > opus;
+	bool played = false; //has the stream been played before (so needs to rewind)?
+	PlayingSample playing; //most recent playback
 };
 
 // ------- global functions -------
 
-void init(); //call Sound::init() from main.cpp before using any member functions
+//call Sound::init() from main.cpp before using any member functions;
+// at most 'max_voices' samples play at once (voice storage is allocated here, once):
+void init(uint32_t max_voices = 64);
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
+//call Sound::update() once per frame (main.cpp does): queues commands that didn't fit in the
+// audio callback's command ring earlier (otherwise they wait for the next play/set/stop call)
+// and frees voices that finished playing:
+void update();
+
+//Offline rendering (for benchmarks, regression checks, and capturing audio on machines without an audio device):
+// init_offline() sets up voices like init() but opens no device; render() then runs the mixer on the calling
+// thread, appending 'blocks' blocks of BlockFrames interleaved stereo frames (at OutputRate) to 'out':
+constexpr uint32_t OutputRate = 48000;
+constexpr uint32_t BlockFrames = 1024;
+void init_offline(uint32_t max_voices = 64);
+void render(uint32_t blocks, std::vector< float > *out);
+//render 'blocks' blocks and save them as a (stereo, 32-bit float) WAV file:
+void render_wav(std::string const &filename, uint32_t blocks);
+
+//When every voice is busy, play()/loop() steal one. Only voices playing at the same or lower
+// 'priority' than the new sample are candidates (if there are none, the new sample doesn't play);
+// among those, the policy picks:
+enum class StealPolicy {
+	LowestPriority, //the lowest-priority voice (oldest among equals)
+	Quietest, //the voice with the lowest current volume
+	Oldest, //the voice that started playing longest ago
+};
+void set_steal_policy(StealPolicy policy);
+
 //Call 'Sound::play' to play a sample once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
-std::shared_ptr< PlayingSample > play(
+PlayingSample play(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	int32_t priority = 0
 );
 //The play_3D version will play a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > play_3D(
+PlayingSample play_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	int32_t priority = 0
 );
 
 //Call 'Sound::loop' to play a sample ~forever~.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback.
-std::shared_ptr< PlayingSample > loop(
+PlayingSample loop(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	int32_t priority = 0
 );
 //The loop_3D version will loop a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > loop_3D(
+PlayingSample loop_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	int32_t priority = 0
 );
 
+//Streams play the same way as samples:
+PlayingSample play(Stream &stream, float volume = 1.0f, float pan = 0.0f, int32_t priority = 0);
+PlayingSample play_3D(Stream &stream, float volume, glm::vec3 const &position, float half_volume_radius = std::numeric_limits< float >::infinity(), int32_t priority = 0);
+PlayingSample loop(Stream &stream, float volume = 1.0f, float pan = 0.0f, int32_t priority = 0);
+PlayingSample loop_3D(Stream &stream, float volume, glm::vec3 const &position, float half_volume_radius = std::numeric_limits< float >::infinity(), int32_t priority = 0);
+
 //Listener controls the panning of "3D" samples (ones played using the "position" version of the play functions):
 struct Listener {
 	void set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
@@ -141,8 +200,8 @@ void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly:
+// the set_*/stop/play/... functions don't need these (they queue commands instead), so you shouldn't need
+// to call them unless your code is modifying 'volume' or 'listener' directly:
 void lock();
 void unlock();
 
@@ -0,0 +1,66 @@
+#include "Story.hpp"
+#include "read_write_chunk.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+Story::Story(std::string const &filename) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open story file '" + filename + "'.");
+	}
+
+	read_chunk(file, "str0", &strings);
+	read_chunk(file, "sta0", &states);
+	read_chunk(file, "edg0", &choices);
+
+	if (file.peek() != EOF) {
+		std::cerr << "WARNING: trailing data in story file '" << filename << "'" << std::endl;
+	}
+
+	if (states.empty()) {
+		throw std::runtime_error("story file '" + filename + "' contains no states.");
+	}
+
+	//the compiler has already checked the graph; this just makes sure indices are in-range:
+	for (auto const &s : states) {
+		if (!(s.name_begin <= s.name_end && s.name_end <= strings.size())
+		 || !(s.text_begin <= s.text_end && s.text_end <= strings.size())) {
+			throw std::runtime_error("story file '" + filename + "' contains state with invalid string indices");
+		}
+		if (!(s.choice_begin <= s.choice_end && s.choice_end <= choices.size())) {
+			throw std::runtime_error("story file '" + filename + "' contains state with invalid choice indices");
+		}
+	}
+	for (auto const &c : choices) {
+		if (!(c.label_begin <= c.label_end && c.label_end <= strings.size())) {
+			throw std::runtime_error("story file '" + filename + "' contains choice with invalid string indices");
+		}
+		if (c.target >= states.size()) {
+			throw std::runtime_error("story file '" + filename + "' contains choice with invalid target (" + std::to_string(c.target) + ")");
+		}
+	}
+}
+
+std::string_view Story::name(uint32_t state) const {
+	State const &s = states[state];
+	return std::string_view(strings.data() + s.name_begin, s.name_end - s.name_begin);
+}
+
+std::string_view Story::text(uint32_t state) const {
+	State const &s = states[state];
+	return std::string_view(strings.data() + s.text_begin, s.text_end - s.text_begin);
+}
+
+std::string_view Story::label(Choice const &choice) const {
+	return std::string_view(strings.data() + choice.label_begin, choice.label_end - choice.label_begin);
+}
+
+Story::Choice const *Story::choice(uint32_t state, uint32_t key) const {
+	State const &s = states[state];
+	for (uint32_t c = s.choice_begin; c < s.choice_end; ++c) {
+		if (choices[c].key == key) return &choices[c];
+	}
+	return nullptr;
+}
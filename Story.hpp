@@ -0,0 +1,57 @@
+#pragma once
+
+/*
+ * A Story is a branching narrative graph: a list of states, each with some
+ * text and up to a few numbered choices that lead to other states.
+ *
+ * Stories are written as JSON (see dist/story.json) and compiled ahead of time
+ * by the 'compile-story' tool into a chunked binary file:
+ *
+ *   str0: all strings (state names, texts, choice labels), concatenated
+ *   sta0: State entries (state 0 is always the "start" state)
+ *   edg0: Choice entries, grouped by state
+ *
+ * All targets are validated by the compiler, so at runtime walking the graph
+ * is just array indexing.
+ *
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+struct Story {
+	//load from a compiled story file:
+	// note: will throw if file fails to read or has out-of-range indices.
+	Story(std::string const &filename);
+
+	struct State {
+		uint32_t name_begin, name_end; //range in 'strings'
+		uint32_t text_begin, text_end; //range in 'strings'
+		uint32_t choice_begin, choice_end; //range in 'choices'
+	};
+	static_assert(sizeof(State) == 24, "State is packed.");
+
+	struct Choice {
+		uint32_t key; //number the player presses to pick this choice (1, 2, ...)
+		uint32_t label_begin, label_end; //range in 'strings'
+		uint32_t target; //index of state this choice leads to
+	};
+	static_assert(sizeof(Choice) == 16, "Choice is packed.");
+
+	std::vector< char > strings;
+	std::vector< State > states;
+	std::vector< Choice > choices;
+
+	//index of the first state:
+	static constexpr uint32_t Start = 0;
+
+	//convenience accessors (no allocation):
+	std::string_view name(uint32_t state) const;
+	std::string_view text(uint32_t state) const;
+	std::string_view label(Choice const &choice) const;
+
+	//the choice in 'state' selected by pressing 'key', or nullptr if there isn't one:
+	Choice const *choice(uint32_t state, uint32_t key) const;
+};
@@ -0,0 +1,119 @@
+#include "TextLayout.hpp"
+
+#include "ColorTextureProgram.hpp"
+#include "gl_errors.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+TextLayout::TextLayout() {
+	glGenBuffers(1, &buffer);
+	glGenVertexArrays(1, &vao);
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glVertexAttribPointer(color_texture_program->Position_vec4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLbyte *)0);
+	glEnableVertexAttribArray(color_texture_program->Position_vec4);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	GL_ERRORS();
+}
+
+TextLayout::~TextLayout() {
+	glDeleteVertexArrays(1, &vao);
+	vao = 0;
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+}
+
+void TextLayout::set(std::string_view text_, glm::vec2 const &origin_, float scale_, float wrap_width_) {
+	if (text_ == text && origin_ == origin && scale_ == scale && wrap_width_ == wrap_width) return;
+	text = std::string(text_);
+	origin = origin_;
+	scale = scale_;
+	wrap_width = wrap_width_;
+	dirty = true;
+}
+
+bool TextLayout::update(ShapeCache &shapes, GlyphAtlas &atlas) {
+	if (!dirty && built_atlas == &atlas && built_generation == atlas.generation) return false;
+
+	ShapedRun const &run = shapes.get(text, scale, wrap_width);
+
+	//build quads, noting which atlas page each glyph came from:
+	std::vector< glm::vec4 > vertices;
+	std::vector< uint32_t > pages;
+	vertices.reserve(6 * run.glyphs.size());
+	pages.reserve(run.glyphs.size());
+
+	atlas.begin_batch();
+	for (auto const &g : run.glyphs) {
+		GlyphAtlas::Glyph const &ch = atlas.get(g.index);
+		if (ch.size.x <= 0 || ch.size.y <= 0) continue;
+
+		float xpos = origin.x + g.origin.x + ch.bearing.x * scale;
+		float ypos = origin.y + g.origin.y - (ch.size.y - ch.bearing.y) * scale;
+		float w = ch.size.x * scale;
+		float h = ch.size.y * scale;
+
+		glm::vec2 uv0 = ch.uv_min;
+		glm::vec2 uv1 = ch.uv_max;
+
+		vertices.emplace_back(xpos,     ypos + h, uv0.x, uv0.y);
+		vertices.emplace_back(xpos,     ypos,     uv0.x, uv1.y);
+		vertices.emplace_back(xpos + w, ypos,     uv1.x, uv1.y);
+
+		vertices.emplace_back(xpos,     ypos + h, uv0.x, uv0.y);
+		vertices.emplace_back(xpos + w, ypos,     uv1.x, uv1.y);
+		vertices.emplace_back(xpos + w, ypos + h, uv1.x, uv0.y);
+
+		pages.emplace_back(ch.page);
+	}
+
+	//group quads by page so that each page is one contiguous draw:
+	std::vector< glm::vec4 > sorted;
+	sorted.reserve(vertices.size());
+	runs.clear();
+	for (uint32_t page = 0; page < atlas.page_count(); ++page) {
+		GLint first = GLint(sorted.size());
+		for (size_t q = 0; q < pages.size(); ++q) {
+			if (pages[q] != page) continue;
+			sorted.insert(sorted.end(), vertices.begin() + 6 * q, vertices.begin() + 6 * (q + 1));
+		}
+		if (GLint(sorted.size()) != first) {
+			runs.emplace_back();
+			runs.back().texture = atlas.page_texture(page);
+			runs.back().first = first;
+			runs.back().count = GLsizei(sorted.size()) - first;
+		}
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, sorted.size() * sizeof(glm::vec4), sorted.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	GL_ERRORS();
+
+	dirty = false;
+	built_atlas = &atlas;
+	built_generation = atlas.generation;
+	return true;
+}
+
+void TextLayout::draw(glm::mat4 const &object_to_clip, glm::vec3 const &color) const {
+	if (runs.empty()) return;
+
+	glUseProgram(color_texture_program->program);
+	glUniform3f(color_texture_program->Color_vec3, color.x, color.y, color.z);
+	glUniformMatrix4fv(color_texture_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(vao);
+	for (auto const &run : runs) {
+		glBindTexture(GL_TEXTURE_2D, run.texture);
+		glDrawArrays(GL_TRIANGLES, run.first, run.count);
+	}
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+}
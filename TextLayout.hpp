@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+ * A TextLayout is a retained-mode block of text: it keeps its glyph quads in
+ * its own vertex buffer, so drawing is just a bind and a draw call.
+ *
+ * Call set() whenever the text or layout parameters might have changed (it
+ * only marks the layout dirty if something actually differs), then update()
+ * to rebuild if needed (or if the glyph atlas evicted glyphs since the last
+ * build), then draw().
+ *
+ */
+
+#include "GL.hpp"
+#include "GlyphAtlas.hpp"
+#include "ShapeCache.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct TextLayout {
+	TextLayout();
+	~TextLayout();
+
+	//layout owns GL objects, so copying is not allowed:
+	TextLayout(TextLayout const &) = delete;
+	TextLayout &operator=(TextLayout const &) = delete;
+
+	//set text and placement; 'origin' is the pen position at the start of the first line (pixels):
+	void set(std::string_view text, glm::vec2 const &origin, float scale, float wrap_width);
+
+	//rebuild the vertex buffer if text/placement changed or atlas contents moved:
+	// returns 'true' if a rebuild happened.
+	bool update(ShapeCache &shapes, GlyphAtlas &atlas);
+
+	//draw with color_texture_program:
+	void draw(glm::mat4 const &object_to_clip, glm::vec3 const &color) const;
+
+	//----- current parameters -----
+	std::string text;
+	glm::vec2 origin = glm::vec2(0.0f);
+	float scale = 1.0f;
+	float wrap_width = 0.0f;
+
+	//-- internals --
+	bool dirty = true;
+	GlyphAtlas const *built_atlas = nullptr; //atlas used for last build
+	uint32_t built_generation = 0; //atlas generation at last build
+
+	GLuint buffer = 0; //holds (x, y, u, v) for six vertices per glyph
+	GLuint vao = 0;
+
+	//one draw per atlas page referenced by the text (almost always just one):
+	struct Run {
+		GLuint texture = 0;
+		GLint first = 0;
+		GLsizei count = 0;
+	};
+	std::vector< Run > runs;
+};
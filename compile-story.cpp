@@ -0,0 +1,146 @@
+//compile-story converts a JSON story (see dist/story.json) into the binary
+// format read by Story (see Story.hpp), checking the graph along the way.
+//
+//JSON format:
+// {
+//   "state_name": {
+//     "text": "What the player reads in this state.",
+//     "choice1": [ "Label for choice 1.", "target_state" ],
+//     "choice2": [ "none", "none" ] //<-- "none" label means no choice
+//   },
+//   ...
+// }
+// A state named "start" is required; it becomes state 0.
+
+#include "Story.hpp"
+#include "read_write_chunk.hpp"
+
+#include "json.hpp"
+using JSON = nlohmann::json;
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <map>
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.json> <out.graph>" << std::endl;
+		return 1;
+	}
+	std::string in_file = argv[1];
+	std::string out_file = argv[2];
+
+	try {
+		JSON json;
+		{
+			std::ifstream in(in_file);
+			if (!in) throw std::runtime_error("Failed to open '" + in_file + "'.");
+			in >> json;
+		}
+		if (!json.is_object()) throw std::runtime_error("Expecting '" + in_file + "' to contain an object of states.");
+		if (!json.contains("start")) throw std::runtime_error("Story has no \"start\" state.");
+
+		//assign state indices ("start" first, then in file order -- which nlohmann::json sorts by name):
+		std::vector< std::string > names;
+		std::map< std::string, uint32_t > index;
+		names.emplace_back("start");
+		for (auto const &item : json.items()) {
+			if (item.key() != "start") names.emplace_back(item.key());
+		}
+		for (uint32_t i = 0; i < names.size(); ++i) {
+			index.emplace(names[i], i);
+		}
+
+		std::vector< char > strings;
+		auto add_string = [&strings](std::string const &str, uint32_t *begin, uint32_t *end) {
+			*begin = uint32_t(strings.size());
+			strings.insert(strings.end(), str.begin(), str.end());
+			*end = uint32_t(strings.size());
+		};
+
+		std::vector< Story::State > states;
+		std::vector< Story::Choice > choices;
+		uint32_t errors = 0;
+
+		for (uint32_t i = 0; i < names.size(); ++i) {
+			std::string const &name = names[i];
+			JSON const &entry = json.at(name);
+			auto error = [&](std::string const &message) {
+				std::cerr << "ERROR: state \"" << name << "\": " << message << std::endl;
+				errors += 1;
+			};
+
+			states.emplace_back();
+			Story::State &state = states.back();
+			add_string(name, &state.name_begin, &state.name_end);
+
+			if (!entry.is_object() || !entry.contains("text") || !entry["text"].is_string()) {
+				error("missing \"text\" string.");
+				state.text_begin = state.text_end = 0;
+			} else {
+				add_string(entry["text"].get< std::string >(), &state.text_begin, &state.text_end);
+			}
+
+			state.choice_begin = uint32_t(choices.size());
+			for (uint32_t key = 1; entry.is_object() && entry.contains("choice" + std::to_string(key)); ++key) {
+				JSON const &c = entry["choice" + std::to_string(key)];
+				if (!c.is_array() || c.size() != 2 || !c[0].is_string() || !c[1].is_string()) {
+					error("\"choice" + std::to_string(key) + "\" should be [ \"label\", \"target\" ].");
+					continue;
+				}
+				std::string label = c[0].get< std::string >();
+				std::string target = c[1].get< std::string >();
+				if (label == "none") continue; //no choice here
+
+				auto f = index.find(target);
+				if (f == index.end()) {
+					error("choice" + std::to_string(key) + " leads to nonexistent state \"" + target + "\".");
+					continue;
+				}
+
+				choices.emplace_back();
+				Story::Choice &choice = choices.back();
+				choice.key = key;
+				add_string(label, &choice.label_begin, &choice.label_end);
+				choice.target = f->second;
+			}
+			state.choice_end = uint32_t(choices.size());
+		}
+
+		if (errors) {
+			throw std::runtime_error(std::to_string(errors) + " error(s) in '" + in_file + "'; not writing output.");
+		}
+
+		{ //warn about states that can never be reached:
+			std::vector< bool > reached(states.size(), false);
+			std::vector< uint32_t > todo(1, Story::Start);
+			reached[Story::Start] = true;
+			while (!todo.empty()) {
+				uint32_t s = todo.back();
+				todo.pop_back();
+				for (uint32_t c = states[s].choice_begin; c < states[s].choice_end; ++c) {
+					if (!reached[choices[c].target]) {
+						reached[choices[c].target] = true;
+						todo.emplace_back(choices[c].target);
+					}
+				}
+			}
+			for (uint32_t s = 0; s < states.size(); ++s) {
+				if (!reached[s]) std::cerr << "WARNING: state \"" << names[s] << "\" is unreachable from \"start\"." << std::endl;
+			}
+		}
+
+		std::ofstream out(out_file, std::ios::binary);
+		write_chunk("str0", strings, &out);
+		write_chunk("sta0", states, &out);
+		write_chunk("edg0", choices, &out);
+		if (!out) throw std::runtime_error("Failed to write '" + out_file + "'.");
+
+		std::cout << "Wrote " << states.size() << " states and " << choices.size() << " choices (" << strings.size() << " bytes of text) to '" << out_file << "'." << std::endl;
+	} catch (std::exception const &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -1,53 +1,148 @@
 #include "load_opus.hpp"
+#include "mix_kernels.hpp"
 
 #include <opusfile.h>
 
+#include <algorithm>
 #include <cassert>
+#include <exception>
 #include <memory>
 #include <cmath>
 #include <stdexcept>
 #include <iostream>
+#include <thread>
 
-void load_opus(std::string const &filename, std::vector< float > *data_) {
-	assert(data_);
-	auto &data = *data_;
-	data.clear();
+//files are only split into segments at least this long (5 seconds), since each segment
+// pays for opening the file, seeking, and decoder pre-roll:
+constexpr uint64_t const MinSegmentSamples = 5 * 48000;
 
-	std::cout << "loading '" << filename << "'..."; std::cout.flush();
+//samples decoded per op_read_float_stereo call (seems like reads are generally 960 samples, so this is plenty):
+constexpr uint32_t const ReadSamples = 48000;
+
+typedef std::unique_ptr< OggOpusFile, decltype(&op_free) > OpusFilePtr;
 
-	//will hold opusfile * int a std::unique_ptr so that it will automatically be deleted:
+static OpusFilePtr open_opus(std::string const &filename) {
 	int err = 0;
-	std::unique_ptr< OggOpusFile, decltype(&op_free) > op(
+	OpusFilePtr op(
 		op_open_file(filename.c_str(), &err), //pointer to hold
 		op_free //deletion function
 	);
 	if (err != 0) {
 		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
 	}
+	return op;
+}
+
+//decode up to 'count' samples from the current position of 'op' into 'out', downmixing to mono;
+// returns the number decoded (less than 'count' only if the file ended):
+static uint64_t decode_segment(OggOpusFile *op, std::string const &filename, float *out, uint64_t count) {
+	MixKernel const &kernel = mix_kernel();
+	std::vector< float > pcm(2 * ReadSamples);
+	uint64_t done = 0;
+	while (done < count) {
+		int want = int(std::min< uint64_t >(count - done, ReadSamples));
+		int ret = op_read_float_stereo(op, pcm.data(), 2 * want);
+		if (ret < 0) {
+			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+		}
+		if (ret == 0) break;
+		kernel.downmix_stereo_to_mono(pcm.data(), uint32_t(ret), out + done);
+		done += uint32_t(ret);
+	}
+	return done;
+}
+
+//decode the whole file, from the current position of 'op', onto the end of 'data':
+static void decode_rest(OggOpusFile *op, std::string const &filename, std::vector< float > *data_) {
+	auto &data = *data_;
+	for (;;) {
+		size_t at = data.size();
+		data.resize(at + ReadSamples);
+		uint64_t got = decode_segment(op, filename, data.data() + at, ReadSamples);
+		data.resize(at + got);
+		if (got < ReadSamples) break;
+	}
+}
+
+void load_opus(std::string const &filename, std::vector< float > *data_, uint32_t threads) {
+	assert(data_);
+	auto &data = *data_;
+	data.clear();
+
+	std::cout << "loading '" << filename << "'..."; std::cout.flush();
+
+	OpusFilePtr op = open_opus(filename);
 
 	//get length in samples:
 	ogg_int64_t length = op_pcm_total(op.get(), -1);
-	if (length >= 0) {
-		data.reserve(length);
-	} else {
+	if (length < 0) {
 		std::cerr << "WARNING: cannot estimate length of '" << filename << "', loading may be slow." << std::endl;
-		length = 0;
-		data.reserve(2*48000);
+		decode_rest(op.get(), filename, &data);
+		std::cout << " done." << std::endl;
+		return;
 	}
 
-	std::vector< float > pcm(2*48000*2, 0.0f); //seems like reads are generally 960 samples so this is definitely overkill
-	for (;;) {
-		int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
-		if (ret >= 0) {
-			//positive return values are the number of samples read per channel; copy into data:
-			data.reserve(data.size() + ret);
-			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
-				data.emplace_back((pcm[2*i] + pcm[2*i+1]) * 0.5f); //downmix to mono by averaging
+	if (threads == 0) threads = std::max(1U, std::thread::hardware_concurrency());
+	uint32_t segments = uint32_t(std::max< uint64_t >(1, std::min< uint64_t >(threads, uint64_t(length) / MinSegmentSamples)));
+
+	data.resize(size_t(length));
+
+	if (segments > 1) {
+		//decode evenly spaced segments in parallel, each with its own OggOpusFile (they aren't thread-safe),
+		// straight into their part of 'data':
+		auto begin = [&](uint32_t s) { return uint64_t(length) * s / segments; };
+		std::vector< std::exception_ptr > errors(segments);
+		std::vector< uint64_t > decoded(segments, 0);
+		auto decode = [&](uint32_t s) {
+			try {
+				OpusFilePtr segment_op(nullptr, op_free);
+				OggOpusFile *at = op.get();
+				if (s != 0) {
+					segment_op = open_opus(filename);
+					at = segment_op.get();
+					int ret = op_pcm_seek(at, ogg_int64_t(begin(s)));
+					if (ret != 0) {
+						throw std::runtime_error("opusfile error " + std::to_string(ret) + " seeking in \"" + filename + "\".");
+					}
+				}
+				decoded[s] = decode_segment(at, filename, data.data() + begin(s), begin(s+1) - begin(s));
+			} catch (...) {
+				errors[s] = std::current_exception();
 			}
-			if (ret == 0) break;
-		} else {
-			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+		};
+		std::vector< std::thread > workers;
+		workers.reserve(segments - 1);
+		for (uint32_t s = 1; s < segments; ++s) {
+			workers.emplace_back(decode, s);
 		}
+		decode(0);
+		for (auto &worker : workers) {
+			worker.join();
+		}
+		for (auto const &error : errors) {
+			if (error) std::rethrow_exception(error);
+		}
+
+		bool complete = true;
+		for (uint32_t s = 0; s < segments; ++s) {
+			if (decoded[s] != begin(s+1) - begin(s)) complete = false;
+		}
+		if (complete) {
+			std::cout << " done (" << segments << " segments)." << std::endl;
+			return;
+		}
+		//(op_pcm_total() should be exact, so this shouldn't happen)
+		std::cerr << "WARNING: '" << filename << "' ended before its reported length; decoding it again serially." << std::endl;
+		int ret = op_pcm_seek(op.get(), 0);
+		if (ret != 0) {
+			throw std::runtime_error("opusfile error " + std::to_string(ret) + " seeking in \"" + filename + "\".");
+		}
+	}
+
+	//serial decode:
+	data.resize(decode_segment(op.get(), filename, data.data(), data.size()));
+	if (data.size() == size_t(length)) {
+		decode_rest(op.get(), filename, &data); //(anything past the reported length)
 	}
 
 	std::cout << " done." << std::endl;
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
-//Load an opus file as 48kHz floating-point mono; throws on error:
-void load_opus(std::string const &filename, std::vector< float > *data);
+//Load an opus file as 48kHz floating-point mono; throws on error.
+// Long files are decoded in parallel: up to 'threads' workers (0 == one per core) each seek to
+// an evenly spaced offset and decode their own segment. ('threads' == 1 decodes serially.)
+void load_opus(std::string const &filename, std::vector< float > *data, uint32_t threads = 0);
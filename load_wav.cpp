@@ -3,12 +3,14 @@
 #include <SDL.h>
 
 #include <iostream>
+#include <fstream>
 #include <cassert>
 #include <algorithm>
+#include <cstring>
 
 constexpr uint32_t AUDIO_RATE = 48000;
 
-void load_wav(std::string const &filename, std::vector< float > *data_) {
+void load_wav(std::string const &filename, std::vector< float > *data_, uint32_t *rate) {
 	assert(data_);
 	auto &data = *data_;
 
@@ -21,11 +23,18 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 		throw std::runtime_error("Failed to load WAV file '" + filename + "'; SDL says \"" + std::string(SDL_GetError()) + "\"");
 	}
 
+	//keep the file's rate if the caller can deal with it (e.g., Sound's mixer resamples on the fly):
+	int freq = AUDIO_RATE;
+	if (rate) {
+		*rate = uint32_t(have->freq);
+		freq = have->freq;
+	}
+
 	//based on the SDL_AudioCVT example in the docs: https://wiki.libsdl.org/SDL_AudioCVT
 	SDL_AudioCVT cvt;
-	SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, 1, AUDIO_RATE);
+	SDL_BuildAudioCVT(&cvt, have->format, have->channels, have->freq, AUDIO_F32SYS, 1, freq);
 	if (cvt.needed) {
-		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(AUDIO_RATE) + " Hz, float32, mono; converting." << std::endl;
+		std::cout << "WAV file '" + filename + "' didn't load as " + std::to_string(freq) + " Hz, float32, mono; converting." << std::endl;
 		cvt.len = audio_len;
 		cvt.buf = (Uint8 *)SDL_malloc(cvt.len * cvt.len_mult);
 		SDL_memcpy(cvt.buf, audio_buf, audio_len);
@@ -48,3 +57,44 @@ void load_wav(std::string const &filename, std::vector< float > *data_) {
 	}
 	std::cout << "Range: " << min << ", " << max << std::endl;
 }
+
+void save_wav(std::string const &filename, std::vector< float > const &data, uint32_t rate, uint32_t channels) {
+	assert(channels > 0 && data.size() % channels == 0);
+
+	//WAV is little-endian; write fields byte-by-byte so this works everywhere:
+	std::vector< uint8_t > bytes;
+	auto u16 = [&bytes](uint16_t v) {
+		bytes.emplace_back(uint8_t(v & 0xff));
+		bytes.emplace_back(uint8_t(v >> 8));
+	};
+	auto u32 = [&bytes](uint32_t v) {
+		for (uint32_t i = 0; i < 4; ++i) bytes.emplace_back(uint8_t((v >> (8 * i)) & 0xff));
+	};
+	auto tag = [&bytes](char const *t) {
+		bytes.insert(bytes.end(), t, t + 4);
+	};
+
+	uint32_t data_bytes = uint32_t(data.size() * 4);
+	bytes.reserve(44 + data_bytes);
+	tag("RIFF"); u32(36 + data_bytes); tag("WAVE");
+	tag("fmt "); u32(16);
+	u16(3); //format: IEEE float
+	u16(uint16_t(channels));
+	u32(rate);
+	u32(rate * channels * 4); //bytes per second
+	u16(uint16_t(channels * 4)); //bytes per frame
+	u16(32); //bits per sample
+	tag("data"); u32(data_bytes);
+	for (float f : data) {
+		uint32_t v;
+		static_assert(sizeof(v) == sizeof(f), "float is 32 bits");
+		std::memcpy(&v, &f, sizeof(v));
+		u32(v);
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	file.write(reinterpret_cast< char const * >(bytes.data()), bytes.size());
+	if (!file) {
+		throw std::runtime_error("Failed to write WAV file '" + filename + "'.");
+	}
+}
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
-//Load a WAV file as 48kHz floating-point mono; throws on error:
-void load_wav(std::string const &filename, std::vector< float > *data);
+//Load a WAV file as floating-point mono; throws on error.
+// Resamples to 48kHz unless 'rate' is given, in which case the file's own rate is kept and stored there:
+void load_wav(std::string const &filename, std::vector< float > *data, uint32_t *rate = nullptr);
+
+//Save interleaved floating-point audio (e.g., stereo from Sound::render()) as a 32-bit float WAV file; throws on error:
+void save_wav(std::string const &filename, std::vector< float > const &data, uint32_t rate, uint32_t channels);
@@ -9,6 +9,7 @@
 
 //For sound init:
 #include "Sound.hpp"
+#include "SampleCache.hpp"
 
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
@@ -110,6 +111,7 @@ int main(int argc, char **argv) {
 
 	//------------ load assets --------------
 	call_load_functions();
+	std::cout << "Sample data resident: " << (SampleCache::resident_bytes() / 1024) << " KiB." << std::endl;
 
 	//------------ create game mode + make current --------------
 	Mode::set_current(std::make_shared< PlayMode >());
@@ -180,6 +182,9 @@ int main(int argc, char **argv) {
 
 			Mode::current->update(elapsed);
 			if (!Mode::current) break;
+
+			//pass along any sound commands still waiting from this frame:
+			Sound::update();
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
@@ -0,0 +1,61 @@
+#pragma once
+
+//Mesh files may end with a 'hsh0' chunk: a hash table over mesh names, so that
+// MeshBuffer can look meshes up without building a map (or any std::string) at load time.
+//
+//The table is a power-of-two number of uint32_t slots (at least twice the number of meshes);
+// each slot is 0 (empty) or 1 + the position of a mesh in the file's index chunk.
+// A name's probe sequence starts at slot mesh_name_hash(name) & (slots - 1) and steps linearly.
+//
+//(used by MeshBuffer to read tables and by the mesh utilities to write them)
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+//FNV-1a hash of a mesh name:
+inline uint32_t mesh_name_hash(std::string_view name) {
+	uint32_t h = 0x811c9dc5;
+	for (char c : name) {
+		h = (h ^ uint8_t(c)) * 0x01000193;
+	}
+	return h;
+}
+
+//position of 'name' in the table's meshes, or -1U if not present:
+// 'name_of(i)' gives the name of mesh i.
+template< typename NameOf >
+uint32_t find_in_mesh_name_table(std::vector< uint32_t > const &table, std::string_view name, NameOf const &name_of) {
+	if (table.empty()) return -1U;
+	uint32_t mask = uint32_t(table.size()) - 1;
+	for (uint32_t slot = mesh_name_hash(name) & mask; table[slot] != 0; slot = (slot + 1) & mask) {
+		if (name_of(table[slot] - 1) == name) return table[slot] - 1;
+	}
+	return -1U;
+}
+
+//build a table over 'count' meshes named by 'name_of(i)':
+// (meshes whose names repeat an earlier mesh's name are left out and, if 'duplicates' is given, listed there)
+template< typename NameOf >
+std::vector< uint32_t > make_mesh_name_table(uint32_t count, NameOf const &name_of, std::vector< uint32_t > *duplicates = nullptr) {
+	uint32_t slots = 1;
+	while (slots < 2 * count) slots *= 2;
+	std::vector< uint32_t > table(slots, 0);
+	for (uint32_t i = 0; i < count; ++i) {
+		std::string_view name = name_of(i);
+		uint32_t slot = mesh_name_hash(name) & (slots - 1);
+		bool duplicate = false;
+		for (; table[slot] != 0; slot = (slot + 1) & (slots - 1)) {
+			if (name_of(table[slot] - 1) == name) {
+				duplicate = true;
+				break;
+			}
+		}
+		if (duplicate) {
+			if (duplicates) duplicates->emplace_back(i);
+		} else {
+			table[slot] = i + 1;
+		}
+	}
+	return table;
+}
@@ -0,0 +1,165 @@
+//mix-kernels-bench times the mixer's inner loops (see mix_kernels.hpp).
+//
+//Usage:
+//	mix-kernels-bench [voices] [iterations]
+//
+//Each iteration mixes 'voices' (default 256) one-second samples, each with its own
+// pan ramp, into one 1024-frame stereo block, the way Sound's mix_audio does.
+// Every kernel's output is also compared against the scalar kernel's,
+// as are its 16-bit version, its stereo-to-mono downmix (used when loading samples),
+// and its resampler (also timed, at a 44.1kHz-to-48kHz step).
+
+#include "mix_kernels.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	uint32_t voices = 256;
+	uint32_t iterations = 200;
+	if (argc > 1) voices = std::max(1U, uint32_t(std::stoul(argv[1])));
+	if (argc > 2) iterations = std::max(1U, uint32_t(std::stoul(argv[2])));
+
+	const uint32_t Frames = 1024; //same as Sound's MIX_SAMPLES
+	const uint32_t SampleLength = 48000;
+
+	//random sample data, start offsets, and pan ramps:
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+	std::vector< std::vector< float > > samples(voices);
+	std::vector< uint32_t > offsets(voices);
+	struct Gains { float left, right, left_step, right_step; };
+	std::vector< Gains > gains(voices);
+	for (uint32_t v = 0; v < voices; ++v) {
+		samples[v].resize(SampleLength);
+		for (float &s : samples[v]) s = unit(mt);
+		//(arbitrary offsets, so loads are unaligned, as they usually are in the mixer)
+		offsets[v] = uint32_t(mt() % (SampleLength - Frames));
+		gains[v].left = 0.5f + 0.5f * unit(mt);
+		gains[v].right = 0.5f + 0.5f * unit(mt);
+		gains[v].left_step = 1e-4f * unit(mt);
+		gains[v].right_step = 1e-4f * unit(mt);
+	}
+
+	auto mix_block = [&](MixKernel const &kernel, std::vector< float > &out) {
+		std::fill(out.begin(), out.end(), 0.0f);
+		for (uint32_t v = 0; v < voices; ++v) {
+			Gains const &g = gains[v];
+			kernel.mix_mono_to_stereo(samples[v].data() + offsets[v], Frames, g.left, g.right, g.left_step, g.right_step, out.data());
+		}
+	};
+
+	std::vector< float > reference(2 * Frames);
+	mix_block(mix_kernels()[0], reference);
+
+	std::cout << "Mixing " << voices << " voices into " << Frames << "-frame blocks (" << iterations << " iterations):" << std::endl;
+	for (MixKernel const &kernel : mix_kernels()) {
+		std::vector< float > out(2 * Frames);
+
+		//check against scalar:
+		mix_block(kernel, out);
+		float max_error = 0.0f;
+		for (uint32_t i = 0; i < out.size(); ++i) {
+			max_error = std::max(max_error, std::abs(out[i] - reference[i]));
+		}
+
+		std::vector< double > times;
+		times.reserve(iterations);
+		for (uint32_t i = 0; i < iterations; ++i) {
+			auto before = std::chrono::high_resolution_clock::now();
+			mix_block(kernel, out);
+			auto after = std::chrono::high_resolution_clock::now();
+			times.emplace_back(std::chrono::duration< double >(after - before).count());
+		}
+		std::sort(times.begin(), times.end());
+		double median = times[times.size() / 2];
+		std::cout << "  " << kernel.name << ": "
+			<< (median * 1e9 / double(voices * Frames)) << " ns per voice-frame ("
+			<< (median * 1e3) << " ms per block median, " << (times[0] * 1e3) << " ms best); "
+			<< "max difference from scalar " << max_error << (kernel.mix_mono_to_stereo == mix_kernel().mix_mono_to_stereo ? " [used by mixer]" : "")
+			<< std::endl;
+		if (!(max_error < 1e-3f)) {
+			std::cerr << "ERROR: kernel '" << kernel.name << "' doesn't match scalar kernel." << std::endl;
+			return 1;
+		}
+
+		//16-bit version should match the float version on the same samples:
+		{
+			std::vector< int16_t > words(Frames);
+			std::vector< float > floats(Frames);
+			for (uint32_t i = 0; i < Frames; ++i) {
+				words[i] = int16_t(samples[0][i] * 32767.0f);
+				floats[i] = float(words[i]) / 32768.0f;
+			}
+			std::vector< float > from_words(2 * Frames, 0.0f), from_floats(2 * Frames, 0.0f);
+			Gains const &g = gains[0];
+			kernel.mix_int16_mono_to_stereo(words.data(), Frames - 3, g.left, g.right, g.left_step, g.right_step, from_words.data()); //(with leftovers)
+			mix_kernels()[0].mix_mono_to_stereo(floats.data(), Frames - 3, g.left, g.right, g.left_step, g.right_step, from_floats.data());
+			float max_int16_error = 0.0f;
+			for (uint32_t i = 0; i < from_words.size(); ++i) {
+				max_int16_error = std::max(max_int16_error, std::abs(from_words[i] - from_floats[i]));
+			}
+			if (!(max_int16_error < 1e-5f)) {
+				std::cerr << "ERROR: kernel '" << kernel.name << "' 16-bit mix doesn't match scalar kernel (" << max_int16_error << ")." << std::endl;
+				return 1;
+			}
+		}
+
+		//downmix should match exactly (it's the same arithmetic in every version):
+		std::vector< float > mono(2 * Frames, 0.0f), mono_reference(2 * Frames, 0.0f);
+		mix_kernels()[0].downmix_stereo_to_mono(reference.data(), Frames, mono_reference.data());
+		kernel.downmix_stereo_to_mono(reference.data(), Frames, mono.data());
+		kernel.downmix_stereo_to_mono(reference.data() + 2, Frames - 3, mono.data() + Frames); //(unaligned, with leftovers)
+		mix_kernels()[0].downmix_stereo_to_mono(reference.data() + 2, Frames - 3, mono_reference.data() + Frames);
+		if (mono != mono_reference) {
+			std::cerr << "ERROR: kernel '" << kernel.name << "' downmix doesn't match scalar kernel." << std::endl;
+			return 1;
+		}
+
+		//resampler should match scalar, for steps that use each filter table:
+		for (float step_ratio : { 44100.0f / 48000.0f, 1.37f, 2.0f, 3.9f, 7.5f }) {
+			uint64_t step = uint64_t(double(step_ratio) * 4294967296.0);
+			float const *table = resample_table(step_ratio);
+			uint32_t const Count = Frames - 3; //(with leftovers)
+			uint32_t frac = uint32_t(mt());
+			std::vector< float > resampled(Count), resampled_reference(Count);
+			//(samples[0] is long enough: SampleLength > Count * 7.5 + ResampleTaps)
+			kernel.resample(samples[0].data(), frac, step, Count, table, resampled.data());
+			mix_kernels()[0].resample(samples[0].data(), frac, step, Count, table, resampled_reference.data());
+			float max_resample_error = 0.0f;
+			for (uint32_t i = 0; i < Count; ++i) {
+				max_resample_error = std::max(max_resample_error, std::abs(resampled[i] - resampled_reference[i]));
+			}
+			if (!(max_resample_error < 1e-5f)) {
+				std::cerr << "ERROR: kernel '" << kernel.name << "' resampler doesn't match scalar kernel at step " << step_ratio << " (" << max_resample_error << ")." << std::endl;
+				return 1;
+			}
+		}
+		{
+			uint64_t step = uint64_t(44100.0 / 48000.0 * 4294967296.0);
+			float const *table = resample_table(44100.0f / 48000.0f);
+			std::vector< float > resampled(Frames);
+			std::vector< double > resample_times;
+			resample_times.reserve(iterations);
+			for (uint32_t i = 0; i < iterations; ++i) {
+				auto before = std::chrono::high_resolution_clock::now();
+				for (uint32_t v = 0; v < voices; ++v) {
+					kernel.resample(samples[v].data() + offsets[v] / 2, 0, step, Frames, table, resampled.data());
+				}
+				auto after = std::chrono::high_resolution_clock::now();
+				resample_times.emplace_back(std::chrono::duration< double >(after - before).count());
+			}
+			std::sort(resample_times.begin(), resample_times.end());
+			double resample_median = resample_times[resample_times.size() / 2];
+			std::cout << "    resample: " << (resample_median * 1e9 / double(voices * Frames)) << " ns per voice-frame ("
+				<< (resample_median * 1e3) << " ms per block median)" << std::endl;
+		}
+	}
+
+	return 0;
+}
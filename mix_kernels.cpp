@@ -0,0 +1,339 @@
+#include "mix_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+//SIMD versions are only built for x86-64 (where SSE2 is always available);
+// the AVX2 version is compiled for that target specifically and only used if the CPU reports support:
+#if defined(__x86_64__) || defined(_M_X64)
+#define MIX_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+//gains are computed as base + frame * step (rather than accumulated), so every kernel gives the same ramp:
+
+static void mix_mono_to_stereo_scalar(float const *in, uint32_t count, float left, float right, float left_step, float right_step, float *out) {
+	for (uint32_t i = 0; i < count; ++i) {
+		out[2*i+0] += in[i] * (left + float(i) * left_step);
+		out[2*i+1] += in[i] * (right + float(i) * right_step);
+	}
+}
+
+//(16-bit versions fold the 1/32768 scale into the gains)
+static void mix_int16_mono_to_stereo_scalar(int16_t const *in, uint32_t count, float left, float right, float left_step, float right_step, float *out) {
+	float const scale = 1.0f / 32768.0f;
+	left *= scale; right *= scale; left_step *= scale; right_step *= scale;
+	for (uint32_t i = 0; i < count; ++i) {
+		out[2*i+0] += float(in[i]) * (left + float(i) * left_step);
+		out[2*i+1] += float(in[i]) * (right + float(i) * right_step);
+	}
+}
+
+static void downmix_stereo_to_mono_scalar(float const *in, uint32_t count, float *out) {
+	for (uint32_t i = 0; i < count; ++i) {
+		out[i] = (in[2*i+0] + in[2*i+1]) * 0.5f;
+	}
+}
+
+static void resample_scalar(float const *in, uint32_t frac, uint64_t step, uint32_t count, float const *table, float *out) {
+	uint64_t p = frac;
+	for (uint32_t i = 0; i < count; ++i, p += step) {
+		float const *src = in + (p >> 32);
+		float const *coef = table + ((p >> 24) & 0xff) * ResampleTaps;
+		float sum = 0.0f;
+		for (uint32_t k = 0; k < ResampleTaps; ++k) {
+			sum += src[k] * coef[k];
+		}
+		out[i] = sum;
+	}
+}
+
+#ifdef MIX_KERNELS_X86
+
+//four frames at a time:
+static void mix_mono_to_stereo_sse(float const *in, uint32_t count, float left, float right, float left_step, float right_step, float *out) {
+	//gains for frames [0,1] and [2,3] of each group, as (l, r, l, r):
+	__m128 const step = _mm_setr_ps(left_step, right_step, left_step, right_step);
+	__m128 const base01 = _mm_add_ps(_mm_setr_ps(left, right, left, right), _mm_mul_ps(_mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f), step));
+	__m128 const base23 = _mm_add_ps(_mm_setr_ps(left, right, left, right), _mm_mul_ps(_mm_setr_ps(2.0f, 2.0f, 3.0f, 3.0f), step));
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 at = _mm_mul_ps(_mm_set1_ps(float(i)), step);
+		__m128 gain01 = _mm_add_ps(base01, at);
+		__m128 gain23 = _mm_add_ps(base23, at);
+
+		__m128 samples = _mm_loadu_ps(in + i); //(a0, a1, a2, a3)
+		__m128 samples01 = _mm_unpacklo_ps(samples, samples); //(a0, a0, a1, a1)
+		__m128 samples23 = _mm_unpackhi_ps(samples, samples); //(a2, a2, a3, a3)
+
+		_mm_storeu_ps(out + 2*i + 0, _mm_add_ps(_mm_loadu_ps(out + 2*i + 0), _mm_mul_ps(samples01, gain01)));
+		_mm_storeu_ps(out + 2*i + 4, _mm_add_ps(_mm_loadu_ps(out + 2*i + 4), _mm_mul_ps(samples23, gain23)));
+	}
+	//leftover frames:
+	if (i < count) {
+		mix_mono_to_stereo_scalar(in + i, count - i, left + float(i) * left_step, right + float(i) * right_step, left_step, right_step, out + 2*i);
+	}
+}
+
+//four frames at a time:
+static void mix_int16_mono_to_stereo_sse(int16_t const *in, uint32_t count, float left, float right, float left_step, float right_step, float *out) {
+	float const scale = 1.0f / 32768.0f;
+	left *= scale; right *= scale; left_step *= scale; right_step *= scale;
+
+	__m128 const step = _mm_setr_ps(left_step, right_step, left_step, right_step);
+	__m128 const base01 = _mm_add_ps(_mm_setr_ps(left, right, left, right), _mm_mul_ps(_mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f), step));
+	__m128 const base23 = _mm_add_ps(_mm_setr_ps(left, right, left, right), _mm_mul_ps(_mm_setr_ps(2.0f, 2.0f, 3.0f, 3.0f), step));
+
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 at = _mm_mul_ps(_mm_set1_ps(float(i)), step);
+		__m128 gain01 = _mm_add_ps(base01, at);
+		__m128 gain23 = _mm_add_ps(base23, at);
+
+		__m128i words = _mm_loadl_epi64(reinterpret_cast< __m128i const * >(in + i)); //(a0, a1, a2, a3) as int16
+		__m128i ints = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16); //sign-extended to int32
+		__m128 samples = _mm_cvtepi32_ps(ints);
+		__m128 samples01 = _mm_unpacklo_ps(samples, samples); //(a0, a0, a1, a1)
+		__m128 samples23 = _mm_unpackhi_ps(samples, samples); //(a2, a2, a3, a3)
+
+		_mm_storeu_ps(out + 2*i + 0, _mm_add_ps(_mm_loadu_ps(out + 2*i + 0), _mm_mul_ps(samples01, gain01)));
+		_mm_storeu_ps(out + 2*i + 4, _mm_add_ps(_mm_loadu_ps(out + 2*i + 4), _mm_mul_ps(samples23, gain23)));
+	}
+	//leftover frames:
+	if (i < count) {
+		float const unscale = 32768.0f;
+		mix_int16_mono_to_stereo_scalar(in + i, count - i, (left + float(i) * left_step) * unscale, (right + float(i) * right_step) * unscale, left_step * unscale, right_step * unscale, out + 2*i);
+	}
+}
+
+//four frames at a time:
+static void downmix_stereo_to_mono_sse(float const *in, uint32_t count, float *out) {
+	__m128 const half = _mm_set1_ps(0.5f);
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 a = _mm_loadu_ps(in + 2*i + 0); //(l0, r0, l1, r1)
+		__m128 b = _mm_loadu_ps(in + 2*i + 4); //(l2, r2, l3, r3)
+		__m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)); //(l0, l1, l2, l3)
+		__m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)); //(r0, r1, r2, r3)
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(left, right), half));
+	}
+	//leftover frames:
+	if (i < count) {
+		downmix_stereo_to_mono_scalar(in + 2*i, count - i, out + i);
+	}
+}
+
+//eight frames at a time:
+TARGET_AVX2
+static void mix_mono_to_stereo_avx2(float const *in, uint32_t count, float left, float right, float left_step, float right_step, float *out) {
+	__m256 const step = _mm256_setr_ps(left_step, right_step, left_step, right_step, left_step, right_step, left_step, right_step);
+	__m256 const lr = _mm256_setr_ps(left, right, left, right, left, right, left, right);
+	__m256 const base0 = _mm256_fmadd_ps(_mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f), step, lr);
+	__m256 const base1 = _mm256_fmadd_ps(_mm256_setr_ps(4.0f, 4.0f, 5.0f, 5.0f, 6.0f, 6.0f, 7.0f, 7.0f), step, lr);
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 at = _mm256_set1_ps(float(i));
+		__m256 gain0 = _mm256_fmadd_ps(at, step, base0);
+		__m256 gain1 = _mm256_fmadd_ps(at, step, base1);
+
+		__m256 samples = _mm256_loadu_ps(in + i); //(a0, ..., a7)
+		__m256 lo = _mm256_unpacklo_ps(samples, samples); //(a0, a0, a1, a1 | a4, a4, a5, a5)
+		__m256 hi = _mm256_unpackhi_ps(samples, samples); //(a2, a2, a3, a3 | a6, a6, a7, a7)
+		__m256 samples0 = _mm256_permute2f128_ps(lo, hi, 0x20); //(a0, a0, ..., a3, a3)
+		__m256 samples1 = _mm256_permute2f128_ps(lo, hi, 0x31); //(a4, a4, ..., a7, a7)
+
+		_mm256_storeu_ps(out + 2*i + 0, _mm256_fmadd_ps(samples0, gain0, _mm256_loadu_ps(out + 2*i + 0)));
+		_mm256_storeu_ps(out + 2*i + 8, _mm256_fmadd_ps(samples1, gain1, _mm256_loadu_ps(out + 2*i + 8)));
+	}
+	//leftover frames:
+	if (i < count) {
+		mix_mono_to_stereo_sse(in + i, count - i, left + float(i) * left_step, right + float(i) * right_step, left_step, right_step, out + 2*i);
+	}
+}
+
+//eight frames at a time:
+TARGET_AVX2
+static void mix_int16_mono_to_stereo_avx2(int16_t const *in, uint32_t count, float left, float right, float left_step, float right_step, float *out) {
+	float const scale = 1.0f / 32768.0f;
+	left *= scale; right *= scale; left_step *= scale; right_step *= scale;
+
+	__m256 const step = _mm256_setr_ps(left_step, right_step, left_step, right_step, left_step, right_step, left_step, right_step);
+	__m256 const lr = _mm256_setr_ps(left, right, left, right, left, right, left, right);
+	__m256 const base0 = _mm256_fmadd_ps(_mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f), step, lr);
+	__m256 const base1 = _mm256_fmadd_ps(_mm256_setr_ps(4.0f, 4.0f, 5.0f, 5.0f, 6.0f, 6.0f, 7.0f, 7.0f), step, lr);
+
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 at = _mm256_set1_ps(float(i));
+		__m256 gain0 = _mm256_fmadd_ps(at, step, base0);
+		__m256 gain1 = _mm256_fmadd_ps(at, step, base1);
+
+		__m128i words = _mm_loadu_si128(reinterpret_cast< __m128i const * >(in + i)); //(a0, ..., a7) as int16
+		__m256 samples = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(words));
+		__m256 lo = _mm256_unpacklo_ps(samples, samples); //(a0, a0, a1, a1 | a4, a4, a5, a5)
+		__m256 hi = _mm256_unpackhi_ps(samples, samples); //(a2, a2, a3, a3 | a6, a6, a7, a7)
+		__m256 samples0 = _mm256_permute2f128_ps(lo, hi, 0x20); //(a0, a0, ..., a3, a3)
+		__m256 samples1 = _mm256_permute2f128_ps(lo, hi, 0x31); //(a4, a4, ..., a7, a7)
+
+		_mm256_storeu_ps(out + 2*i + 0, _mm256_fmadd_ps(samples0, gain0, _mm256_loadu_ps(out + 2*i + 0)));
+		_mm256_storeu_ps(out + 2*i + 8, _mm256_fmadd_ps(samples1, gain1, _mm256_loadu_ps(out + 2*i + 8)));
+	}
+	//leftover frames:
+	if (i < count) {
+		float const unscale = 32768.0f;
+		mix_int16_mono_to_stereo_sse(in + i, count - i, (left + float(i) * left_step) * unscale, (right + float(i) * right_step) * unscale, left_step * unscale, right_step * unscale, out + 2*i);
+	}
+}
+
+//eight frames at a time:
+TARGET_AVX2
+static void downmix_stereo_to_mono_avx2(float const *in, uint32_t count, float *out) {
+	__m256 const half = _mm256_set1_ps(0.5f);
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 a = _mm256_loadu_ps(in + 2*i + 0); //(l0, r0, ..., l3, r3)
+		__m256 b = _mm256_loadu_ps(in + 2*i + 8); //(l4, r4, ..., l7, r7)
+		__m256 sums = _mm256_hadd_ps(a, b); //(s0, s1, s4, s5 | s2, s3, s6, s7)
+		sums = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(sums), _MM_SHUFFLE(3,1,2,0))); //(s0, ..., s7)
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(sums, half));
+	}
+	//leftover frames:
+	if (i < count) {
+		downmix_stereo_to_mono_sse(in + 2*i, count - i, out + i);
+	}
+}
+
+//four taps at a time:
+static void resample_sse(float const *in, uint32_t frac, uint64_t step, uint32_t count, float const *table, float *out) {
+	static_assert(ResampleTaps == 16, "SSE resampler is written for 16 taps");
+	uint64_t p = frac;
+	for (uint32_t i = 0; i < count; ++i, p += step) {
+		float const *src = in + (p >> 32);
+		float const *coef = table + ((p >> 24) & 0xff) * ResampleTaps;
+		__m128 sum = _mm_mul_ps(_mm_loadu_ps(src + 0), _mm_loadu_ps(coef + 0));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + 4), _mm_loadu_ps(coef + 4)));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + 8), _mm_loadu_ps(coef + 8)));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + 12), _mm_loadu_ps(coef + 12)));
+		//horizontal sum:
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		out[i] = _mm_cvtss_f32(sum);
+	}
+}
+
+//eight taps at a time:
+TARGET_AVX2
+static void resample_avx2(float const *in, uint32_t frac, uint64_t step, uint32_t count, float const *table, float *out) {
+	static_assert(ResampleTaps == 16, "AVX2 resampler is written for 16 taps");
+	uint64_t p = frac;
+	for (uint32_t i = 0; i < count; ++i, p += step) {
+		float const *src = in + (p >> 32);
+		float const *coef = table + ((p >> 24) & 0xff) * ResampleTaps;
+		__m256 sum = _mm256_mul_ps(_mm256_loadu_ps(src + 0), _mm256_loadu_ps(coef + 0));
+		sum = _mm256_fmadd_ps(_mm256_loadu_ps(src + 8), _mm256_loadu_ps(coef + 8), sum);
+		//horizontal sum:
+		__m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+		half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+		half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+		out[i] = _mm_cvtss_f32(half);
+	}
+}
+
+static bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	if (!(fma && osxsave)) return false;
+	if ((_xgetbv(0) & 0x6) != 0x6) return false; //OS saves the AVX registers
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+#endif //MIX_KERNELS_X86
+
+std::vector< MixKernel > const &mix_kernels() {
+	static std::vector< MixKernel > kernels = []() {
+		std::vector< MixKernel > ret;
+		ret.emplace_back(MixKernel{ "scalar", mix_mono_to_stereo_scalar, mix_int16_mono_to_stereo_scalar, downmix_stereo_to_mono_scalar, resample_scalar });
+#ifdef MIX_KERNELS_X86
+		ret.emplace_back(MixKernel{ "sse", mix_mono_to_stereo_sse, mix_int16_mono_to_stereo_sse, downmix_stereo_to_mono_sse, resample_sse });
+		if (cpu_has_avx2()) {
+			ret.emplace_back(MixKernel{ "avx2", mix_mono_to_stereo_avx2, mix_int16_mono_to_stereo_avx2, downmix_stereo_to_mono_avx2, resample_avx2 });
+		}
+#endif
+		return ret;
+	}();
+	return kernels;
+}
+
+MixKernel const &mix_kernel() {
+	static MixKernel const &kernel = mix_kernels().back();
+	return kernel;
+}
+
+//------------------------------------
+//resampling filters: Kaiser-windowed sinc, one table per range of steps:
+
+static constexpr float const ResampleTableSteps[] = { 1.0f, 1.5f, 2.0f, 4.0f, 8.0f }; //largest step each table is for (the last should cover Sound's MAX_RESAMPLE_STEP)
+
+//zeroth-order modified Bessel function of the first kind (for the Kaiser window):
+static double bessel_i0(double x) {
+	double sum = 1.0, term = 1.0;
+	for (uint32_t k = 1; k < 32; ++k) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+float const *resample_table(float step) {
+	static std::vector< std::vector< float > > tables = []() {
+		constexpr double Beta = 7.0; //Kaiser window shape (higher = less ripple, wider transition)
+		constexpr double Pi = 3.14159265358979323846;
+		std::vector< std::vector< float > > ret;
+		for (float max_step : ResampleTableSteps) {
+			//cutoff (relative to the input's Nyquist frequency), leaving room for the transition band:
+			double cutoff = 0.9 / std::max(1.0, double(max_step));
+			std::vector< float > table(ResamplePhases * ResampleTaps);
+			for (uint32_t phase = 0; phase < ResamplePhases; ++phase) {
+				double frac = double(phase) / double(ResamplePhases);
+				double sum = 0.0;
+				for (uint32_t k = 0; k < ResampleTaps; ++k) {
+					//distance from the output position to input sample k:
+					double x = double(k) - double(ResampleTaps / 2 - 1) - frac;
+					double t = cutoff * x;
+					double sinc = (t == 0.0 ? 1.0 : std::sin(Pi * t) / (Pi * t));
+					double w = x / double(ResampleTaps / 2);
+					double window = (std::abs(w) >= 1.0 ? 0.0 : bessel_i0(Beta * std::sqrt(1.0 - w * w)) / bessel_i0(Beta));
+					table[phase * ResampleTaps + k] = float(cutoff * sinc * window);
+					sum += cutoff * sinc * window;
+				}
+				//normalize for unit gain at DC:
+				for (uint32_t k = 0; k < ResampleTaps; ++k) {
+					table[phase * ResampleTaps + k] = float(table[phase * ResampleTaps + k] / sum);
+				}
+			}
+			ret.emplace_back(std::move(table));
+		}
+		return ret;
+	}();
+
+	uint32_t t = 0;
+	while (t + 1 < tables.size() && step > ResampleTableSteps[t]) ++t;
+	return tables[t].data();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ * Inner loops of Sound's mixer (and sample loading), in scalar, SSE, and AVX2 versions.
+ *
+ * mix_mono_to_stereo adds a run of mono samples into an interleaved stereo buffer
+ *  while linearly ramping the left and right gains:
+ *   out[2*i+0] += in[i] * (left  + i * left_step)
+ *   out[2*i+1] += in[i] * (right + i * right_step)
+ *
+ * mix_int16_mono_to_stereo does the same for 16-bit samples (read as in[i] / 32768).
+ *
+ * downmix_stereo_to_mono averages the channels of an interleaved stereo buffer:
+ *   out[i] = (in[2*i+0] + in[2*i+1]) * 0.5
+ *
+ * resample reads mono samples at a fractional position that advances by 'step' per output
+ *  sample (both 32.32 fixed point, position relative to 'in'), filtering with a polyphase
+ *  windowed-sinc table from resample_table():
+ *   p = frac + i * step
+ *   out[i] = sum over k < ResampleTaps of in[(p >> 32) + k] * table[phase(p) * ResampleTaps + k]
+ *  (so 'in' should start ResampleTaps/2 - 1 samples before the first position)
+ *
+ * mix_kernel() picks the fastest version that was compiled in and that
+ *  the CPU running the program supports; mix_kernels() lists all of them
+ *  (e.g., for benchmarking and for checking them against each other).
+ *
+ */
+
+#include <cstdint>
+#include <vector>
+
+struct MixKernel {
+	char const *name;
+	void (*mix_mono_to_stereo)(float const *in, uint32_t count, float left, float right, float left_step, float right_step, float *out);
+	void (*mix_int16_mono_to_stereo)(int16_t const *in, uint32_t count, float left, float right, float left_step, float right_step, float *out);
+	void (*downmix_stereo_to_mono)(float const *in, uint32_t count, float *out);
+	void (*resample)(float const *in, uint32_t frac, uint64_t step, uint32_t count, float const *table, float *out);
+};
+
+constexpr uint32_t ResampleTaps = 16;
+constexpr uint32_t ResamplePhases = 256; //(phase(p) is the top 8 bits of the fraction)
+
+//filter table for resampling at 'step' input samples per output sample (lower cutoff for larger steps, to avoid aliasing):
+// ResamplePhases rows of ResampleTaps coefficients; tables are built on the first call (so make one before using them from the audio callback)
+float const *resample_table(float step);
+
+//kernels usable on this CPU, slowest (always "scalar") first:
+std::vector< MixKernel > const &mix_kernels();
+
+//the last (fastest) of the above:
+MixKernel const &mix_kernel();
@@ -0,0 +1,160 @@
+//mixer-bench times Sound's whole mixer (mix_audio), rendered offline -- no audio device needed.
+//
+//Usage:
+//	mixer-bench [max voices] [blocks] [output.wav]
+//
+//Sweeps voice counts (powers of four up to 'max voices', default 256), 2D and 3D
+// panning, and static or moving ramps (every voice gets a new pan/position or volume
+// target each block, and in 3D the listener moves too). For each case, renders 'blocks'
+// (default 400) blocks with Sound::render and reports per-block time percentiles against
+// the real-time deadline of one block (1024 frames at 48kHz, about 21.3ms).
+//
+//If 'output.wav' is given, also renders a few seconds of 3D voices sweeping past the
+// listener to that file with Sound::render_wav (e.g., to listen to or to compare against an earlier render).
+
+#include "Sound.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	uint32_t max_voices = 256;
+	uint32_t blocks = 400;
+	std::string wav;
+	if (argc > 1) max_voices = std::max(1U, uint32_t(std::stoul(argv[1])));
+	if (argc > 2) blocks = std::max(1U, uint32_t(std::stoul(argv[2])));
+	if (argc > 3) wav = argv[3];
+
+	const double Deadline = double(Sound::BlockFrames) / double(Sound::OutputRate);
+	const uint32_t WarmupBlocks = 8;
+
+	Sound::init_offline(max_voices);
+
+	//a few test sounds (decaying tones over some noise), long enough that looping doesn't line them up:
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+	std::vector< Sound::Sample > samples;
+	for (float hz : { 220.0f, 330.0f, 495.0f, 742.5f }) {
+		std::vector< float > data(3 * Sound::OutputRate + uint32_t(hz));
+		for (uint32_t i = 0; i < data.size(); ++i) {
+			float t = float(i % 12000) / float(Sound::OutputRate);
+			data[i] = std::exp(-4.0f * t) * 0.5f * std::sin(2.0f * 3.1415926f * hz * t) + 0.02f * unit(mt);
+		}
+		samples.emplace_back(data);
+	}
+
+	std::vector< uint32_t > counts;
+	for (uint32_t count = 1; count < max_voices; count *= 4) counts.emplace_back(count);
+	counts.emplace_back(max_voices);
+
+	std::vector< float > out;
+	out.reserve(2 * Sound::BlockFrames); //(so render() doesn't allocate while being timed)
+
+	std::cout << "Mixing " << blocks << " blocks per case; deadline " << (Deadline * 1e3) << " ms per block:" << std::endl;
+	bool missed = false;
+	for (uint32_t count : counts) {
+		for (bool in_3D : { false, true }) {
+			for (bool ramps : { false, true }) {
+				//start voices spread around the listener (or across the stereo field):
+				Sound::listener.set_position_right(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 0.0f);
+				std::vector< Sound::PlayingSample > playing;
+				playing.reserve(count);
+				for (uint32_t v = 0; v < count; ++v) {
+					Sound::Sample const &sample = samples[v % samples.size()];
+					float volume = 1.0f / float(count);
+					if (in_3D) {
+						playing.emplace_back(Sound::loop_3D(sample, volume, glm::vec3(10.0f * unit(mt), 10.0f * unit(mt), 0.0f), 5.0f));
+					} else {
+						playing.emplace_back(Sound::loop(sample, volume, unit(mt)));
+					}
+				}
+
+				std::vector< double > times;
+				times.reserve(blocks);
+				for (uint32_t b = 0; b < WarmupBlocks + blocks; ++b) {
+					if (ramps) {
+						//one command per voice per block (alternating pan/position and volume), so the command ring keeps up:
+						for (auto &p : playing) {
+							if (b % 2 == 0) {
+								if (in_3D) p.set_position(glm::vec3(10.0f * unit(mt), 10.0f * unit(mt), 0.0f));
+								else p.set_pan(unit(mt));
+							} else {
+								p.set_volume((1.0f + 0.5f * unit(mt)) / float(count));
+							}
+						}
+						if (in_3D) {
+							float angle = float(b) * 0.05f;
+							Sound::listener.set_position_right(glm::vec3(std::cos(angle), std::sin(angle), 0.0f), glm::vec3(std::cos(angle), std::sin(angle), 0.0f));
+						}
+					}
+
+					out.clear();
+					auto before = std::chrono::high_resolution_clock::now();
+					Sound::render(1, &out);
+					auto after = std::chrono::high_resolution_clock::now();
+					if (b >= WarmupBlocks) times.emplace_back(std::chrono::duration< double >(after - before).count());
+				}
+
+				std::sort(times.begin(), times.end());
+				auto percentile = [&times](double p) {
+					return times[std::min(times.size() - 1, size_t(p * double(times.size())))];
+				};
+				uint32_t over = uint32_t(times.end() - std::upper_bound(times.begin(), times.end(), Deadline));
+				std::cout << "  " << count << " voices, " << (in_3D ? "3D" : "2D") << ", " << (ramps ? "moving" : "static") << " ramps: "
+					<< "p50 " << (percentile(0.50) * 1e3) << " ms, p90 " << (percentile(0.90) * 1e3) << " ms, p99 " << (percentile(0.99) * 1e3)
+					<< " ms, max " << (times.back() * 1e3) << " ms (" << (100.0 * times.back() / Deadline) << "% of deadline)";
+				if (over) {
+					std::cout << "; " << over << " blocks over deadline";
+					missed = true;
+				}
+				std::cout << std::endl;
+
+				//release the voices before the next case:
+				Sound::stop_all_samples();
+				for (uint32_t b = 0; b < 4; ++b) {
+					out.clear();
+					Sound::render(1, &out);
+				}
+				for (auto const &p : playing) {
+					if (!p.stopped()) {
+						std::cerr << "ERROR: voice " << p.voice << " still playing after stop_all_samples()." << std::endl;
+						return 1;
+					}
+				}
+			}
+		}
+	}
+
+	if (!wav.empty()) {
+		//a few voices sweeping past the listener while their playback rates glide:
+		const float Seconds = 5.0f;
+		std::vector< Sound::PlayingSample > playing;
+		for (uint32_t v = 0; v < samples.size(); ++v) {
+			float side = (v % 2 ? 1.0f : -1.0f);
+			playing.emplace_back(Sound::loop_3D(samples[v], 0.5f, glm::vec3(-8.0f * side, 2.0f + float(v), 0.0f), 5.0f));
+			playing.back().set_position(glm::vec3(8.0f * side, 2.0f + float(v), 0.0f), Seconds);
+			playing.back().set_rate(0.75f + 0.25f * float(v), Seconds);
+		}
+		uint32_t wav_blocks = uint32_t(Seconds * float(Sound::OutputRate) / float(Sound::BlockFrames));
+		try {
+			Sound::render_wav(wav, wav_blocks);
+		} catch (std::exception &e) {
+			std::cerr << "ERROR: " << e.what() << std::endl;
+			return 1;
+		}
+		std::cout << "Wrote " << (wav_blocks * Sound::BlockFrames) << " frames to '" << wav << "'." << std::endl;
+	}
+
+	Sound::shutdown();
+
+	if (missed) {
+		std::cout << "Some blocks missed the deadline." << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,105 @@
+//opus-decode-bench times load_opus (see load_opus.hpp) at different thread counts.
+//
+//Usage:
+//	opus-decode-bench <file.opus> [iterations]
+//
+//Compares against the original decoder (one op_read_float_stereo loop, emplace_back per sample),
+// and checks each parallel decode against it (segment boundaries go through op_pcm_seek's
+// pre-roll, so tiny differences are expected there).
+
+#include "load_opus.hpp"
+
+#include <opusfile.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+//load_opus as it was before segments and SIMD downmixing:
+static void load_opus_original(std::string const &filename, std::vector< float > *data_) {
+	auto &data = *data_;
+	data.clear();
+
+	int err = 0;
+	std::unique_ptr< OggOpusFile, decltype(&op_free) > op(op_open_file(filename.c_str(), &err), op_free);
+	if (err != 0) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
+	}
+
+	ogg_int64_t length = op_pcm_total(op.get(), -1);
+	data.reserve(length >= 0 ? size_t(length) : 2*48000);
+
+	std::vector< float > pcm(2*48000*2, 0.0f);
+	for (;;) {
+		int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
+		if (ret < 0) {
+			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+		}
+		for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+			data.emplace_back((pcm[2*i] + pcm[2*i+1]) * 0.5f);
+		}
+		if (ret == 0) break;
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		std::cerr << "Usage:\n\topus-decode-bench <file.opus> [iterations]" << std::endl;
+		return 1;
+	}
+	std::string filename = argv[1];
+	uint32_t iterations = 5;
+	if (argc > 2) iterations = std::max(1U, uint32_t(std::stoul(argv[2])));
+
+	//median time of 'iterations' runs of 'load' (with load_opus's progress messages hidden):
+	auto time = [&](std::function< void(std::vector< float > *) > const &load, std::vector< float > *data) {
+		std::vector< double > times;
+		for (uint32_t i = 0; i < iterations; ++i) {
+			std::ostringstream quiet;
+			std::streambuf *old = std::cout.rdbuf(quiet.rdbuf());
+			auto before = std::chrono::high_resolution_clock::now();
+			load(data);
+			auto after = std::chrono::high_resolution_clock::now();
+			std::cout.rdbuf(old);
+			times.emplace_back(std::chrono::duration< double >(after - before).count());
+		}
+		std::sort(times.begin(), times.end());
+		return times[times.size() / 2];
+	};
+
+	std::vector< float > reference;
+	double original = time([&](std::vector< float > *data) { load_opus_original(filename, data); }, &reference);
+	std::cout << "'" << filename << "': " << reference.size() << " samples (" << (reference.size() / 48000.0) << " s)" << std::endl;
+	std::cout << "  original: " << (original * 1e3) << " ms" << std::endl;
+
+	uint32_t cores = std::max(1U, std::thread::hardware_concurrency());
+	for (uint32_t threads = 1; ; threads = std::min(cores, threads * 2)) {
+		std::vector< float > data;
+		double t = time([&](std::vector< float > *data) { load_opus(filename, data, threads); }, &data);
+
+		float max_difference = 0.0f;
+		if (data.size() == reference.size()) {
+			for (size_t i = 0; i < data.size(); ++i) {
+				max_difference = std::max(max_difference, std::abs(data[i] - reference[i]));
+			}
+		}
+		std::cout << "  load_opus, " << threads << " thread(s): " << (t * 1e3) << " ms (" << (original / t) << "x); ";
+		if (data.size() != reference.size()) {
+			std::cout << "ERROR: decoded " << data.size() << " samples instead of " << reference.size() << "." << std::endl;
+			return 1;
+		}
+		std::cout << "max difference from original " << max_difference << std::endl;
+
+		if (threads == cores) break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,389 @@
+//quantize-meshes converts a mesh file (.pnct) to the compact vertex layout read by MeshBuffer:
+// - positions become 16-bit normalized integers relative to each mesh's bounding box,
+// - normals become 10:10:10:2 normalized integers,
+// - texture coordinates become half floats,
+// - colors are unchanged.
+// This takes vertices from 36 bytes to 20 bytes. Element and index chunks are kept as-is
+// (run weld-meshes first for the smallest files).
+//
+//Usage:
+//	quantize-meshes [--check] <in.pnct> <out.pnct>
+//
+//With --check, the output file is read back, decoded the way OpenGL will decode it,
+// and compared to the input, corner by corner; quantize-meshes fails if any attribute
+// is off by more than its format allows.
+
+#include "ChunkReader.hpp"
+#include "read_write_chunk.hpp"
+#include "mesh_name_table.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//same layouts as MeshBuffer reads:
+struct Vertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::u8vec4 Color;
+	glm::vec2 TexCoord;
+};
+static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+struct QuantizedVertex {
+	int16_t Position[4]; //xyz: snorm16, relative to mesh's bounding box; w: padding
+	uint32_t Normal; //snorm 10:10:10:2 (w unused)
+	glm::u8vec4 Color;
+	uint16_t TexCoord[2]; //half floats
+};
+static_assert(sizeof(QuantizedVertex) == 4*2+4+4*1+2*2, "QuantizedVertex is packed.");
+
+struct Box {
+	glm::vec3 min, max;
+};
+static_assert(sizeof(Box) == 4*6, "Box is packed.");
+
+struct IndexEntry {
+	uint32_t name_begin, name_end;
+	uint32_t begin, end; //vertex range (idx0) or element range (idx1)
+};
+static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+//---- conversions ----
+
+//float in [-1,1] to signed normalized integer with 'bits' bits:
+static int32_t to_snorm(float f, uint32_t bits) {
+	int32_t max = (1 << (bits - 1)) - 1;
+	f = std::max(-1.0f, std::min(1.0f, f));
+	return int32_t(std::lround(f * float(max)));
+}
+//...and back (using the OpenGL 4.2+ rule; older drivers may use (2c+1)/(2^bits-1), which differs by at most half a step):
+static float from_snorm(int32_t c, uint32_t bits) {
+	int32_t max = (1 << (bits - 1)) - 1;
+	return std::max(-1.0f, float(c) / float(max));
+}
+
+static uint32_t pack_normal(glm::vec3 n) {
+	float len = glm::length(n);
+	if (len > 0.0f) n /= len;
+	uint32_t x = uint32_t(to_snorm(n.x, 10)) & 0x3ff;
+	uint32_t y = uint32_t(to_snorm(n.y, 10)) & 0x3ff;
+	uint32_t z = uint32_t(to_snorm(n.z, 10)) & 0x3ff;
+	return x | (y << 10) | (z << 20);
+}
+static glm::vec3 unpack_normal(uint32_t packed) {
+	auto field = [packed](uint32_t shift) -> int32_t {
+		int32_t v = int32_t((packed >> shift) & 0x3ff);
+		return (v & 0x200 ? v - 0x400 : v); //sign-extend
+	};
+	return glm::vec3(from_snorm(field(0), 10), from_snorm(field(10), 10), from_snorm(field(20), 10));
+}
+
+//IEEE half float conversion (round-to-nearest-even; infinities and NaNs preserved):
+static uint16_t to_half(float f) {
+	uint32_t bits;
+	std::memcpy(&bits, &f, 4);
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int32_t exponent = int32_t((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+	if (((bits >> 23) & 0xff) == 0xff) { //inf / nan
+		return uint16_t(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	}
+	if (exponent >= 31) return uint16_t(sign | 0x7c00); //overflow -> inf
+	if (exponent <= 0) {
+		//subnormal (or zero):
+		if (exponent < -10) return uint16_t(sign);
+		mantissa |= 0x800000;
+		uint32_t shift = uint32_t(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1))) half += 1;
+		return uint16_t(sign | half);
+	}
+	uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half += 1; //(carry into exponent is correct rounding)
+	return uint16_t(half);
+}
+static float from_half(uint16_t h) {
+	uint32_t sign = uint32_t(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+	float f;
+	if (exponent == 0) {
+		f = std::ldexp(float(mantissa), -24);
+	} else if (exponent == 31) {
+		f = (mantissa ? std::numeric_limits< float >::quiet_NaN() : std::numeric_limits< float >::infinity());
+	} else {
+		f = std::ldexp(float(mantissa | 0x400), int(exponent) - 25);
+	}
+	uint32_t bits;
+	std::memcpy(&bits, &f, 4);
+	bits |= sign;
+	std::memcpy(&f, &bits, 4);
+	return f;
+}
+
+//---- file reading ----
+
+struct MeshFile {
+	std::vector< Vertex > vertices; //(only for unquantized files)
+	std::vector< QuantizedVertex > quantized; //(only for quantized files)
+	std::vector< Box > boxes; //(only for quantized files)
+	std::vector< uint32_t > elements;
+	bool indexed = false;
+	std::vector< char > strings;
+	std::vector< IndexEntry > index;
+
+	//calls fn(mesh, vertex) for each corner of each mesh:
+	template< typename F >
+	void for_each_corner(F const &fn) const {
+		size_t count = (quantized.empty() ? vertices.size() : quantized.size());
+		for (uint32_t m = 0; m < index.size(); ++m) {
+			IndexEntry const &entry = index[m];
+			std::string name(strings.begin() + entry.name_begin, strings.begin() + entry.name_end);
+			for (uint32_t i = entry.begin; i < entry.end; ++i) {
+				uint32_t v = (indexed ? elements[i] : i);
+				if (v >= count) throw std::runtime_error("mesh '" + name + "' has out-of-range vertex");
+				fn(m, v);
+			}
+		}
+	}
+};
+
+static MeshFile read_mesh_file(std::string const &filename) {
+	MeshFile ret;
+	ChunkReader file(filename);
+
+	if (file.peek("pncq")) {
+		Span< QuantizedVertex > q = file.read< QuantizedVertex >("pncq");
+		ret.quantized.assign(q.begin(), q.end());
+	} else {
+		Span< Vertex > v = file.read< Vertex >("pnct");
+		ret.vertices.assign(v.begin(), v.end());
+	}
+	if (file.peek("el16")) {
+		Span< uint16_t > e = file.read< uint16_t >("el16");
+		ret.elements.assign(e.begin(), e.end());
+		ret.indexed = true;
+	} else if (file.peek("el32")) {
+		Span< uint32_t > e = file.read< uint32_t >("el32");
+		ret.elements.assign(e.begin(), e.end());
+		ret.indexed = true;
+	}
+	if (!ret.quantized.empty()) {
+		Span< Box > b = file.read< Box >("box0");
+		ret.boxes.assign(b.begin(), b.end());
+	}
+	Span< char > strings = file.read< char >("str0");
+	ret.strings.assign(strings.begin(), strings.end());
+	Span< IndexEntry > index = file.read< IndexEntry >(ret.indexed ? "idx1" : "idx0");
+	ret.index.assign(index.begin(), index.end());
+
+	if (!ret.quantized.empty() && ret.boxes.size() != ret.index.size()) {
+		throw std::runtime_error("'" + filename + "' has a different number of boxes and meshes");
+	}
+	for (auto const &entry : ret.index) {
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= ret.strings.size())) {
+			throw std::runtime_error("index entry has out-of-range name begin/end");
+		}
+		size_t limit = (ret.indexed ? ret.elements.size() : std::max(ret.vertices.size(), ret.quantized.size()));
+		if (!(entry.begin <= entry.end && entry.end <= limit)) {
+			throw std::runtime_error("index entry has out-of-range start/count");
+		}
+	}
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	bool check = false;
+	std::vector< std::string > files;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--check") check = true;
+		else files.emplace_back(arg);
+	}
+	if (files.size() != 2) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--check] <in.pnct> <out.pnct>" << std::endl;
+		return 1;
+	}
+	std::string in_file = files[0];
+	std::string out_file = files[1];
+
+	try {
+		MeshFile in = read_mesh_file(in_file);
+		if (!in.quantized.empty()) throw std::runtime_error("'" + in_file + "' is already quantized.");
+
+		//each mesh's vertices are quantized relative to that mesh's box, so a vertex shared by several meshes
+		// gets one copy per mesh (weld-meshes only shares vertices that are identical, so this is rare):
+		std::vector< Box > boxes(in.index.size());
+		for (auto &box : boxes) {
+			box.min = glm::vec3( std::numeric_limits< float >::infinity());
+			box.max = glm::vec3(-std::numeric_limits< float >::infinity());
+		}
+		std::vector< uint32_t > owner(in.vertices.size(), -1U); //mesh that the (first) copy of each vertex belongs to
+		in.for_each_corner([&](uint32_t m, uint32_t v) {
+			boxes[m].min = glm::min(boxes[m].min, in.vertices[v].Position);
+			boxes[m].max = glm::max(boxes[m].max, in.vertices[v].Position);
+		});
+		for (auto &box : boxes) {
+			if (box.min.x > box.max.x) box.min = box.max = glm::vec3(0.0f); //(empty mesh)
+		}
+
+		std::vector< QuantizedVertex > quantized;
+		std::vector< uint32_t > elements = in.elements;
+		std::vector< uint32_t > copy_of(in.vertices.size(), -1U); //(for indexed files) quantized copy of vertex for its owner mesh
+
+		auto quantize = [&](Vertex const &v, Box const &box) {
+			glm::vec3 center = 0.5f * (box.max + box.min);
+			glm::vec3 radius = 0.5f * (box.max - box.min);
+			QuantizedVertex q;
+			for (uint32_t c = 0; c < 3; ++c) {
+				q.Position[c] = int16_t(to_snorm(radius[c] > 0.0f ? (v.Position[c] - center[c]) / radius[c] : 0.0f, 16));
+			}
+			q.Position[3] = 0;
+			q.Normal = pack_normal(v.Normal);
+			q.Color = v.Color;
+			q.TexCoord[0] = to_half(v.TexCoord.x);
+			q.TexCoord[1] = to_half(v.TexCoord.y);
+			return q;
+		};
+
+		if (in.indexed) {
+			for (uint32_t m = 0; m < in.index.size(); ++m) {
+				for (uint32_t i = in.index[m].begin; i < in.index[m].end; ++i) {
+					uint32_t v = in.elements[i];
+					if (owner[v] != m) {
+						//first use of this vertex by this mesh:
+						owner[v] = m;
+						copy_of[v] = uint32_t(quantized.size());
+						quantized.emplace_back(quantize(in.vertices[v], boxes[m]));
+					}
+					elements[i] = copy_of[v];
+				}
+			}
+		} else {
+			//vertex ranges are separate, but may overlap, so go by ranges:
+			quantized.resize(in.vertices.size());
+			in.for_each_corner([&](uint32_t m, uint32_t v) {
+				if (owner[v] != -1U && owner[v] != m) throw std::runtime_error("meshes in non-indexed file overlap; run weld-meshes first.");
+				owner[v] = m;
+				quantized[v] = quantize(in.vertices[v], boxes[m]);
+			});
+		}
+
+		std::ofstream out(out_file, std::ios::binary);
+		write_chunk("pncq", quantized, &out);
+		if (in.indexed) {
+			if (quantized.size() <= 0x10000) {
+				std::vector< uint16_t > elements16(elements.begin(), elements.end());
+				write_chunk("el16", elements16, &out);
+			} else {
+				write_chunk("el32", elements, &out);
+			}
+		}
+		write_chunk("box0", boxes, &out);
+		write_chunk("str0", in.strings, &out);
+		write_chunk(in.indexed ? "idx1" : "idx0", in.index, &out);
+		{ //hash table over mesh names (so MeshBuffer doesn't need to build one):
+			std::vector< uint32_t > duplicates;
+			std::vector< uint32_t > name_table = make_mesh_name_table(uint32_t(in.index.size()), [&](uint32_t i) {
+				return std::string_view(in.strings.data() + in.index[i].name_begin, in.index[i].name_end - in.index[i].name_begin);
+			}, &duplicates);
+			for (uint32_t i : duplicates) {
+				std::cerr << "WARNING: mesh name '" << std::string(in.strings.data() + in.index[i].name_begin, in.strings.data() + in.index[i].name_end) << "' is used more than once; only the first will be found." << std::endl;
+			}
+			write_chunk("hsh0", name_table, &out);
+		}
+		size_t out_bytes = size_t(out.tellp());
+		if (!out) throw std::runtime_error("Failed to write '" + out_file + "'.");
+		out.close();
+
+		std::cout << "Wrote " << in.index.size() << " meshes to '" << out_file << "':\n"
+			<< "  " << in.vertices.size() << " vertices (" << in.vertices.size() * sizeof(Vertex) << " bytes) -> "
+			<< quantized.size() << " vertices (" << quantized.size() * sizeof(QuantizedVertex) << " bytes)\n"
+			<< "  file is " << out_bytes << " bytes" << std::endl;
+
+		if (check) {
+			//read back what was written and compare every corner with the input:
+			MeshFile back = read_mesh_file(out_file);
+			if (back.index.size() != in.index.size()) throw std::runtime_error("check: mesh count changed");
+
+			std::vector< std::pair< uint32_t, uint32_t > > in_corners, back_corners;
+			in.for_each_corner([&](uint32_t m, uint32_t v) { in_corners.emplace_back(m, v); });
+			back.for_each_corner([&](uint32_t m, uint32_t v) { back_corners.emplace_back(m, v); });
+			if (in_corners.size() != back_corners.size()) throw std::runtime_error("check: corner count changed");
+
+			float max_position = 0.0f; //in units of quantization steps
+			float max_normal = 0.0f; //in degrees
+			float max_texcoord = 0.0f; //relative to half float precision
+			uint32_t failures = 0;
+			for (uint32_t c = 0; c < in_corners.size(); ++c) {
+				uint32_t m = in_corners[c].first;
+				if (back_corners[c].first != m) throw std::runtime_error("check: corner moved to a different mesh");
+				Vertex const &a = in.vertices[in_corners[c].second];
+				QuantizedVertex const &b = back.quantized[back_corners[c].second];
+				Box const &box = back.boxes[m];
+				glm::vec3 center = 0.5f * (box.max + box.min);
+				glm::vec3 radius = 0.5f * (box.max - box.min);
+
+				bool ok = true;
+				for (uint32_t i = 0; i < 3; ++i) {
+					float decoded = center[i] + radius[i] * from_snorm(b.Position[i], 16);
+					float step = radius[i] / 32767.0f;
+					float err = std::abs(decoded - a.Position[i]);
+					if (step > 0.0f) max_position = std::max(max_position, err / step);
+					//half a step of rounding, plus float slop in center/radius arithmetic:
+					if (err > 0.5f * step + 1e-6f * (std::abs(center[i]) + radius[i])) ok = false;
+				}
+
+				if (glm::length(a.Normal) > 0.0f) {
+					glm::vec3 n = glm::normalize(a.Normal);
+					glm::vec3 decoded = glm::normalize(unpack_normal(b.Normal));
+					float angle = std::acos(std::min(1.0f, glm::dot(n, decoded))) * (180.0f / 3.1415926f);
+					max_normal = std::max(max_normal, angle);
+					if (angle > 0.25f) ok = false; //(10-bit components give about 0.1 degree)
+				}
+
+				if (b.Color != a.Color) ok = false;
+
+				for (uint32_t i = 0; i < 2; ++i) {
+					float decoded = from_half(b.TexCoord[i]);
+					float precision = std::max(std::abs(a.TexCoord[i]) * (1.0f / 2048.0f), 1.0f / 16777216.0f);
+					float err = std::abs(decoded - a.TexCoord[i]);
+					if (!(err <= precision)) {
+						if (std::abs(a.TexCoord[i]) < 65504.0f || !std::isinf(decoded)) ok = false; //(out-of-range values become inf)
+					} else {
+						max_texcoord = std::max(max_texcoord, err / precision);
+					}
+				}
+
+				if (!ok) {
+					if (failures < 10) {
+						std::cerr << "  mismatch at corner " << c << " of mesh '"
+							<< std::string(in.strings.begin() + in.index[m].name_begin, in.strings.begin() + in.index[m].name_end) << "'" << std::endl;
+					}
+					failures += 1;
+				}
+			}
+
+			std::cout << "Check: " << in_corners.size() << " corners; max errors: position " << max_position << " steps, normal " << max_normal << " degrees, texcoord " << max_texcoord << " (of half precision)." << std::endl;
+			if (failures) {
+				throw std::runtime_error("check: " + std::to_string(failures) + " corners decoded out of tolerance");
+			}
+		}
+	} catch (std::exception const &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
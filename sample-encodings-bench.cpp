@@ -0,0 +1,108 @@
+//sample-encodings-bench compares Sound's sample encodings (see SampleData.hpp).
+//
+//Usage:
+//	sample-encodings-bench [voices] [iterations]
+//
+//For each encoding, reports memory per second of audio, encoding error
+// (against the original float samples), and the cost of mixing 'voices'
+// (default 256) samples into one 1024-frame block with SampleData::mix,
+// the way Sound's mix_audio does.
+
+#include "SampleData.hpp"
+#include "mix_kernels.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	uint32_t voices = 256;
+	uint32_t iterations = 200;
+	if (argc > 1) voices = std::max(1U, uint32_t(std::stoul(argv[1])));
+	if (argc > 2) iterations = std::max(1U, uint32_t(std::stoul(argv[2])));
+
+	const uint32_t Frames = 1024; //same as Sound's MIX_SAMPLES
+	const uint32_t SampleLength = 4 * 48000;
+
+	//a test sound: a few decaying tones over some noise, repeated:
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+	std::vector< float > samples(SampleLength);
+	for (uint32_t i = 0; i < SampleLength; ++i) {
+		float t = float(i % 24000) / 48000.0f;
+		float envelope = std::exp(-6.0f * t);
+		samples[i] = envelope * (0.4f * std::sin(2.0f * 3.1415926f * 220.0f * t) + 0.2f * std::sin(2.0f * 3.1415926f * 1375.0f * t))
+		           + 0.05f * unit(mt);
+	}
+
+	//where each voice reads from, and its pan ramp:
+	std::vector< uint32_t > offsets(voices);
+	struct Gains { float left, right, left_step, right_step; };
+	std::vector< Gains > gains(voices);
+	for (uint32_t v = 0; v < voices; ++v) {
+		offsets[v] = uint32_t(mt() % (SampleLength - Frames));
+		gains[v].left = 0.5f + 0.5f * unit(mt);
+		gains[v].right = 0.5f + 0.5f * unit(mt);
+		gains[v].left_step = 1e-4f * unit(mt);
+		gains[v].right_step = 1e-4f * unit(mt);
+	}
+
+	MixKernel const &kernel = mix_kernel();
+	std::cout << "Mixing " << voices << " voices into " << Frames << "-frame blocks with the '" << kernel.name << "' kernel (" << iterations << " iterations):" << std::endl;
+
+	double float_bytes = 0.0;
+	double float_time = 0.0;
+	for (SampleData::Encoding encoding : { SampleData::Float32, SampleData::Int16, SampleData::ADPCM }) {
+		SampleData data(samples, encoding);
+
+		//encoding error:
+		std::vector< float > decoded(SampleLength);
+		data.decode(0, SampleLength, decoded.data());
+		double signal = 0.0, noise = 0.0;
+		float max_error = 0.0f;
+		for (uint32_t i = 0; i < SampleLength; ++i) {
+			float error = decoded[i] - samples[i];
+			signal += double(samples[i]) * double(samples[i]);
+			noise += double(error) * double(error);
+			max_error = std::max(max_error, std::abs(error));
+		}
+
+		//mixing time:
+		std::vector< float > out(2 * Frames);
+		std::vector< double > times;
+		times.reserve(iterations);
+		for (uint32_t i = 0; i < iterations; ++i) {
+			auto before = std::chrono::high_resolution_clock::now();
+			std::fill(out.begin(), out.end(), 0.0f);
+			for (uint32_t v = 0; v < voices; ++v) {
+				Gains const &g = gains[v];
+				data.mix(kernel, offsets[v], Frames, g.left, g.right, g.left_step, g.right_step, out.data());
+			}
+			auto after = std::chrono::high_resolution_clock::now();
+			times.emplace_back(std::chrono::duration< double >(after - before).count());
+		}
+		std::sort(times.begin(), times.end());
+		double median = times[times.size() / 2];
+
+		double bytes_per_second = double(data.bytes()) / (double(SampleLength) / 48000.0);
+		if (encoding == SampleData::Float32) {
+			float_bytes = bytes_per_second;
+			float_time = median;
+		}
+
+		std::cout << "  " << sample_encoding_name(encoding) << ": "
+			<< (bytes_per_second / 1024.0) << " KiB per second (" << (float_bytes / bytes_per_second) << "x smaller than float32); "
+			<< (median * 1e9 / double(voices * Frames)) << " ns per voice-frame (" << (median / float_time) << "x float32); ";
+		if (noise == 0.0) {
+			std::cout << "lossless" << std::endl;
+		} else {
+			std::cout << "SNR " << (10.0 * std::log10(signal / noise)) << " dB, max error " << max_error << std::endl;
+		}
+	}
+
+	return 0;
+}
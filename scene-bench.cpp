@@ -0,0 +1,284 @@
+//scene-bench times copying, updating, querying, and drawing a Scene with many transforms
+// (and loading and looking up a mesh file with a mesh per transform).
+//
+//Usage:
+//	scene-bench [transform count] [iterations]
+//
+//The scene is a forest of short chains (like the hexapod's legs), with a
+// drawable (a single triangle) on every transform. Drawing happens in a
+// hidden window.
+
+#include "Scene.hpp"
+#include "Mesh.hpp"
+#include "ColorProgram.hpp"
+#include "Load.hpp"
+#include "GL.hpp"
+#include "gl_errors.hpp"
+#include "read_write_chunk.hpp"
+#include "mesh_name_table.hpp"
+
+#include <SDL.h>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+//run 'fn' 'iterations' times, report the median time in milliseconds:
+template< typename F >
+static void bench(std::string const &name, uint32_t iterations, F const &fn) {
+	std::vector< double > times;
+	times.reserve(iterations);
+	for (uint32_t i = 0; i < iterations; ++i) {
+		auto before = std::chrono::high_resolution_clock::now();
+		fn();
+		auto after = std::chrono::high_resolution_clock::now();
+		times.emplace_back(std::chrono::duration< double >(after - before).count() * 1000.0);
+	}
+	std::sort(times.begin(), times.end());
+	std::cout << "  " << name << ": " << times[times.size() / 2] << " ms median (" << times[0] << " ms best, " << times.back() << " ms worst)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	uint32_t transform_count = 100000;
+	uint32_t iterations = 20;
+	if (argc > 1) transform_count = uint32_t(std::stoul(argv[1]));
+	if (argc > 2) iterations = std::max(1U, uint32_t(std::stoul(argv[2])));
+
+	//------------ GL context (hidden window) ------------
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_GL_ResetAttributes();
+	SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
+	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+
+	SDL_Window *window = SDL_CreateWindow("scene-bench", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 256, 256, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+	if (!window) {
+		std::cerr << "Error creating SDL window: " << SDL_GetError() << std::endl;
+		return 1;
+	}
+	SDL_GLContext context = SDL_GL_CreateContext(window);
+	if (!context) {
+		SDL_DestroyWindow(window);
+		std::cerr << "Error creating OpenGL context: " << SDL_GetError() << std::endl;
+		return 1;
+	}
+	init_GL();
+	SDL_GL_SetSwapInterval(0);
+
+	call_load_functions();
+
+	//------------ one-triangle mesh ------------
+	struct Vertex {
+		glm::vec4 Position;
+		glm::u8vec4 Color;
+	};
+	std::vector< Vertex > triangle{
+		{ glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), glm::u8vec4(0xff, 0x00, 0x00, 0xff) },
+		{ glm::vec4(0.1f, 0.0f, 0.0f, 1.0f), glm::u8vec4(0x00, 0xff, 0x00, 0xff) },
+		{ glm::vec4(0.0f, 0.1f, 0.0f, 1.0f), glm::u8vec4(0x00, 0x00, 0xff, 0xff) },
+	};
+	GLuint buffer = 0, vao = 0;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, triangle.size() * sizeof(Vertex), triangle.data(), GL_STATIC_DRAW);
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glVertexAttribPointer(color_program->Position_vec4, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLbyte *)0 + offsetof(Vertex, Position));
+	glEnableVertexAttribArray(color_program->Position_vec4);
+	glVertexAttribPointer(color_program->Color_vec4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (GLbyte *)0 + offsetof(Vertex, Color));
+	glEnableVertexAttribArray(color_program->Color_vec4);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GL_ERRORS();
+
+	//------------ build scene ------------
+	Scene scene;
+	{
+		const uint32_t ChainLength = 4;
+		Scene::Transform *prev = nullptr;
+		for (uint32_t i = 0; i < transform_count; ++i) {
+			Scene::Transform &t = scene.transforms.emplace_back();
+			t.name = "T" + std::to_string(i);
+			if (i % ChainLength == 0) {
+				t.position = glm::vec3(float(i % 100) - 50.0f, float(i / 100 % 100) - 50.0f, -float(i / 10000));
+			} else {
+				t.position = glm::vec3(0.0f, 0.0f, 0.5f);
+				t.rotation = glm::angleAxis(0.1f, glm::vec3(0.0f, 1.0f, 0.0f));
+				t.parent = scene.transforms.handle(prev);
+			}
+			prev = &t;
+
+			Scene::Drawable &d = scene.drawables.emplace_back(&t);
+			d.pipeline.program = color_program->program;
+			d.pipeline.OBJECT_TO_CLIP_mat4 = color_program->OBJECT_TO_CLIP_mat4;
+			d.pipeline.vao = vao;
+			d.pipeline.type = GL_TRIANGLES;
+			d.pipeline.start = 0;
+			d.pipeline.count = 3;
+			d.pipeline.min = glm::vec3(0.0f, 0.0f, 0.0f);
+			d.pipeline.max = glm::vec3(0.1f, 0.1f, 0.0f);
+		}
+	}
+	glm::mat4 world_to_clip = glm::infinitePerspective(glm::radians(60.0f), 1.0f, 0.1f) * glm::lookAt(glm::vec3(0.0f, 0.0f, 100.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	std::cout << "Scene with " << scene.transforms.size() << " transforms and " << scene.drawables.size() << " drawables:" << std::endl;
+
+	bench("copy", iterations, [&](){
+		Scene copy(scene);
+		if (copy.transforms.size() != scene.transforms.size()) std::cerr << "copy failed?!" << std::endl;
+	});
+
+	bench("update_world (full)", iterations, [&](){
+		scene.world.rebuild = true;
+		scene.update_world();
+	});
+
+	bench("update_world (nothing changed)", iterations, [&](){
+		scene.update_world();
+	});
+
+	bench("update_world (1% of roots moved)", iterations, [&](){
+		uint32_t i = 0;
+		for (auto &t : scene.transforms) {
+			if (!t.parent && (i++ % 100) == 0) t.position.z += 0.01f;
+		}
+		scene.update_world();
+	});
+
+	bench("update_bvh (full)", iterations, [&](){
+		scene.bvh.world_rebuilds = -1U;
+		scene.update_bvh();
+	});
+
+	bench("update_bvh (1% of roots moved)", iterations, [&](){
+		uint32_t i = 0;
+		for (auto &t : scene.transforms) {
+			if (!t.parent && (i++ % 100) == 0) t.position.z += 0.01f;
+		}
+		scene.update_bvh();
+	});
+	std::cout << "  (refit touched " << scene.bvh.tree.refit_nodes << " of " << scene.bvh.tree.nodes.size() << " nodes)" << std::endl;
+
+	uint32_t hits = 0;
+	bench("pick (1000 rays)", iterations, [&](){
+		hits = 0;
+		for (uint32_t r = 0; r < 1000; ++r) {
+			glm::vec3 origin = glm::vec3(0.0f, 0.0f, 100.0f);
+			glm::vec3 direction = glm::vec3(float(r % 32) / 31.0f - 0.5f, float(r / 32 % 32) / 31.0f - 0.5f, -1.0f);
+			if (scene.pick(origin, direction)) hits += 1;
+		}
+	});
+	std::cout << "  (pick: " << hits << " of 1000 rays hit)" << std::endl;
+
+	//rays that enter a leaf's box but miss every item in it must not hit anything:
+	{
+		BVH pair;
+		pair.build({ BVH::Box(glm::vec3(-2.0f, -1.0f, -1.0f), glm::vec3(-1.0f, 1.0f, 1.0f)), BVH::Box(glm::vec3(1.0f, -1.0f, -1.0f), glm::vec3(2.0f, 1.0f, 1.0f)) });
+		float t = 0.0f;
+		uint32_t between = pair.raycast(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+		uint32_t right = pair.raycast(glm::vec3(1.5f, 0.0f, 10.0f), glm::vec3(0.0f, 0.0f, -1.0f), std::numeric_limits< float >::infinity(), &t);
+		if (between != -1U || right != 1 || t != 9.0f) {
+			std::cerr << "ERROR: BVH raycast between two boxes returned " << int32_t(between) << "; onto the second box returned " << int32_t(right) << " at t = " << t << "." << std::endl;
+			return 1;
+		}
+	}
+
+	glViewport(0, 0, 256, 256);
+	glEnable(GL_DEPTH_TEST);
+	bench("draw", iterations, [&](){
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		scene.draw(world_to_clip);
+		glFinish();
+	});
+	std::cout << "  (draw: " << scene.draw_stats.drawn << " drawables, " << scene.draw_stats.culled << " culled, " << scene.draw_stats.program_binds << " program binds, " << scene.draw_stats.vao_binds << " vao binds, " << scene.draw_stats.gl_calls_saved << " state calls saved)" << std::endl;
+
+	scene.bvh_culling = true;
+	bench("draw (bvh culling)", iterations, [&](){
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		scene.draw(world_to_clip);
+		glFinish();
+	});
+	std::cout << "  (draw: " << scene.draw_stats.drawn << " drawables, " << scene.draw_stats.culled << " culled, " << scene.draw_stats.program_binds << " program binds, " << scene.draw_stats.vao_binds << " vao binds, " << scene.draw_stats.gl_calls_saved << " state calls saved)" << std::endl;
+
+	//------------ mesh file with a (one-triangle) mesh per transform ------------
+	{
+		struct MeshVertex {
+			glm::vec3 Position;
+			glm::vec3 Normal;
+			glm::u8vec4 Color;
+			glm::vec2 TexCoord;
+		};
+		struct IndexEntry {
+			uint32_t name_begin, name_end;
+			uint32_t vertex_begin, vertex_end;
+		};
+		std::vector< MeshVertex > vertices;
+		std::vector< char > strings;
+		std::vector< IndexEntry > index;
+		for (auto const &t : scene.transforms) {
+			IndexEntry entry;
+			entry.name_begin = uint32_t(strings.size());
+			strings.insert(strings.end(), t.name.begin(), t.name.end());
+			entry.name_end = uint32_t(strings.size());
+			entry.vertex_begin = uint32_t(vertices.size());
+			for (uint32_t i = 0; i < 3; ++i) {
+				vertices.emplace_back(MeshVertex{ glm::vec3(float(i == 1), float(i == 2), 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::u8vec4(0xff), glm::vec2(0.0f) });
+			}
+			entry.vertex_end = uint32_t(vertices.size());
+			index.emplace_back(entry);
+		}
+		std::vector< uint32_t > name_table = make_mesh_name_table(uint32_t(index.size()), [&](uint32_t i) {
+			return std::string_view(strings.data() + index[i].name_begin, index[i].name_end - index[i].name_begin);
+		});
+
+		std::string const with_table = "scene-bench-hashed.pnct";
+		std::string const without_table = "scene-bench-plain.pnct";
+		for (std::string const &filename : { with_table, without_table }) {
+			std::ofstream out(filename, std::ios::binary);
+			write_chunk("pnct", vertices, &out);
+			write_chunk("str0", strings, &out);
+			write_chunk("idx0", index, &out);
+			if (filename == with_table) write_chunk("hsh0", name_table, &out);
+		}
+
+		std::cout << "Mesh file with " << index.size() << " meshes:" << std::endl;
+		bench("load (name table in file)", iterations, [&](){
+			MeshBuffer buffer(with_table, MeshBuffer::DeferUpload);
+		});
+		bench("load (name table built)", iterations, [&](){
+			MeshBuffer buffer(without_table, MeshBuffer::DeferUpload);
+		});
+		MeshBuffer buffer(with_table, MeshBuffer::DeferUpload);
+		GLuint found = 0;
+		bench("lookup (every transform's mesh)", iterations, [&](){
+			for (auto const &t : scene.transforms) {
+				found += buffer.lookup(t.name).count;
+			}
+		});
+		if (found != 3 * iterations * scene.transforms.size()) std::cerr << "ERROR: lookups found the wrong meshes." << std::endl;
+		buffer.upload();
+		glDeleteBuffers(1, &buffer.buffer);
+
+		std::remove(with_table.c_str());
+		std::remove(without_table.c_str());
+	}
+
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &buffer);
+
+	SDL_GL_DeleteContext(context);
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+
+	return 0;
+}
@@ -120,6 +120,13 @@ int main(int argc, char **argv) {
 				drawable.pipeline.type = mesh.type;
 				drawable.pipeline.start = mesh.start;
 				drawable.pipeline.count = mesh.count;
+				drawable.pipeline.index_type = mesh.index_type;
+				drawable.pipeline.position_to_object = mesh.position_to_object;
+				drawable.pipeline.min = mesh.min;
+				drawable.pipeline.max = mesh.max;
+
+				//coarser levels of detail (if any) take over as the drawable shrinks on screen:
+				buffer->set_lods(mesh_name, &drawable.pipeline);
 
 			});
 		} catch (std::exception &e) {
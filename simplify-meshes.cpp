@@ -0,0 +1,469 @@
+//simplify-meshes adds coarser levels of detail to a mesh file (.pnct):
+// for each mesh "X" it appends "X.LOD1", "X.LOD2", ... (see Mesh.hpp), each with about
+// 'ratio' times as many triangles as the level before.
+//
+//Levels are made by repeatedly collapsing the edge whose removal changes the surface least, as measured
+// by quadric error metrics (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics", 1997):
+// - each vertex keeps the sum of the (squared distance to) planes of its original triangles,
+// - an edge a->b is collapsed by moving a onto b, at a cost of a's + b's quadric evaluated at b,
+// - open boundaries and color seams get extra perpendicular planes so they hold their shape,
+// - collapses that would flip a triangle or pinch the surface are skipped.
+//Corners keep their own colors and texture coordinates; flat-shaded normals are recomputed from the new triangles.
+//
+//Usage:
+//	simplify-meshes [--levels <n>] [--ratio <r>] <in.pnct> <out.pnct>
+//
+//Defaults are two levels at a ratio of 0.5. Meshes that already have a .LOD1 (or are themselves LODs) are left alone,
+// and a mesh gets fewer levels if it can't be simplified further.
+//
+//The input may be plain (pnct, str0, idx0) or indexed (pnct, el16/el32, str0, idx1); the output is plain
+// (run weld-meshes and quantize-meshes after this utility).
+
+#include "ChunkReader.hpp"
+#include "read_write_chunk.hpp"
+#include "mesh_name_table.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//same layout as MeshBuffer reads:
+struct Vertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::u8vec4 Color;
+	glm::vec2 TexCoord;
+};
+static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+struct IndexEntry {
+	uint32_t name_begin, name_end;
+	uint32_t begin, end; //vertex range (idx0) or element range (idx1)
+};
+static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+//symmetric 4x4 matrix Q such that [p 1] Q [p 1]^T is the sum of squared distances from p to some planes:
+struct Quadric {
+	double a = 0.0, b = 0.0, c = 0.0, d = 0.0; //first row
+	double e = 0.0, f = 0.0, g = 0.0; //second row (from the diagonal)
+	double h = 0.0, i = 0.0; //third row
+	double j = 0.0; //fourth row
+
+	//plane n.p + w = 0 (n unit length), scaled by 'weight':
+	static Quadric plane(glm::dvec3 const &n, double w, double weight) {
+		Quadric q;
+		q.a = weight * n.x * n.x; q.b = weight * n.x * n.y; q.c = weight * n.x * n.z; q.d = weight * n.x * w;
+		q.e = weight * n.y * n.y; q.f = weight * n.y * n.z; q.g = weight * n.y * w;
+		q.h = weight * n.z * n.z; q.i = weight * n.z * w;
+		q.j = weight * w * w;
+		return q;
+	}
+	Quadric &operator+=(Quadric const &o) {
+		a += o.a; b += o.b; c += o.c; d += o.d;
+		e += o.e; f += o.f; g += o.g;
+		h += o.h; i += o.i;
+		j += o.j;
+		return *this;
+	}
+	double error(glm::dvec3 const &p) const {
+		return a*p.x*p.x + 2.0*b*p.x*p.y + 2.0*c*p.x*p.z + 2.0*d*p.x
+		     + e*p.y*p.y + 2.0*f*p.y*p.z + 2.0*g*p.y
+		     + h*p.z*p.z + 2.0*i*p.z
+		     + j;
+	}
+};
+
+//extra weight on boundary / seam planes, relative to surface planes:
+static const double BoundaryWeight = 10.0;
+
+//one mesh's triangles, being simplified:
+struct Simplifier {
+	std::vector< glm::dvec3 > positions; //unique positions
+	std::vector< Quadric > quadrics; //per position
+	std::vector< std::vector< uint32_t > > triangles_of; //per position (may include dead triangles)
+	std::vector< uint32_t > version; //per position; bumped when its neighborhood changes (invalidates queued collapses)
+	std::vector< bool > removed; //per position
+
+	std::vector< std::array< uint32_t, 3 > > triangles; //positions of each corner
+	std::vector< std::array< Vertex, 3 > > corners; //attributes of each corner (Position is ignored)
+	std::vector< std::array< bool, 3 > > flat; //did the corner's normal match its triangle's normal?
+	std::vector< bool > dead; //per triangle
+	uint32_t alive = 0; //triangles not dead
+
+	struct Collapse {
+		double cost;
+		uint32_t from, to;
+		uint32_t from_version, to_version;
+		bool operator<(Collapse const &o) const { return cost > o.cost; } //(cheapest first in std::priority_queue)
+	};
+	std::priority_queue< Collapse > queue;
+	double max_cost = 0.0; //most expensive collapse performed so far
+
+	Simplifier(std::vector< Vertex > const &vertices) {
+		assert(vertices.size() % 3 == 0);
+
+		//corners share a position index if their positions are bit-for-bit equal:
+		std::map< std::array< uint32_t, 3 >, uint32_t > position_index;
+		auto index_of = [&](glm::vec3 const &p) {
+			std::array< uint32_t, 3 > key;
+			std::memcpy(key.data(), &p, sizeof(key));
+			auto ret = position_index.emplace(key, uint32_t(positions.size()));
+			if (ret.second) positions.emplace_back(glm::dvec3(p));
+			return ret.first->second;
+		};
+
+		for (uint32_t t = 0; t * 3 < vertices.size(); ++t) {
+			std::array< uint32_t, 3 > tri;
+			std::array< Vertex, 3 > attribs;
+			for (uint32_t c = 0; c < 3; ++c) {
+				tri[c] = index_of(vertices[3*t+c].Position);
+				attribs[c] = vertices[3*t+c];
+			}
+			if (tri[0] == tri[1] || tri[1] == tri[2] || tri[2] == tri[0]) continue; //skip degenerate triangles
+			triangles.emplace_back(tri);
+			corners.emplace_back(attribs);
+		}
+		alive = uint32_t(triangles.size());
+		dead.assign(triangles.size(), false);
+
+		quadrics.resize(positions.size());
+		triangles_of.resize(positions.size());
+		version.assign(positions.size(), 0);
+		removed.assign(positions.size(), false);
+
+		//surface quadrics (area weighted) and flat-shading flags:
+		flat.resize(triangles.size());
+		for (uint32_t t = 0; t < triangles.size(); ++t) {
+			glm::dvec3 const &a = positions[triangles[t][0]];
+			glm::dvec3 const &b = positions[triangles[t][1]];
+			glm::dvec3 const &c = positions[triangles[t][2]];
+			glm::dvec3 cross = glm::cross(b - a, c - a);
+			double length = glm::length(cross);
+			glm::dvec3 n = (length > 0.0 ? cross / length : glm::dvec3(0.0));
+			Quadric q = Quadric::plane(n, -glm::dot(n, a), 0.5 * length);
+			for (uint32_t k = 0; k < 3; ++k) {
+				quadrics[triangles[t][k]] += q;
+				triangles_of[triangles[t][k]].emplace_back(t);
+				flat[t][k] = (glm::dot(glm::dvec3(corners[t][k].Normal), n) > 0.9998); //(within ~1 degree)
+			}
+		}
+
+		//boundary and seam quadrics -- planes through the edge, perpendicular to its triangle:
+		std::map< std::pair< uint32_t, uint32_t >, std::vector< std::pair< uint32_t, uint32_t > > > edge_uses; //(lower, higher) -> (triangle, corner)
+		for (uint32_t t = 0; t < triangles.size(); ++t) {
+			for (uint32_t k = 0; k < 3; ++k) {
+				uint32_t a = triangles[t][k], b = triangles[t][(k+1)%3];
+				edge_uses[std::make_pair(std::min(a,b), std::max(a,b))].emplace_back(t, k);
+			}
+		}
+		for (auto const &eu : edge_uses) {
+			auto const &uses = eu.second;
+			bool hold = (uses.size() != 2); //open boundary (or non-manifold edge)
+			if (!hold) {
+				//seam if the two triangles disagree on color at either end of the edge:
+				auto color_at = [&](std::pair< uint32_t, uint32_t > use, uint32_t p) {
+					for (uint32_t k = 0; k < 3; ++k) {
+						if (triangles[use.first][k] == p) return corners[use.first][k].Color;
+					}
+					assert(0 && "edge endpoint is in triangle");
+					return glm::u8vec4(0);
+				};
+				for (uint32_t p : {eu.first.first, eu.first.second}) {
+					if (color_at(uses[0], p) != color_at(uses[1], p)) hold = true;
+				}
+			}
+			if (!hold) continue;
+			for (auto const &use : uses) {
+				uint32_t t = use.first;
+				glm::dvec3 const &a = positions[triangles[t][use.second]];
+				glm::dvec3 const &b = positions[triangles[t][(use.second+1)%3]];
+				glm::dvec3 const &c = positions[triangles[t][(use.second+2)%3]];
+				glm::dvec3 edge = b - a;
+				glm::dvec3 n = glm::cross(edge, glm::cross(edge, c - a));
+				double length = glm::length(n);
+				if (length == 0.0) continue;
+				n /= length;
+				Quadric q = Quadric::plane(n, -glm::dot(n, a), BoundaryWeight * glm::dot(edge, edge));
+				quadrics[eu.first.first] += q;
+				quadrics[eu.first.second] += q;
+			}
+		}
+
+		for (auto const &eu : edge_uses) {
+			queue_collapses(eu.first.first, eu.first.second);
+		}
+	}
+
+	//queue both directions of the edge between positions a and b:
+	void queue_collapses(uint32_t a, uint32_t b) {
+		Quadric q = quadrics[a];
+		q += quadrics[b];
+		queue.push(Collapse{ q.error(positions[b]), a, b, version[a], version[b] });
+		queue.push(Collapse{ q.error(positions[a]), b, a, version[b], version[a] });
+	}
+
+	//can 'from' be moved onto 'to' without flipping triangles or pinching the surface?
+	bool can_collapse(uint32_t from, uint32_t to) const {
+		//link condition: positions adjacent to both must be exactly the far corners of triangles on the edge:
+		std::set< uint32_t > from_neighbors, to_neighbors;
+		uint32_t on_edge = 0;
+		for (uint32_t t : triangles_of[from]) {
+			if (dead[t]) continue;
+			bool has_to = false;
+			for (uint32_t p : triangles[t]) {
+				if (p == to) has_to = true;
+				if (p != from) from_neighbors.insert(p);
+			}
+			if (has_to) on_edge += 1;
+		}
+		for (uint32_t t : triangles_of[to]) {
+			if (dead[t]) continue;
+			for (uint32_t p : triangles[t]) {
+				if (p != to) to_neighbors.insert(p);
+			}
+		}
+		if (on_edge == 0) return false; //(edge no longer exists)
+		uint32_t shared = 0;
+		for (uint32_t p : from_neighbors) {
+			if (p != to && to_neighbors.count(p)) shared += 1;
+		}
+		if (shared != on_edge) return false;
+
+		//no remaining triangle may flip or become degenerate:
+		for (uint32_t t : triangles_of[from]) {
+			if (dead[t]) continue;
+			std::array< uint32_t, 3 > tri = triangles[t];
+			if (tri[0] == to || tri[1] == to || tri[2] == to) continue; //(will be removed)
+			glm::dvec3 before = glm::cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+			for (uint32_t &p : tri) {
+				if (p == from) p = to;
+			}
+			glm::dvec3 after = glm::cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+			double before_length = glm::length(before), after_length = glm::length(after);
+			if (after_length <= 1e-6 * before_length) return false;
+			if (glm::dot(before, after) < 0.5 * before_length * after_length) return false; //(more than 60 degrees)
+		}
+		return true;
+	}
+
+	void collapse(uint32_t from, uint32_t to) {
+		for (uint32_t t : triangles_of[from]) {
+			if (dead[t]) continue;
+			auto &tri = triangles[t];
+			if (tri[0] == to || tri[1] == to || tri[2] == to) {
+				dead[t] = true;
+				alive -= 1;
+				continue;
+			}
+			for (uint32_t &p : tri) {
+				if (p == from) p = to;
+			}
+			triangles_of[to].emplace_back(t);
+		}
+		triangles_of[from].clear();
+		removed[from] = true;
+		quadrics[to] += quadrics[from];
+
+		//drop dead triangles from the list of 'to' (keeps later scans short):
+		auto &list = triangles_of[to];
+		list.erase(std::remove_if(list.begin(), list.end(), [this](uint32_t t) { return bool(dead[t]); }), list.end());
+		std::sort(list.begin(), list.end());
+		list.erase(std::unique(list.begin(), list.end()), list.end());
+
+		//re-queue edges around 'to' with its new quadric:
+		version[to] += 1;
+		std::set< uint32_t > neighbors;
+		for (uint32_t t : list) {
+			for (uint32_t p : triangles[t]) {
+				if (p != to) neighbors.insert(p);
+			}
+		}
+		for (uint32_t p : neighbors) {
+			queue_collapses(to, p);
+		}
+	}
+
+	//collapse edges until at most 'target' triangles remain (or nothing more can be collapsed):
+	void simplify(uint32_t target) {
+		while (alive > target && !queue.empty()) {
+			Collapse c = queue.top();
+			queue.pop();
+			if (removed[c.from] || removed[c.to]) continue;
+			if (version[c.from] != c.from_version || version[c.to] != c.to_version) continue; //(stale)
+			if (!can_collapse(c.from, c.to)) continue;
+			collapse(c.from, c.to);
+			max_cost = std::max(max_cost, c.cost);
+		}
+	}
+
+	//current triangles as a plain triangle list:
+	std::vector< Vertex > triangle_list() const {
+		std::vector< Vertex > ret;
+		ret.reserve(3 * alive);
+		for (uint32_t t = 0; t < triangles.size(); ++t) {
+			if (dead[t]) continue;
+			glm::dvec3 const &a = positions[triangles[t][0]];
+			glm::dvec3 const &b = positions[triangles[t][1]];
+			glm::dvec3 const &c = positions[triangles[t][2]];
+			glm::vec3 n = glm::vec3(glm::normalize(glm::cross(b - a, c - a)));
+			for (uint32_t k = 0; k < 3; ++k) {
+				Vertex v = corners[t][k];
+				v.Position = glm::vec3(positions[triangles[t][k]]);
+				if (flat[t][k]) v.Normal = n;
+				ret.emplace_back(v);
+			}
+		}
+		return ret;
+	}
+};
+
+int main(int argc, char **argv) {
+	uint32_t levels = 2;
+	float ratio = 0.5f;
+	std::vector< std::string > files;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--levels" && i + 1 < argc) {
+			levels = uint32_t(std::stoul(argv[i+1]));
+			i += 1;
+		} else if (arg == "--ratio" && i + 1 < argc) {
+			ratio = std::stof(argv[i+1]);
+			i += 1;
+		} else {
+			files.emplace_back(arg);
+		}
+	}
+	if (files.size() != 2 || !(ratio > 0.0f && ratio < 1.0f)) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--levels <n>] [--ratio <r>] <in.pnct> <out.pnct>" << std::endl;
+		return 1;
+	}
+	std::string in_file = files[0];
+	std::string out_file = files[1];
+
+	//levels with fewer triangles than this aren't worth a draw call of their own:
+	const uint32_t MinTriangles = 4;
+
+	try {
+		std::vector< Vertex > vertices;
+		std::vector< char > strings;
+		std::vector< IndexEntry > index;
+
+		//--- read, expanding indexed meshes to triangle lists ---
+		std::vector< std::string > names;
+		std::vector< std::vector< Vertex > > meshes;
+		{
+			ChunkReader file(in_file);
+			Span< Vertex > data = file.read< Vertex >("pnct");
+
+			bool indexed = false;
+			std::vector< uint32_t > elements;
+			if (file.peek("el16")) {
+				Span< uint16_t > e = file.read< uint16_t >("el16");
+				elements.assign(e.begin(), e.end());
+				indexed = true;
+			} else if (file.peek("el32")) {
+				Span< uint32_t > e = file.read< uint32_t >("el32");
+				elements.assign(e.begin(), e.end());
+				indexed = true;
+			}
+
+			Span< char > in_strings = file.read< char >("str0");
+			Span< IndexEntry > in_index = file.read< IndexEntry >(indexed ? "idx1" : "idx0");
+
+			for (IndexEntry const &entry : in_index) {
+				if (!(entry.name_begin <= entry.name_end && entry.name_end <= in_strings.size())) {
+					throw std::runtime_error("index entry has out-of-range name begin/end");
+				}
+				std::string name(in_strings.data() + entry.name_begin, in_strings.data() + entry.name_end);
+				if (!(entry.begin <= entry.end && entry.end <= (indexed ? elements.size() : data.size()))) {
+					throw std::runtime_error("mesh '" + name + "' has out-of-range start/count");
+				}
+				if ((entry.end - entry.begin) % 3 != 0) {
+					throw std::runtime_error("mesh '" + name + "' isn't a list of triangles");
+				}
+				names.emplace_back(name);
+				meshes.emplace_back();
+				for (uint32_t i = entry.begin; i < entry.end; ++i) {
+					uint32_t v = (indexed ? elements[i] : i);
+					if (v >= data.size()) throw std::runtime_error("mesh '" + name + "' has out-of-range element");
+					meshes.back().emplace_back(data[v]);
+				}
+			}
+		}
+
+		std::set< std::string > existing(names.begin(), names.end());
+		auto add_mesh = [&](std::string const &name, std::vector< Vertex > const &mesh) {
+			IndexEntry entry;
+			entry.name_begin = uint32_t(strings.size());
+			strings.insert(strings.end(), name.begin(), name.end());
+			entry.name_end = uint32_t(strings.size());
+			entry.begin = uint32_t(vertices.size());
+			vertices.insert(vertices.end(), mesh.begin(), mesh.end());
+			entry.end = uint32_t(vertices.size());
+			index.emplace_back(entry);
+		};
+
+		//--- copy meshes and add levels of detail ---
+		for (uint32_t m = 0; m < meshes.size(); ++m) {
+			add_mesh(names[m], meshes[m]);
+		}
+		uint32_t lods_added = 0;
+		for (uint32_t m = 0; m < meshes.size(); ++m) {
+			std::string const &name = names[m];
+			if (name.find(".LOD") != std::string::npos) continue; //(is itself a level of detail)
+			if (existing.count(name + ".LOD1")) continue; //(has authored levels of detail)
+
+			Simplifier simplifier(meshes[m]);
+			uint32_t triangles = simplifier.alive;
+			std::cout << "'" << name << "': " << triangles << " triangles";
+			uint32_t previous = triangles;
+			for (uint32_t level = 1; level <= levels; ++level) {
+				uint32_t target = uint32_t(std::floor(double(triangles) * std::pow(double(ratio), double(level))));
+				if (target < MinTriangles) break;
+				simplifier.simplify(target);
+				//stop once simplification stalls (every edge left is a boundary or would fold the surface):
+				if (simplifier.alive > previous - std::max(1u, uint32_t((1.0f - ratio) * 0.5f * float(previous)))) break;
+				previous = simplifier.alive;
+				add_mesh(name + ".LOD" + std::to_string(level), simplifier.triangle_list());
+				lods_added += 1;
+				std::cout << " -> " << simplifier.alive << " (max cost " << simplifier.max_cost << ")";
+			}
+			std::cout << std::endl;
+		}
+
+		std::ofstream out(out_file, std::ios::binary);
+		write_chunk("pnct", vertices, &out);
+		write_chunk("str0", strings, &out);
+		write_chunk("idx0", index, &out);
+		{ //hash table over mesh names (so MeshBuffer doesn't need to build one):
+			std::vector< uint32_t > duplicates;
+			std::vector< uint32_t > name_table = make_mesh_name_table(uint32_t(index.size()), [&](uint32_t i) {
+				return std::string_view(strings.data() + index[i].name_begin, index[i].name_end - index[i].name_begin);
+			}, &duplicates);
+			for (uint32_t i : duplicates) {
+				std::cerr << "WARNING: mesh name '" << std::string(strings.data() + index[i].name_begin, strings.data() + index[i].name_end) << "' is used more than once; only the first will be found." << std::endl;
+			}
+			write_chunk("hsh0", name_table, &out);
+		}
+		if (!out) throw std::runtime_error("Failed to write '" + out_file + "'.");
+		out.close();
+
+		std::cout << "Wrote " << meshes.size() << " meshes and " << lods_added << " levels of detail (" << vertices.size() << " vertices) to '" << out_file << "'." << std::endl;
+	} catch (std::exception const &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,379 @@
+//weld-meshes converts a mesh file (.pnct) into its indexed form (see Mesh.hpp):
+// - identical vertices are merged ("welded") into one,
+//   (where "identical" means colors match and positions, normals, and texture coordinates
+//    match after rounding to a multiple of the tolerance -- this catches exporter float noise)
+// - each mesh's triangles are reordered so that recently-used vertices get reused
+//   (improving post-transform vertex cache hits; see optimize_triangle_order below),
+// - vertices are reordered by first use (improving vertex fetch locality),
+// - indices are 16-bit if there are few enough vertices.
+//
+//Usage:
+//	weld-meshes [--tolerance <t>] <in.pnct> <out.pnct>
+//
+//The default tolerance is 0.0001; use --tolerance 0 to weld only bit-for-bit identical vertices.
+//
+//The input may be plain (pnct, str0, idx0) or already indexed (pnct, el16/el32, str0, idx1);
+// the output is always indexed (pnct, el16 or el32, str0, idx1, hsh0).
+
+#include "ChunkReader.hpp"
+#include "read_write_chunk.hpp"
+#include "mesh_name_table.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//same layout as MeshBuffer reads:
+struct Vertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::u8vec4 Color;
+	glm::vec2 TexCoord;
+};
+static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+struct IndexEntry {
+	uint32_t name_begin, name_end;
+	uint32_t begin, end; //vertex range (idx0) or element range (idx1)
+};
+static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+//vertices are welded if their keys are equal:
+struct VertexKey {
+	int64_t values[8]; //position, normal, texcoord -- rounded to multiples of tolerance (or bit patterns if tolerance is zero)
+	uint32_t color;
+	VertexKey(Vertex const &v, float tolerance) {
+		float const floats[8] = {
+			v.Position.x, v.Position.y, v.Position.z,
+			v.Normal.x, v.Normal.y, v.Normal.z,
+			v.TexCoord.x, v.TexCoord.y
+		};
+		for (uint32_t i = 0; i < 8; ++i) {
+			if (tolerance > 0.0f) {
+				values[i] = int64_t(std::llround(double(floats[i]) / double(tolerance)));
+			} else {
+				uint32_t bits;
+				std::memcpy(&bits, &floats[i], 4);
+				values[i] = bits;
+			}
+		}
+		std::memcpy(&color, &v.Color, 4);
+	}
+	bool operator==(VertexKey const &o) const {
+		return std::equal(values, values + 8, o.values) && color == o.color;
+	}
+};
+struct VertexKeyHash {
+	size_t operator()(VertexKey const &k) const {
+		uint64_t h = 0xcbf29ce484222325ULL; //FNV-1a over values
+		for (int64_t v : k.values) {
+			h = (h ^ uint64_t(v)) * 0x100000001b3ULL;
+		}
+		h = (h ^ k.color) * 0x100000001b3ULL;
+		return size_t(h);
+	}
+};
+
+//fraction of vertices that would miss in a FIFO post-transform cache of the given size, per triangle
+// ("average cache miss ratio"; 3.0 is worst, ~0.5 is typical for well-ordered meshes):
+static float acmr(std::vector< uint32_t > const &indices, uint32_t cache_size = 16) {
+	if (indices.empty()) return 0.0f;
+	std::vector< uint32_t > fifo;
+	uint32_t misses = 0;
+	for (uint32_t i : indices) {
+		if (std::find(fifo.begin(), fifo.end(), i) != fifo.end()) continue;
+		misses += 1;
+		fifo.emplace_back(i);
+		if (fifo.size() > cache_size) fifo.erase(fifo.begin());
+	}
+	return float(misses) / float(indices.size() / 3);
+}
+
+//reorder triangles (in place) so vertices are reused while they're likely still in the post-transform cache:
+// this is Tom Forsyth's "Linear-Speed Vertex Cache Optimisation" (2006): greedily emit the triangle whose
+// vertices score highest, where vertices score well if they are recently used or have few triangles left.
+static void optimize_triangle_order(std::vector< uint32_t > &indices) {
+	const uint32_t CacheSize = 32; //modeled cache size
+	const float CacheDecayPower = 1.5f;
+	const float LastTriScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+
+	uint32_t triangles = uint32_t(indices.size() / 3);
+	if (triangles < 2) return;
+
+	//renumber vertices densely (so per-vertex arrays are sized by this mesh, not the whole file):
+	std::unordered_map< uint32_t, uint32_t > local_of;
+	std::vector< uint32_t > global_of;
+	std::vector< uint32_t > local(indices.size());
+	for (uint32_t i = 0; i < indices.size(); ++i) {
+		auto ret = local_of.emplace(indices[i], uint32_t(global_of.size()));
+		if (ret.second) global_of.emplace_back(indices[i]);
+		local[i] = ret.first->second;
+	}
+	uint32_t vertices = uint32_t(global_of.size());
+
+	//triangles using each vertex (as ranges of 'adjacent'):
+	std::vector< uint32_t > remaining(vertices, 0); //triangles not yet emitted that use this vertex
+	for (uint32_t v : local) remaining[v] += 1;
+	std::vector< uint32_t > adjacent_begin(vertices + 1, 0);
+	for (uint32_t v = 0; v < vertices; ++v) adjacent_begin[v+1] = adjacent_begin[v] + remaining[v];
+	std::vector< uint32_t > adjacent(local.size());
+	{
+		std::vector< uint32_t > fill(adjacent_begin.begin(), adjacent_begin.end() - 1);
+		for (uint32_t i = 0; i < local.size(); ++i) {
+			adjacent[fill[local[i]]++] = i / 3;
+		}
+	}
+
+	std::vector< int32_t > cache_position(vertices, -1);
+	std::vector< float > vertex_score(vertices, 0.0f);
+	auto score = [&](uint32_t v) -> float {
+		if (remaining[v] == 0) return -1.0f; //no triangles left to use it
+		float s = 0.0f;
+		int32_t p = cache_position[v];
+		if (p >= 0) {
+			if (p < 3) {
+				//used by the last triangle; fixed score so those vertices aren't favored too much:
+				s = LastTriScore;
+			} else {
+				s = std::pow(1.0f - float(p - 3) / float(CacheSize - 3), CacheDecayPower);
+			}
+		}
+		//boost vertices with few triangles left, so they get finished off:
+		s += ValenceBoostScale * std::pow(float(remaining[v]), -ValenceBoostPower);
+		return s;
+	};
+	for (uint32_t v = 0; v < vertices; ++v) vertex_score[v] = score(v);
+
+	std::vector< float > triangle_score(triangles);
+	std::vector< uint8_t > emitted(triangles, 0);
+	for (uint32_t t = 0; t < triangles; ++t) {
+		triangle_score[t] = vertex_score[local[3*t+0]] + vertex_score[local[3*t+1]] + vertex_score[local[3*t+2]];
+	}
+
+	std::vector< uint32_t > cache; //most recent first
+	std::vector< uint32_t > out;
+	out.reserve(indices.size());
+
+	uint32_t best = 0;
+	for (uint32_t t = 1; t < triangles; ++t) {
+		if (triangle_score[t] > triangle_score[best]) best = t;
+	}
+	uint32_t scan = 0; //(for finding a fresh start when the cache has nothing useful)
+
+	for (uint32_t emitted_count = 0; emitted_count < triangles; ++emitted_count) {
+		//emit 'best':
+		emitted[best] = 1;
+		std::vector< uint32_t > next_cache;
+		next_cache.reserve(CacheSize + 3);
+		for (uint32_t c = 0; c < 3; ++c) {
+			uint32_t v = local[3*best+c];
+			out.emplace_back(global_of[v]);
+
+			//remove triangle from vertex's adjacency list:
+			uint32_t *begin = &adjacent[adjacent_begin[v]];
+			uint32_t *end = begin + remaining[v];
+			uint32_t *f = std::find(begin, end, best);
+			assert(f != end);
+			std::swap(*f, *(end - 1));
+			remaining[v] -= 1;
+
+			next_cache.emplace_back(v);
+		}
+		for (uint32_t v : cache) {
+			if (std::find(next_cache.begin(), next_cache.end(), v) == next_cache.end()) next_cache.emplace_back(v);
+		}
+
+		//update cache positions (vertices past the end fall out of the cache):
+		for (uint32_t i = 0; i < next_cache.size(); ++i) {
+			cache_position[next_cache[i]] = (i < CacheSize ? int32_t(i) : -1);
+		}
+		if (next_cache.size() > CacheSize) {
+			for (uint32_t i = CacheSize; i < next_cache.size(); ++i) {
+				vertex_score[next_cache[i]] = score(next_cache[i]);
+			}
+		}
+
+		//re-score vertices in cache and their triangles, picking the best of those triangles:
+		float best_score = -1.0f;
+		uint32_t next_best = -1U;
+		for (uint32_t i = 0; i < next_cache.size(); ++i) {
+			uint32_t v = next_cache[i];
+			if (i < CacheSize) vertex_score[v] = score(v);
+		}
+		for (uint32_t i = 0; i < next_cache.size(); ++i) {
+			uint32_t v = next_cache[i];
+			for (uint32_t a = adjacent_begin[v]; a < adjacent_begin[v] + remaining[v]; ++a) {
+				uint32_t t = adjacent[a];
+				float s = vertex_score[local[3*t+0]] + vertex_score[local[3*t+1]] + vertex_score[local[3*t+2]];
+				triangle_score[t] = s;
+				if (s > best_score) {
+					best_score = s;
+					next_best = t;
+				}
+			}
+		}
+		if (next_cache.size() > CacheSize) next_cache.resize(CacheSize);
+		cache = std::move(next_cache);
+
+		if (next_best == -1U) {
+			//nothing in the cache has triangles left; start again somewhere else:
+			while (scan < triangles && emitted[scan]) ++scan;
+			next_best = scan;
+		}
+		best = next_best;
+	}
+
+	assert(out.size() == indices.size());
+	indices = std::move(out);
+}
+
+int main(int argc, char **argv) {
+	float tolerance = 0.0001f;
+	std::vector< std::string > files;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--tolerance" && i + 1 < argc) {
+			tolerance = std::stof(argv[i+1]);
+			i += 1;
+		} else {
+			files.emplace_back(arg);
+		}
+	}
+	if (files.size() != 2 || !(tolerance >= 0.0f)) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--tolerance <t>] <in.pnct> <out.pnct>" << std::endl;
+		return 1;
+	}
+	std::string in_file = files[0];
+	std::string out_file = files[1];
+
+	try {
+		std::vector< Vertex > vertices; //welded vertices
+		std::vector< uint32_t > elements;
+		std::vector< char > strings;
+		std::vector< IndexEntry > index;
+
+		size_t in_bytes = 0;
+		size_t in_vertices = 0;
+		float acmr_before = 0.0f, acmr_after = 0.0f;
+
+		{ //read, weld, and reorder triangles of each mesh:
+			ChunkReader file(in_file);
+			in_bytes = file.file.size;
+
+			Span< Vertex > data = file.read< Vertex >("pnct");
+			in_vertices = data.size();
+
+			bool indexed = false;
+			std::vector< uint32_t > in_elements;
+			if (file.peek("el16")) {
+				Span< uint16_t > e = file.read< uint16_t >("el16");
+				in_elements.assign(e.begin(), e.end());
+				indexed = true;
+			} else if (file.peek("el32")) {
+				Span< uint32_t > e = file.read< uint32_t >("el32");
+				in_elements.assign(e.begin(), e.end());
+				indexed = true;
+			}
+
+			Span< char > in_strings = file.read< char >("str0");
+			strings.assign(in_strings.begin(), in_strings.end());
+
+			Span< IndexEntry > in_index = file.read< IndexEntry >(indexed ? "idx1" : "idx0");
+
+			std::unordered_map< VertexKey, uint32_t, VertexKeyHash > welded;
+			std::vector< uint32_t > all_before; //all meshes' indices before reordering (for stats)
+
+			for (IndexEntry const &entry : in_index) {
+				if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+					throw std::runtime_error("index entry has out-of-range name begin/end");
+				}
+				std::string name(strings.data() + entry.name_begin, strings.data() + entry.name_end);
+				if (!(entry.begin <= entry.end && entry.end <= (indexed ? in_elements.size() : data.size()))) {
+					throw std::runtime_error("mesh '" + name + "' has out-of-range start/count");
+				}
+				if ((entry.end - entry.begin) % 3 != 0) {
+					throw std::runtime_error("mesh '" + name + "' isn't a list of triangles");
+				}
+
+				std::vector< uint32_t > indices;
+				indices.reserve(entry.end - entry.begin);
+				for (uint32_t i = entry.begin; i < entry.end; ++i) {
+					uint32_t v = (indexed ? in_elements[i] : i);
+					if (v >= data.size()) throw std::runtime_error("mesh '" + name + "' has out-of-range element");
+					auto ret = welded.emplace(VertexKey(data[v], tolerance), uint32_t(vertices.size()));
+					if (ret.second) vertices.emplace_back(data[v]);
+					indices.emplace_back(ret.first->second);
+				}
+
+				all_before.insert(all_before.end(), indices.begin(), indices.end());
+				optimize_triangle_order(indices);
+
+				IndexEntry out_entry = entry;
+				out_entry.begin = uint32_t(elements.size());
+				elements.insert(elements.end(), indices.begin(), indices.end());
+				out_entry.end = uint32_t(elements.size());
+				index.emplace_back(out_entry);
+			}
+
+			acmr_before = acmr(all_before);
+			acmr_after = acmr(elements);
+		}
+
+		{ //reorder vertices by first use (and drop any that aren't used):
+			std::vector< uint32_t > remap(vertices.size(), -1U);
+			std::vector< Vertex > ordered;
+			ordered.reserve(vertices.size());
+			for (uint32_t &e : elements) {
+				if (remap[e] == -1U) {
+					remap[e] = uint32_t(ordered.size());
+					ordered.emplace_back(vertices[e]);
+				}
+				e = remap[e];
+			}
+			vertices = std::move(ordered);
+		}
+
+		std::ofstream out(out_file, std::ios::binary);
+		write_chunk("pnct", vertices, &out);
+		if (vertices.size() <= 0x10000) {
+			std::vector< uint16_t > elements16(elements.begin(), elements.end());
+			write_chunk("el16", elements16, &out);
+		} else {
+			write_chunk("el32", elements, &out);
+		}
+		write_chunk("str0", strings, &out);
+		write_chunk("idx1", index, &out);
+		{ //hash table over mesh names (so MeshBuffer doesn't need to build one):
+			std::vector< uint32_t > duplicates;
+			std::vector< uint32_t > name_table = make_mesh_name_table(uint32_t(index.size()), [&](uint32_t i) {
+				return std::string_view(strings.data() + index[i].name_begin, index[i].name_end - index[i].name_begin);
+			}, &duplicates);
+			for (uint32_t i : duplicates) {
+				std::cerr << "WARNING: mesh name '" << std::string(strings.data() + index[i].name_begin, strings.data() + index[i].name_end) << "' is used more than once; only the first will be found." << std::endl;
+			}
+			write_chunk("hsh0", name_table, &out);
+		}
+		size_t out_bytes = size_t(out.tellp());
+		if (!out) throw std::runtime_error("Failed to write '" + out_file + "'.");
+
+		std::cout << "Wrote " << index.size() << " meshes to '" << out_file << "':\n"
+			<< "  " << in_vertices << " vertices welded to " << vertices.size() << " (" << elements.size() << " " << (vertices.size() <= 0x10000 ? 16 : 32) << "-bit indices)\n"
+			<< "  " << in_bytes << " bytes -> " << out_bytes << " bytes\n"
+			<< "  vertex cache misses per triangle (16-entry FIFO): " << acmr_before << " -> " << acmr_after << std::endl;
+	} catch (std::exception const &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}